@@ -38,8 +38,22 @@
 #include <stdlib.h>
 #include <string.h>
 
-/*	error reporting	*/
-char *result_string_pointer = "SOIL initialized";
+/*	error reporting, per thread so images decoded on several threads
+	each see their own result (stb_image's failure reason is per thread too)	*/
+#if defined(_MSC_VER)
+	#define SOIL_THREAD_LOCAL	__declspec(thread)
+#elif defined(__GNUC__)
+	#define SOIL_THREAD_LOCAL	__thread
+#else
+	#define SOIL_THREAD_LOCAL
+#endif
+static SOIL_THREAD_LOCAL const char *result_string_pointer = "SOIL initialized";
+
+/*	capability queries, the application's if it set them	*/
+static int (*soil_has_extension)( const char *name ) = NULL;
+static int (*soil_get_integer)( unsigned int pname ) = NULL;
+static int SOIL_internal_has_extension( const char *name );
+static int SOIL_internal_get_integer( unsigned int pname );
 
 /*	for loading cube maps	*/
 enum{
@@ -95,7 +109,7 @@ unsigned int SOIL_direct_load_DDS_from_memory(
 unsigned int
 	SOIL_internal_create_OGL_texture
 	(
-		const unsigned char *const data,
+		unsigned char *img,
 		int width, int height, int channels,
 		unsigned int reuse_texture_ID,
 		unsigned int flags,
@@ -151,8 +165,6 @@ unsigned int
 			reuse_texture_ID, flags,
 			GL_TEXTURE_2D, GL_TEXTURE_2D,
 			GL_MAX_TEXTURE_SIZE );
-	/*	and nuke the image data	*/
-	SOIL_free_image_data( img );
 	/*	and return the handle, such as it is	*/
 	return tex_id;
 }
@@ -203,8 +215,6 @@ unsigned int
 			reuse_texture_ID, flags,
 			GL_TEXTURE_2D, GL_TEXTURE_2D,
 			GL_MAX_TEXTURE_SIZE );
-	/*	and nuke the image data	*/
-	SOIL_free_image_data( img );
 	/*	and return the handle, such as it is	*/
 	return tex_id;
 }
@@ -261,8 +271,6 @@ unsigned int
 			reuse_texture_ID, flags,
 			GL_TEXTURE_2D, GL_TEXTURE_2D,
 			GL_MAX_TEXTURE_SIZE );
-	/*	and nuke the image data	*/
-	SOIL_free_image_data( img );
 	/*	and return the handle, such as it is	*/
 	return tex_id;
 }
@@ -321,8 +329,6 @@ unsigned int
 			reuse_texture_ID, flags,
 			SOIL_TEXTURE_CUBE_MAP, SOIL_TEXTURE_CUBE_MAP_POSITIVE_X,
 			SOIL_MAX_CUBE_MAP_TEXTURE_SIZE );
-	/*	and nuke the image data	*/
-	SOIL_free_image_data( img );
 	/*	continue?	*/
 	if( tex_id != 0 )
 	{
@@ -345,8 +351,6 @@ unsigned int
 				tex_id, flags,
 				SOIL_TEXTURE_CUBE_MAP, SOIL_TEXTURE_CUBE_MAP_NEGATIVE_X,
 				SOIL_MAX_CUBE_MAP_TEXTURE_SIZE );
-		/*	and nuke the image data	*/
-		SOIL_free_image_data( img );
 	}
 	/*	continue?	*/
 	if( tex_id != 0 )
@@ -370,8 +374,6 @@ unsigned int
 				tex_id, flags,
 				SOIL_TEXTURE_CUBE_MAP, SOIL_TEXTURE_CUBE_MAP_POSITIVE_Y,
 				SOIL_MAX_CUBE_MAP_TEXTURE_SIZE );
-		/*	and nuke the image data	*/
-		SOIL_free_image_data( img );
 	}
 	/*	continue?	*/
 	if( tex_id != 0 )
@@ -395,8 +397,6 @@ unsigned int
 				tex_id, flags,
 				SOIL_TEXTURE_CUBE_MAP, SOIL_TEXTURE_CUBE_MAP_NEGATIVE_Y,
 				SOIL_MAX_CUBE_MAP_TEXTURE_SIZE );
-		/*	and nuke the image data	*/
-		SOIL_free_image_data( img );
 	}
 	/*	continue?	*/
 	if( tex_id != 0 )
@@ -420,8 +420,6 @@ unsigned int
 				tex_id, flags,
 				SOIL_TEXTURE_CUBE_MAP, SOIL_TEXTURE_CUBE_MAP_POSITIVE_Z,
 				SOIL_MAX_CUBE_MAP_TEXTURE_SIZE );
-		/*	and nuke the image data	*/
-		SOIL_free_image_data( img );
 	}
 	/*	continue?	*/
 	if( tex_id != 0 )
@@ -445,8 +443,6 @@ unsigned int
 				tex_id, flags,
 				SOIL_TEXTURE_CUBE_MAP, SOIL_TEXTURE_CUBE_MAP_NEGATIVE_Z,
 				SOIL_MAX_CUBE_MAP_TEXTURE_SIZE );
-		/*	and nuke the image data	*/
-		SOIL_free_image_data( img );
 	}
 	/*	and return the handle, such as it is	*/
 	return tex_id;
@@ -514,8 +510,6 @@ unsigned int
 			reuse_texture_ID, flags,
 			SOIL_TEXTURE_CUBE_MAP, SOIL_TEXTURE_CUBE_MAP_POSITIVE_X,
 			SOIL_MAX_CUBE_MAP_TEXTURE_SIZE );
-	/*	and nuke the image data	*/
-	SOIL_free_image_data( img );
 	/*	continue?	*/
 	if( tex_id != 0 )
 	{
@@ -540,8 +534,6 @@ unsigned int
 				tex_id, flags,
 				SOIL_TEXTURE_CUBE_MAP, SOIL_TEXTURE_CUBE_MAP_NEGATIVE_X,
 				SOIL_MAX_CUBE_MAP_TEXTURE_SIZE );
-		/*	and nuke the image data	*/
-		SOIL_free_image_data( img );
 	}
 	/*	continue?	*/
 	if( tex_id != 0 )
@@ -567,8 +559,6 @@ unsigned int
 				tex_id, flags,
 				SOIL_TEXTURE_CUBE_MAP, SOIL_TEXTURE_CUBE_MAP_POSITIVE_Y,
 				SOIL_MAX_CUBE_MAP_TEXTURE_SIZE );
-		/*	and nuke the image data	*/
-		SOIL_free_image_data( img );
 	}
 	/*	continue?	*/
 	if( tex_id != 0 )
@@ -594,8 +584,6 @@ unsigned int
 				tex_id, flags,
 				SOIL_TEXTURE_CUBE_MAP, SOIL_TEXTURE_CUBE_MAP_NEGATIVE_Y,
 				SOIL_MAX_CUBE_MAP_TEXTURE_SIZE );
-		/*	and nuke the image data	*/
-		SOIL_free_image_data( img );
 	}
 	/*	continue?	*/
 	if( tex_id != 0 )
@@ -621,8 +609,6 @@ unsigned int
 				tex_id, flags,
 				SOIL_TEXTURE_CUBE_MAP, SOIL_TEXTURE_CUBE_MAP_POSITIVE_Z,
 				SOIL_MAX_CUBE_MAP_TEXTURE_SIZE );
-		/*	and nuke the image data	*/
-		SOIL_free_image_data( img );
 	}
 	/*	continue?	*/
 	if( tex_id != 0 )
@@ -648,8 +634,6 @@ unsigned int
 				tex_id, flags,
 				SOIL_TEXTURE_CUBE_MAP, SOIL_TEXTURE_CUBE_MAP_NEGATIVE_Z,
 				SOIL_MAX_CUBE_MAP_TEXTURE_SIZE );
-		/*	and nuke the image data	*/
-		SOIL_free_image_data( img );
 	}
 	/*	and return the handle, such as it is	*/
 	return tex_id;
@@ -889,20 +873,24 @@ unsigned int
 		dh = width;
 	}
 	sz = dw+dh;
-	sub_img = (unsigned char *)malloc( sz*sz*channels );
 	/*	do the splitting and uploading	*/
 	tex_id = reuse_texture_ID;
 	for( i = 0; i < 6; ++i )
 	{
-		int x, y, idx = 0;
+		int y;
 		unsigned int cubemap_target = 0;
-		/*	copy in the sub-image	*/
-		for( y = i*dh; y < i*dh+sz; ++y )
+		/*	copy in the sub-image, which the upload takes over	*/
+		sub_img = (unsigned char *)malloc( sz*sz*channels );
+		if( sub_img == NULL )
 		{
-			for( x = i*dw*channels; x < (i*dw+sz)*channels; ++x )
-			{
-				sub_img[idx++] = data[y*width*channels+x];
-			}
+			result_string_pointer = "Out of memory";
+			return 0;
+		}
+		for( y = 0; y < sz; ++y )
+		{
+			memcpy( sub_img + y*sz*channels,
+					data + ((i*dh + y)*width + i*dw)*channels,
+					sz*channels );
 		}
 		/*	what is my texture target?
 			remember, this coordinate system is
@@ -936,8 +924,6 @@ unsigned int
 				cubemap_target,
 				SOIL_MAX_CUBE_MAP_TEXTURE_SIZE );
 	}
-	/*	and nuke the image and sub-image data	*/
-	SOIL_free_image_data( sub_img );
 	/*	and return the handle, such as it is	*/
 	return tex_id;
 }
@@ -951,9 +937,22 @@ unsigned int
 		unsigned int flags
 	)
 {
-	/*	wrapper function for 2D textures	*/
+	/*	wrapper function for 2D textures, working on a copy of the user's data	*/
+	unsigned char *img;
+	if( data == NULL )
+	{
+		result_string_pointer = "Invalid image data";
+		return 0;
+	}
+	img = (unsigned char*)malloc( width*height*channels );
+	if( img == NULL )
+	{
+		result_string_pointer = "Out of memory";
+		return 0;
+	}
+	memcpy( img, data, width*height*channels );
 	return SOIL_internal_create_OGL_texture(
-				data, width, height, channels,
+				img, width, height, channels,
 				reuse_texture_ID, flags,
 				GL_TEXTURE_2D, GL_TEXTURE_2D,
 				GL_MAX_TEXTURE_SIZE );
@@ -977,10 +976,40 @@ void check_for_GL_errors( const char *calling_location )
 }
 #endif
 
+/*	swaps rows top to bottom, a chunk of each pair at a time	*/
+static void
+	invert_image_rows
+	(
+		unsigned char *img,
+		int row_bytes, int height
+	)
+{
+	unsigned char temp[1024];
+	int j;
+	for( j = 0; j*2 < height - 1; ++j )
+	{
+		unsigned char *row1 = img + j * row_bytes;
+		unsigned char *row2 = img + (height - 1 - j) * row_bytes;
+		int i;
+		for( i = 0; i < row_bytes; i += sizeof( temp ) )
+		{
+			int n = row_bytes - i;
+			if( n > (int)sizeof( temp ) )
+			{
+				n = sizeof( temp );
+			}
+			memcpy( temp, row1 + i, n );
+			memcpy( row1 + i, row2 + i, n );
+			memcpy( row2 + i, temp, n );
+		}
+	}
+}
+
+/*	takes ownership of img, which is modified in place and freed	*/
 unsigned int
 	SOIL_internal_create_OGL_texture
 	(
-		const unsigned char *const data,
+		unsigned char *img,
 		int width, int height, int channels,
 		unsigned int reuse_texture_ID,
 		unsigned int flags,
@@ -990,7 +1019,6 @@ unsigned int
 	)
 {
 	/*	variables	*/
-	unsigned char* img;
 	unsigned int tex_id;
 	unsigned int internal_texture_format = 0, original_texture_format = 0;
 	int DXT_mode = SOIL_CAPABILITY_UNKNOWN;
@@ -1021,30 +1049,15 @@ unsigned int
 		} else
 		{
 			/*	can't do it, and that is a breakable offense (uv coords use pixels instead of [0,1]!)	*/
+			SOIL_free_image_data( img );
 			result_string_pointer = "Texture Rectangle extension unsupported";
 			return 0;
 		}
 	}
-	/*	create a copy the image data	*/
-	img = (unsigned char*)malloc( width*height*channels );
-	memcpy( img, data, width*height*channels );
 	/*	does the user want me to invert the image?	*/
 	if( flags & SOIL_FLAG_INVERT_Y )
 	{
-		int i, j;
-		for( j = 0; j*2 < height; ++j )
-		{
-			int index1 = j * width * channels;
-			int index2 = (height - 1 - j) * width * channels;
-			for( i = width * channels; i > 0; --i )
-			{
-				unsigned char temp = img[index1];
-				img[index1] = img[index2];
-				img[index2] = temp;
-				++index1;
-				++index2;
-			}
-		}
+		invert_image_rows( img, width*channels, height );
 	}
 	/*	does the user want me to scale the colors into the NTSC safe RGB range?	*/
 	if( flags & SOIL_FLAG_NTSC_SAFE_RGB )
@@ -1086,7 +1099,7 @@ unsigned int
 	}
 	/*	how large of a texture can this OpenGL implementation handle?	*/
 	/*	texture_check_size_enum will be GL_MAX_TEXTURE_SIZE or SOIL_MAX_CUBE_MAP_TEXTURE_SIZE	*/
-	glGetIntegerv( texture_check_size_enum, &max_supported_size );
+	max_supported_size = SOIL_internal_get_integer( texture_check_size_enum );
 	/*	do I need to make it a power of 2?	*/
 	if(
 		(flags & SOIL_FLAG_POWER_OF_TWO) ||	/*	user asked for it	*/
@@ -1145,8 +1158,15 @@ unsigned int
 		new_height = height / reduce_block_y;
 		resampled = (unsigned char*)malloc( channels*new_width*new_height );
 		/*	perform the actual reduction	*/
-		mipmap_image(	img, width, height, channels,
-						resampled, reduce_block_x, reduce_block_y );
+		if( flags & SOIL_FLAG_GAMMA_CORRECT_MIPMAPS )
+		{
+			mipmap_image_sRGB(	img, width, height, channels,
+								resampled, reduce_block_x, reduce_block_y );
+		} else
+		{
+			mipmap_image(	img, width, height, channels,
+							resampled, reduce_block_x, reduce_block_y );
+		}
 		/*	nuke the old guy, then point it at the new guy	*/
 		SOIL_free_image_data( img );
 		img = resampled;
@@ -1265,10 +1285,19 @@ unsigned int
 			while( ((1<<MIPlevel) <= width) || ((1<<MIPlevel) <= height) )
 			{
 				/*	do this MIPmap level	*/
-				mipmap_image(
-						img, width, height, channels,
-						resampled,
-						(1 << MIPlevel), (1 << MIPlevel) );
+				if( flags & SOIL_FLAG_GAMMA_CORRECT_MIPMAPS )
+				{
+					mipmap_image_sRGB(
+							img, width, height, channels,
+							resampled,
+							(1 << MIPlevel), (1 << MIPlevel) );
+				} else
+				{
+					mipmap_image(
+							img, width, height, channels,
+							resampled,
+							(1 << MIPlevel), (1 << MIPlevel) );
+				}
 				/*  upload the MIPmaps	*/
 				if( DXT_mode == SOIL_CAPABILITY_PRESENT )
 				{
@@ -1374,7 +1403,6 @@ int
 	)
 {
 	unsigned char *pixel_data;
-	int i, j;
 	int save_result;
 
 	/*	error checks	*/
@@ -1399,19 +1427,7 @@ int
     glReadPixels (x, y, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixel_data);
 
     /*	invert the image	*/
-    for( j = 0; j*2 < height; ++j )
-	{
-		int index1 = j * width * 3;
-		int index2 = (height - 1 - j) * width * 3;
-		for( i = width * 3; i > 0; --i )
-		{
-			unsigned char temp = pixel_data[index1];
-			pixel_data[index1] = pixel_data[index2];
-			pixel_data[index2] = temp;
-			++index1;
-			++index2;
-		}
-	}
+    invert_image_rows( pixel_data, width*3, height );
 
     /*	save the image	*/
     save_result = SOIL_save_image( filename, image_type, width, height, 3, pixel_data);
@@ -1464,6 +1480,71 @@ unsigned char*
 	return result;
 }
 
+int
+	SOIL_image_info
+	(
+		const char *filename,
+		int *width, int *height, int *channels
+	)
+{
+	int result = stbi_info( filename, width, height, channels );
+	/*	only failures are recorded, so header probes spread over
+		worker threads don't all write the shared result string	*/
+	if( result == 0 )
+	{
+		result_string_pointer = stbi_failure_reason();
+	}
+	return result;
+}
+
+int
+	SOIL_load_image_into
+	(
+		const char *filename,
+		int *width, int *height, int *channels,
+		int force_channels,
+		unsigned char *dest, int dest_pitch,
+		int max_width, int max_height
+	)
+{
+	int result = stbi_load_into( filename,
+			width, height, channels, force_channels,
+			dest, dest_pitch, max_width, max_height );
+	if( result == 0 )
+	{
+		result_string_pointer = stbi_failure_reason();
+	} else
+	{
+		result_string_pointer = "Image loaded";
+	}
+	return result;
+}
+
+int
+	SOIL_load_image_from_memory_into
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		int *width, int *height, int *channels,
+		int force_channels,
+		unsigned char *dest, int dest_pitch,
+		int max_width, int max_height
+	)
+{
+	int result = stbi_load_from_memory_into(
+				buffer, buffer_length,
+				width, height, channels, force_channels,
+				dest, dest_pitch, max_width, max_height );
+	if( result == 0 )
+	{
+		result_string_pointer = stbi_failure_reason();
+	} else
+	{
+		result_string_pointer = "Image loaded from memory";
+	}
+	return result;
+}
+
 int
 	SOIL_save_image
 	(
@@ -1529,6 +1610,63 @@ const char*
 	return result_string_pointer;
 }
 
+void
+	SOIL_set_capability_queries
+	(
+		int (*has_extension)( const char *name ),
+		int (*get_integer)( unsigned int pname )
+	)
+{
+	soil_has_extension = has_extension;
+	soil_get_integer = get_integer;
+	/*	probe again through the new queries	*/
+	has_cubemap_capability = SOIL_CAPABILITY_UNKNOWN;
+	has_NPOT_capability = SOIL_CAPABILITY_UNKNOWN;
+	has_tex_rectangle_capability = SOIL_CAPABILITY_UNKNOWN;
+	has_DXT_capability = SOIL_CAPABILITY_UNKNOWN;
+}
+
+static int SOIL_internal_has_extension( const char *name )
+{
+	const char *extensions, *found;
+	size_t length;
+	if( soil_has_extension != NULL )
+	{
+		return soil_has_extension( name );
+	}
+	extensions = (const char*)glGetString( GL_EXTENSIONS );
+	if( NULL == extensions )
+	{
+		/*	core profile, swallow the GL_INVALID_ENUM	*/
+		glGetError();
+		return 0;
+	}
+	/*	match whole names only, "GL_ARB_texture_cube_map" must not
+		be found in "GL_ARB_texture_cube_map_array"	*/
+	length = strlen( name );
+	for( found = strstr( extensions, name ); found != NULL;
+		found = strstr( found + length, name ) )
+	{
+		if( ((found == extensions) || (found[-1] == ' ')) &&
+			((found[length] == ' ') || (found[length] == '\0')) )
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int SOIL_internal_get_integer( unsigned int pname )
+{
+	GLint value = 0;
+	if( soil_get_integer != NULL )
+	{
+		return soil_get_integer( pname );
+	}
+	glGetIntegerv( pname, &value );
+	return value;
+}
+
 unsigned int SOIL_direct_load_DDS_from_memory(
 		const unsigned char *const buffer,
 		int buffer_length,
@@ -1876,10 +2014,7 @@ int query_NPOT_capability( void )
 	if( has_NPOT_capability == SOIL_CAPABILITY_UNKNOWN )
 	{
 		/*	we haven't yet checked for the capability, do so	*/
-		if(
-			(NULL == strstr( (char const*)glGetString( GL_EXTENSIONS ),
-				"GL_ARB_texture_non_power_of_two" ) )
-			)
+		if( !SOIL_internal_has_extension( "GL_ARB_texture_non_power_of_two" ) )
 		{
 			/*	not there, flag the failure	*/
 			has_NPOT_capability = SOIL_CAPABILITY_NONE;
@@ -1900,15 +2035,9 @@ int query_tex_rectangle_capability( void )
 	{
 		/*	we haven't yet checked for the capability, do so	*/
 		if(
-			(NULL == strstr( (char const*)glGetString( GL_EXTENSIONS ),
-				"GL_ARB_texture_rectangle" ) )
-		&&
-			(NULL == strstr( (char const*)glGetString( GL_EXTENSIONS ),
-				"GL_EXT_texture_rectangle" ) )
-		&&
-			(NULL == strstr( (char const*)glGetString( GL_EXTENSIONS ),
-				"GL_NV_texture_rectangle" ) )
-			)
+			!SOIL_internal_has_extension( "GL_ARB_texture_rectangle" ) &&
+			!SOIL_internal_has_extension( "GL_EXT_texture_rectangle" ) &&
+			!SOIL_internal_has_extension( "GL_NV_texture_rectangle" ) )
 		{
 			/*	not there, flag the failure	*/
 			has_tex_rectangle_capability = SOIL_CAPABILITY_NONE;
@@ -1929,12 +2058,8 @@ int query_cubemap_capability( void )
 	{
 		/*	we haven't yet checked for the capability, do so	*/
 		if(
-			(NULL == strstr( (char const*)glGetString( GL_EXTENSIONS ),
-				"GL_ARB_texture_cube_map" ) )
-		&&
-			(NULL == strstr( (char const*)glGetString( GL_EXTENSIONS ),
-				"GL_EXT_texture_cube_map" ) )
-			)
+			!SOIL_internal_has_extension( "GL_ARB_texture_cube_map" ) &&
+			!SOIL_internal_has_extension( "GL_EXT_texture_cube_map" ) )
 		{
 			/*	not there, flag the failure	*/
 			has_cubemap_capability = SOIL_CAPABILITY_NONE;
@@ -1954,9 +2079,7 @@ int query_DXT_capability( void )
 	if( has_DXT_capability == SOIL_CAPABILITY_UNKNOWN )
 	{
 		/*	we haven't yet checked for the capability, do so	*/
-		if( NULL == strstr(
-				(char const*)glGetString( GL_EXTENSIONS ),
-				"GL_EXT_texture_compression_s3tc" ) )
+		if( !SOIL_internal_has_extension( "GL_EXT_texture_compression_s3tc" ) )
 		{
 			/*	not there, flag the failure	*/
 			has_DXT_capability = SOIL_CAPABILITY_NONE;
@@ -91,6 +91,7 @@ enum
 	SOIL_FLAG_NTSC_SAFE_RGB: clamps RGB components to the range [16,235]
 	SOIL_FLAG_CoCg_Y: Google YCoCg; RGB=>CoYCg, RGBA=>CoCgAY
 	SOIL_FLAG_TEXTURE_RECTANGE: uses ARB_texture_rectangle ; pixel indexed & no repeat or MIPmaps or cubemaps
+	SOIL_FLAG_GAMMA_CORRECT_MIPMAPS: treat RGB as sRGB and average the MIPmaps in linear space
 **/
 enum
 {
@@ -103,7 +104,8 @@ enum
 	SOIL_FLAG_DDS_LOAD_DIRECT = 64,
 	SOIL_FLAG_NTSC_SAFE_RGB = 128,
 	SOIL_FLAG_CoCg_Y = 256,
-	SOIL_FLAG_TEXTURE_RECTANGLE = 512
+	SOIL_FLAG_TEXTURE_RECTANGLE = 512,
+	SOIL_FLAG_GAMMA_CORRECT_MIPMAPS = 1024
 };
 
 /**
@@ -390,6 +392,58 @@ unsigned char*
 		int force_channels
 	);
 
+/**
+	Reads the size and channel count of an image file from its header,
+	without decoding it; *channels is what SOIL_load_image would report,
+	except for DDS files: those report the channels their header declares,
+	and a load may differ once the decoded alpha is seen (a DXT1 file with
+	punch-through alpha loads as 4, an opaque DXT5 as 3).
+	SOIL_last_result is only updated when it fails.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_image_info
+	(
+		const char *filename,
+		int *width, int *height, int *channels
+	);
+
+/**
+	Loads an image from disk straight into caller memory, such as a
+	mapped pixel buffer or a slice of an arena, with no intermediate
+	copy for JPEG and PNG files.  force_channels (1-4, SOIL_LOAD_AUTO
+	is not allowed) gives the components per pixel in dest, and row r
+	starts at dest + r*dest_pitch; a negative pitch with dest pointing
+	at the last row loads the image upside down.  Fails, leaving dest
+	untouched, if the image is larger than max_width by max_height.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_load_image_into
+	(
+		const char *filename,
+		int *width, int *height, int *channels,
+		int force_channels,
+		unsigned char *dest, int dest_pitch,
+		int max_width, int max_height
+	);
+
+/**
+	Loads an image from memory straight into caller memory, as
+	SOIL_load_image_into does.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_load_image_from_memory_into
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		int *width, int *height, int *channels,
+		int force_channels,
+		unsigned char *dest, int dest_pitch,
+		int max_width, int max_height
+	);
+
 /**
 	Saves an image from an array of unsigned chars (RGBA) to disk
 	\return 0 if failed, otherwise returns 1
@@ -417,7 +471,8 @@ void
 /**
 	This function resturn a pointer to a string describing the last thing
 	that happened inside SOIL.  It can be used to determine why an image
-	failed to load.
+	failed to load.  The result is kept per thread, so read it on the
+	thread that made the call.
 **/
 const char*
 	SOIL_last_result
@@ -425,6 +480,22 @@ const char*
 		void
 	);
 
+/**
+	Answers SOIL's capability questions from the application's own cache
+	instead of scanning glGetString( GL_EXTENSIONS ), which core profiles
+	don't provide.  has_extension returns non-zero if the named extension,
+	or the core version it was promoted into, is available; get_integer
+	returns a glGetIntegerv limit such as GL_MAX_TEXTURE_SIZE.  Either may
+	be NULL to go back to SOIL's own queries.  Capabilities probed so far
+	are forgotten.
+**/
+void
+	SOIL_set_capability_queries
+	(
+		int (*has_extension)( const char *name ),
+		int (*get_integer)( unsigned int pname )
+	);
+
 
 #ifdef __cplusplus
 }
@@ -8,10 +8,12 @@
 */
 
 #include "image_DXT.h"
+#include "image_threads.h"
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <limits.h>
 
 /*	set this =1 if you want to use the covarince matrix method...
 	which is better than my method of using standard deviations
@@ -19,6 +21,16 @@
 	method fails for finding the largest eigenvector	*/
 #define USE_COV_MAT	1
 
+/*	the SSE2 block encoder runs 4 blocks side by side (one per lane)
+	and does exactly the float operations the scalar code does, in
+	the same order, so its output is bit for bit identical.
+	Define SOIL_DXT_NO_SIMD to force the scalar path.	*/
+#if !defined(SOIL_DXT_NO_SIMD) && USE_COV_MAT && \
+	(defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+	#define SOIL_DXT_SSE2 1
+	#include <emmintrin.h>
+#endif
+
 /********* Function Prototypes *********/
 /*
 	Takes a 4x4 block of pixels and compresses it into 8 bytes
@@ -29,6 +41,15 @@ void compress_DDS_color_block(
 				int channels,
 				const unsigned char *const uncompressed,
 				unsigned char compressed[8] );
+/*
+	Writes the DXT1 color block for a 4x4 block of pixels
+	given its (565) master colors.
+*/
+void encode_DDS_color_block(
+				int enc_c0, int enc_c1,
+				int channels,
+				const unsigned char *const uncompressed,
+				unsigned char compressed[8] );
 /*
 	Takes a 4x4 block of pixels and compresses the alpha
 	component it into 8 bytes for use in DXT5 DDS files.
@@ -37,8 +58,54 @@ void compress_DDS_color_block(
 void compress_DDS_alpha_block(
 				const unsigned char *const uncompressed,
 				unsigned char compressed[8] );
+void LSE_master_colors_max_min(
+				int *cmax, int *cmin,
+				int channels,
+				const unsigned char *const uncompressed );
+
+/*	the block formats a DXT_rows_job can write	*/
+#define DXT_FORMAT_DXT1	0
+#define DXT_FORMAT_DXT5	1
+#define DXT_FORMAT_BC4	2
+#define DXT_FORMAT_BC5	3
+
+/*	an image being compressed, block row bands of it go to each thread	*/
+typedef struct
+{
+	const unsigned char *uncompressed;
+	int width, height, channels;
+	int format, quality;
+	unsigned char *compressed;
+}
+DXT_rows_job;
+static unsigned char* convert_image_to_blocks(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int format, int *out_size );
+static void compress_DXT_rows( void *context, int row_start, int row_end );
+
+/*	0 => one thread per CPU	*/
+static int DXT_thread_count = 0;
+static int DXT_quality = SOIL_DXT_QUALITY_NORMAL;
 
 /********* Actual Exposed Functions *********/
+void set_DXT_thread_count( int threads )
+{
+	DXT_thread_count = (threads < 0) ? 0 : threads;
+}
+
+void set_DXT_quality( int quality )
+{
+	if( quality < SOIL_DXT_QUALITY_FAST )
+	{
+		quality = SOIL_DXT_QUALITY_FAST;
+	} else if( quality > SOIL_DXT_QUALITY_HIGH )
+	{
+		quality = SOIL_DXT_QUALITY_HIGH;
+	}
+	DXT_quality = quality;
+}
+
 int
 	save_image_as_DDS
 	(
@@ -103,12 +170,46 @@ unsigned char* convert_image_to_DXT1(
 		int width, int height, int channels,
 		int *out_size )
 {
-	unsigned char *compressed;
-	int i, j, x, y;
-	unsigned char ublock[16*3];
-	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0;
+	return convert_image_to_blocks( uncompressed, width, height, channels,
+			DXT_FORMAT_DXT1, out_size );
+}
+
+unsigned char* convert_image_to_DXT5(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int *out_size )
+{
+	return convert_image_to_blocks( uncompressed, width, height, channels,
+			DXT_FORMAT_DXT5, out_size );
+}
+
+unsigned char* convert_image_to_BC4(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int *out_size )
+{
+	return convert_image_to_blocks( uncompressed, width, height, channels,
+			DXT_FORMAT_BC4, out_size );
+}
+
+unsigned char* convert_image_to_BC5(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int *out_size )
+{
+	return convert_image_to_blocks( uncompressed, width, height, channels,
+			DXT_FORMAT_BC5, out_size );
+}
+
+static unsigned char* convert_image_to_blocks(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int format, int *out_size )
+{
+	DXT_rows_job job;
+	/*	8 bytes per 4x4 block for DXT1 and BC4, 16 for DXT5 and BC5	*/
+	const int block_bytes =
+		((format == DXT_FORMAT_DXT5) || (format == DXT_FORMAT_BC5)) ? 16 : 8;
 	/*	error check	*/
 	*out_size = 0;
 	if( (width < 1) || (height < 1) ||
@@ -117,161 +218,199 @@ unsigned char* convert_image_to_DXT1(
 	{
 		return NULL;
 	}
-	/*	for channels == 1 or 2, I do not step forward for R,G,B values	*/
-	if( channels < 3 )
+	/*	get the RAM for the compressed image	*/
+	job.compressed = (unsigned char*)malloc(
+			((width+3) >> 2) * ((height+3) >> 2) * block_bytes );
+	if( NULL == job.compressed )
 	{
-		chan_step = 0;
+		return NULL;
 	}
-	/*	get the RAM for the compressed image
-		(8 bytes per 4x4 pixel block)	*/
-	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 8;
-	compressed = (unsigned char*)malloc( *out_size );
+	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * block_bytes;
 	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
+	job.uncompressed = uncompressed;
+	job.width = width;
+	job.height = height;
+	job.channels = channels;
+	job.format = format;
+	job.quality = DXT_quality;
+	/*	small images are not worth waking threads for, so unless a
+		thread count was set keep at least 16 block rows on each one	*/
+	SOIL_run_row_bands( compress_DXT_rows, &job, (height+3) >> 2,
+			DXT_thread_count, (DXT_thread_count > 0) ? 1 : 16 );
+	return job.compressed;
+}
+
+/********* Block Row Driver *********/
+/*
+	Copies the 4x4 block at pixel (i,j) into ublock as RGBA,
+	replicating the first pixel into the parts of edge blocks
+	that fall outside the image.
+*/
+static void fetch_DXT_block(
+		const DXT_rows_job *job,
+		int i, int j,
+		unsigned char ublock[16*4] )
+{
+	const int channels = job->channels;
+	/*	for channels == 1 or 2, I do not step forward for R,G,B values	*/
+	const int chan_step = (channels < 3) ? 0 : 1;
+	/*	# channels = 1 or 3 have no alpha, 2 & 4 do have alpha	*/
+	const int has_alpha = 1 - (channels & 1);
+	int x, y, idx = 0;
+	int mx = 4, my = 4;
+	if( j+4 >= job->height )
+	{
+		my = job->height - j;
+	}
+	if( i+4 >= job->width )
 	{
-		for( i = 0; i < width; i += 4 )
+		mx = job->width - i;
+	}
+	for( y = 0; y < my; ++y )
+	{
+		const unsigned char *src =
+			job->uncompressed + ((j+y)*job->width + i)*channels;
+		for( x = 0; x < mx; ++x )
 		{
-			/*	copy this block into a new one	*/
-			int idx = 0;
-			int mx = 4, my = 4;
-			if( j+4 >= height )
-			{
-				my = height - j;
-			}
-			if( i+4 >= width )
-			{
-				mx = width - i;
-			}
-			for( y = 0; y < my; ++y )
-			{
-				for( x = 0; x < mx; ++x )
-				{
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step+chan_step];
-				}
-				for( x = mx; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-				}
-			}
-			for( y = my; y < 4; ++y )
-			{
-				for( x = 0; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-				}
-			}
-			/*	compress the block	*/
-			++block_count;
-			compress_DDS_color_block( 3, ublock, cblock );
-			/*	copy the data from the block into the main block	*/
-			for( x = 0; x < 8; ++x )
-			{
-				compressed[index++] = cblock[x];
-			}
+			ublock[idx++] = src[0];
+			ublock[idx++] = src[chan_step];
+			ublock[idx++] = src[chan_step+chan_step];
+			ublock[idx++] = has_alpha ? src[channels-1] : 255;
+			src += channels;
+		}
+		for( x = mx; x < 4; ++x )
+		{
+			ublock[idx++] = ublock[0];
+			ublock[idx++] = ublock[1];
+			ublock[idx++] = ublock[2];
+			ublock[idx++] = ublock[3];
+		}
+	}
+	for( y = my; y < 4; ++y )
+	{
+		for( x = 0; x < 4; ++x )
+		{
+			ublock[idx++] = ublock[0];
+			ublock[idx++] = ublock[1];
+			ublock[idx++] = ublock[2];
+			ublock[idx++] = ublock[3];
 		}
 	}
-	return compressed;
 }
 
-unsigned char* convert_image_to_DXT5(
+#if SOIL_DXT_SSE2
+static void LSE_master_colors_max_min_SSE2(
+		int cmax[4], int cmin[4],
+		const unsigned char *const ublocks );
+#endif
+#if SOIL_DXT_SSE2
+static void range_fit_master_colors_SSE2(
+		int cmax[4], int cmin[4],
+		const unsigned char *const ublocks );
+#else
+static void range_fit_master_colors(
+		int *cmax, int *cmin,
+		const unsigned char *const uncompressed );
+#endif
+static void cluster_fit_DDS_color_block(
 		const unsigned char *const uncompressed,
-		int width, int height, int channels,
-		int *out_size )
+		unsigned char compressed[8] );
+static void compress_DDS_channel_block(
+		const unsigned char *const uncompressed,
+		int offset, int quality,
+		unsigned char compressed[8] );
+
+static void compress_DXT_rows( void *context, int row_start, int row_end )
 {
-	unsigned char *compressed;
-	int i, j, x, y;
-	unsigned char ublock[16*4];
-	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0, has_alpha;
-	/*	error check	*/
-	*out_size = 0;
-	if( (width < 1) || (height < 1) ||
-		(NULL == uncompressed) ||
-		(channels < 1) || ( channels > 4) )
-	{
-		return NULL;
-	}
-	/*	for channels == 1 or 2, I do not step forward for R,G,B vales	*/
-	if( channels < 3 )
-	{
-		chan_step = 0;
-	}
-	/*	# channels = 1 or 3 have no alpha, 2 & 4 do have alpha	*/
-	has_alpha = 1 - (channels & 1);
-	/*	get the RAM for the compressed image
-		(16 bytes per 4x4 pixel block)	*/
-	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 16;
-	compressed = (unsigned char*)malloc( *out_size );
-	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
+	const DXT_rows_job *job = (const DXT_rows_job*)context;
+	/*	4 RGBA blocks, back to back	*/
+	unsigned char ublocks[4*16*4];
+	int cmax[4], cmin[4];
+	const int blocks_x = (job->width+3) >> 2;
+	const int block_bytes =
+		((job->format == DXT_FORMAT_DXT5) || (job->format == DXT_FORMAT_BC5)) ? 16 : 8;
+	/*	BC5 takes green, or the alpha of luminance + alpha images	*/
+	const int second_channel = (job->channels == 2) ? 3 : 1;
+	int bx, by, k, n;
+	for( by = row_start; by < row_end; ++by )
 	{
-		for( i = 0; i < width; i += 4 )
+		unsigned char *out = job->compressed + by*blocks_x*block_bytes;
+		for( bx = 0; bx < blocks_x; bx += 4 )
 		{
-			/*	local variables, and my block counter	*/
-			int idx = 0;
-			int mx = 4, my = 4;
-			if( j+4 >= height )
+			/*	grab up to 4 blocks from this row	*/
+			n = blocks_x - bx;
+			if( n > 4 )
 			{
-				my = height - j;
+				n = 4;
 			}
-			if( i+4 >= width )
+			for( k = 0; k < n; ++k )
 			{
-				mx = width - i;
+				fetch_DXT_block( job, (bx+k)*4, by*4, ublocks + k*16*4 );
 			}
-			for( y = 0; y < my; ++y )
+			/*	single / dual channel blocks	*/
+			if( (job->format == DXT_FORMAT_BC4) || (job->format == DXT_FORMAT_BC5) )
 			{
-				for( x = 0; x < mx; ++x )
+				for( k = 0; k < n; ++k )
 				{
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step+chan_step];
-					ublock[idx++] =
-						has_alpha * uncompressed[(j+y)*width*channels+(i+x)*channels+channels-1]
-						+ (1-has_alpha)*255;
-				}
-				for( x = mx; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-					ublock[idx++] = ublock[3];
+					compress_DDS_channel_block( ublocks + k*16*4, 0, job->quality, out );
+					out += 8;
+					if( job->format == DXT_FORMAT_BC5 )
+					{
+						compress_DDS_channel_block( ublocks + k*16*4, second_channel, job->quality, out );
+						out += 8;
+					}
 				}
+				continue;
 			}
-			for( y = my; y < 4; ++y )
+			/*	find their master colors	*/
+			if( job->quality == SOIL_DXT_QUALITY_NORMAL )
 			{
-				for( x = 0; x < 4; ++x )
+				#if SOIL_DXT_SSE2
+				for( k = n; k < 4; ++k )
 				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-					ublock[idx++] = ublock[3];
+					memcpy( ublocks + k*16*4, ublocks, 16*4 );
 				}
-			}
-			/*	now compress the alpha block	*/
-			compress_DDS_alpha_block( ublock, cblock );
-			/*	copy the data from the compressed alpha block into the main buffer	*/
-			for( x = 0; x < 8; ++x )
+				LSE_master_colors_max_min_SSE2( cmax, cmin, ublocks );
+				#else
+				for( k = 0; k < n; ++k )
+				{
+					LSE_master_colors_max_min( &cmax[k], &cmin[k], 4, ublocks + k*16*4 );
+				}
+				#endif
+			} else if( job->quality == SOIL_DXT_QUALITY_FAST )
 			{
-				compressed[index++] = cblock[x];
+				#if SOIL_DXT_SSE2
+				for( k = n; k < 4; ++k )
+				{
+					memcpy( ublocks + k*16*4, ublocks, 16*4 );
+				}
+				range_fit_master_colors_SSE2( cmax, cmin, ublocks );
+				#else
+				for( k = 0; k < n; ++k )
+				{
+					range_fit_master_colors( &cmax[k], &cmin[k], ublocks + k*16*4 );
+				}
+				#endif
 			}
-			/*	then compress the color block	*/
-			++block_count;
-			compress_DDS_color_block( 4, ublock, cblock );
-			/*	copy the data from the compressed color block into the main buffer	*/
-			for( x = 0; x < 8; ++x )
+			/*	and write them out (alpha block first for DXT5)	*/
+			for( k = 0; k < n; ++k )
 			{
-				compressed[index++] = cblock[x];
+				if( job->format == DXT_FORMAT_DXT5 )
+				{
+					compress_DDS_channel_block( ublocks + k*16*4, 3, job->quality, out );
+					out += 8;
+				}
+				if( job->quality == SOIL_DXT_QUALITY_HIGH )
+				{
+					cluster_fit_DDS_color_block( ublocks + k*16*4, out );
+				} else
+				{
+					encode_DDS_color_block( cmax[k], cmin[k], 4, ublocks + k*16*4, out );
+				}
+				out += 8;
 			}
 		}
 	}
-	return compressed;
 }
 
 /********* Helper Functions *********/
@@ -497,6 +636,157 @@ void LSE_master_colors_max_min(
 	}
 }
 
+#if SOIL_DXT_SSE2
+/*
+	Loads 4 RGBA blocks (16*4 bytes each, back to back) transposed,
+	so lane k of r[i], g[i], b[i] is pixel i of block k.
+*/
+static void
+	load_blocks_SSE2
+	(
+		const unsigned char *const ublocks,
+		__m128 r[16], __m128 g[16], __m128 b[16]
+	)
+{
+	const __m128i mask = _mm_set1_epi32( 255 );
+	int i, k;
+	for( i = 0; i < 16; i += 4 )
+	{
+		__m128i p[4];
+		__m128i b0 = _mm_loadu_si128( (const __m128i*)(ublocks + 0*64 + i*4) );
+		__m128i b1 = _mm_loadu_si128( (const __m128i*)(ublocks + 1*64 + i*4) );
+		__m128i b2 = _mm_loadu_si128( (const __m128i*)(ublocks + 2*64 + i*4) );
+		__m128i b3 = _mm_loadu_si128( (const __m128i*)(ublocks + 3*64 + i*4) );
+		__m128i t0 = _mm_unpacklo_epi32( b0, b1 );
+		__m128i t1 = _mm_unpacklo_epi32( b2, b3 );
+		__m128i t2 = _mm_unpackhi_epi32( b0, b1 );
+		__m128i t3 = _mm_unpackhi_epi32( b2, b3 );
+		p[0] = _mm_unpacklo_epi64( t0, t1 );
+		p[1] = _mm_unpackhi_epi64( t0, t1 );
+		p[2] = _mm_unpacklo_epi64( t2, t3 );
+		p[3] = _mm_unpackhi_epi64( t2, t3 );
+		for( k = 0; k < 4; ++k )
+		{
+			r[i+k] = _mm_cvtepi32_ps( _mm_and_si128( p[k], mask ) );
+			g[i+k] = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( p[k], 8 ), mask ) );
+			b[i+k] = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( p[k], 16 ), mask ) );
+		}
+	}
+}
+
+/*
+	compute_color_line_STDEV + LSE_master_colors_max_min for 4 RGBA
+	blocks (16*4 bytes each, back to back), one block per lane.
+	Each lane does the same float operations as the scalar code,
+	in the same order, so the master colors match exactly.
+*/
+static void
+	LSE_master_colors_max_min_SSE2
+	(
+		int cmax[4], int cmin[4],
+		const unsigned char *const ublocks
+	)
+{
+	const __m128 inv_16 = _mm_set1_ps( 1.0f / 16.0f );
+	const __m128 sixteen = _mm_set1_ps( 16.0f );
+	const __m128 half = _mm_set1_ps( 0.5f );
+	__m128 sum_r = _mm_setzero_ps(), sum_g = _mm_setzero_ps(), sum_b = _mm_setzero_ps();
+	__m128 sum_rr = _mm_setzero_ps(), sum_gg = _mm_setzero_ps(), sum_bb = _mm_setzero_ps();
+	__m128 sum_rg = _mm_setzero_ps(), sum_rb = _mm_setzero_ps(), sum_gb = _mm_setzero_ps();
+	__m128 r[16], g[16], b[16];
+	__m128 dir_r, dir_g, dir_b, v_r, v_g, v_b;
+	__m128 vec_len2, dot, dot_min, dot_max;
+	unsigned int c0[3], c1[3];
+	int i, k, e0, e1;
+	load_blocks_SSE2( ublocks, r, g, b );
+	for( i = 0; i < 16; ++i )
+	{
+		/*	products of bytes are exact in a float	*/
+		sum_r = _mm_add_ps( sum_r, r[i] );
+		sum_rr = _mm_add_ps( sum_rr, _mm_mul_ps( r[i], r[i] ) );
+		sum_g = _mm_add_ps( sum_g, g[i] );
+		sum_gg = _mm_add_ps( sum_gg, _mm_mul_ps( g[i], g[i] ) );
+		sum_b = _mm_add_ps( sum_b, b[i] );
+		sum_bb = _mm_add_ps( sum_bb, _mm_mul_ps( b[i], b[i] ) );
+		sum_rg = _mm_add_ps( sum_rg, _mm_mul_ps( r[i], g[i] ) );
+		sum_rb = _mm_add_ps( sum_rb, _mm_mul_ps( r[i], b[i] ) );
+		sum_gb = _mm_add_ps( sum_gb, _mm_mul_ps( g[i], b[i] ) );
+	}
+	/*	convert the sums to averages	*/
+	sum_r = _mm_mul_ps( sum_r, inv_16 );
+	sum_g = _mm_mul_ps( sum_g, inv_16 );
+	sum_b = _mm_mul_ps( sum_b, inv_16 );
+	/*	and convert the squares to the squares of the value - avg_value	*/
+	sum_rr = _mm_sub_ps( sum_rr, _mm_mul_ps( _mm_mul_ps( sixteen, sum_r ), sum_r ) );
+	sum_gg = _mm_sub_ps( sum_gg, _mm_mul_ps( _mm_mul_ps( sixteen, sum_g ), sum_g ) );
+	sum_bb = _mm_sub_ps( sum_bb, _mm_mul_ps( _mm_mul_ps( sixteen, sum_b ), sum_b ) );
+	sum_rg = _mm_sub_ps( sum_rg, _mm_mul_ps( _mm_mul_ps( sixteen, sum_r ), sum_g ) );
+	sum_rb = _mm_sub_ps( sum_rb, _mm_mul_ps( _mm_mul_ps( sixteen, sum_r ), sum_b ) );
+	sum_gb = _mm_sub_ps( sum_gb, _mm_mul_ps( _mm_mul_ps( sixteen, sum_g ), sum_b ) );
+	/*	3 power iterations on the covariance matrix	*/
+	v_r = _mm_set1_ps( 1.0f );
+	v_g = _mm_set1_ps( 2.718281828f );
+	v_b = _mm_set1_ps( 3.141592654f );
+	for( k = 0; k < 3; ++k )
+	{
+		dir_r = _mm_add_ps( _mm_add_ps( _mm_mul_ps( v_r, sum_rr ), _mm_mul_ps( v_g, sum_rg ) ), _mm_mul_ps( v_b, sum_rb ) );
+		dir_g = _mm_add_ps( _mm_add_ps( _mm_mul_ps( v_r, sum_rg ), _mm_mul_ps( v_g, sum_gg ) ), _mm_mul_ps( v_b, sum_gb ) );
+		dir_b = _mm_add_ps( _mm_add_ps( _mm_mul_ps( v_r, sum_rb ), _mm_mul_ps( v_g, sum_gb ) ), _mm_mul_ps( v_b, sum_bb ) );
+		v_r = dir_r;
+		v_g = dir_g;
+		v_b = dir_b;
+	}
+	vec_len2 = _mm_div_ps( _mm_set1_ps( 1.0f ),
+			_mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_set1_ps( 0.00001f ),
+				_mm_mul_ps( dir_r, dir_r ) ),
+				_mm_mul_ps( dir_g, dir_g ) ),
+				_mm_mul_ps( dir_b, dir_b ) ) );
+	/*	finding the max and min vector values	*/
+	dot_max = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dir_r, r[0] ), _mm_mul_ps( dir_g, g[0] ) ), _mm_mul_ps( dir_b, b[0] ) );
+	dot_min = dot_max;
+	for( i = 1; i < 16; ++i )
+	{
+		dot = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dir_r, r[i] ), _mm_mul_ps( dir_g, g[i] ) ), _mm_mul_ps( dir_b, b[i] ) );
+		dot_min = _mm_min_ps( dot_min, dot );
+		dot_max = _mm_max_ps( dot_max, dot );
+	}
+	/*	and the offset (from the average location)	*/
+	dot = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dir_r, sum_r ), _mm_mul_ps( dir_g, sum_g ) ), _mm_mul_ps( dir_b, sum_b ) );
+	dot_min = _mm_mul_ps( _mm_sub_ps( dot_min, dot ), vec_len2 );
+	dot_max = _mm_mul_ps( _mm_sub_ps( dot_max, dot ), vec_len2 );
+	/*	build the master colors, the saturating packs clamp to [0,255]
+		and leave lane k in byte k	*/
+	#define SOIL_DXT_MASTER(dst, avg, dir, dot) \
+		{ \
+			__m128i c = _mm_cvttps_epi32( _mm_add_ps( _mm_add_ps( half, avg ), _mm_mul_ps( dot, dir ) ) ); \
+			c = _mm_packs_epi32( c, c ); \
+			dst = (unsigned int)_mm_cvtsi128_si32( _mm_packus_epi16( c, c ) ); \
+		}
+	SOIL_DXT_MASTER( c0[0], sum_r, dir_r, dot_max );
+	SOIL_DXT_MASTER( c0[1], sum_g, dir_g, dot_max );
+	SOIL_DXT_MASTER( c0[2], sum_b, dir_b, dot_max );
+	SOIL_DXT_MASTER( c1[0], sum_r, dir_r, dot_min );
+	SOIL_DXT_MASTER( c1[1], sum_g, dir_g, dot_min );
+	SOIL_DXT_MASTER( c1[2], sum_b, dir_b, dot_min );
+	#undef SOIL_DXT_MASTER
+	/*	down_sample (with rounding?)	*/
+	for( k = 0; k < 4; ++k )
+	{
+		e0 = rgb_to_565( (c0[0] >> (8*k)) & 255, (c0[1] >> (8*k)) & 255, (c0[2] >> (8*k)) & 255 );
+		e1 = rgb_to_565( (c1[0] >> (8*k)) & 255, (c1[1] >> (8*k)) & 255, (c1[2] >> (8*k)) & 255 );
+		if( e0 > e1 )
+		{
+			cmax[k] = e0;
+			cmin[k] = e1;
+		} else
+		{
+			cmax[k] = e1;
+			cmin[k] = e0;
+		}
+	}
+}
+#endif
+
 void
 	compress_DDS_color_block
 	(
@@ -504,18 +794,31 @@ void
 		const unsigned char *const uncompressed,
 		unsigned char compressed[8]
 	)
+{
+	int enc_c0, enc_c1;
+	/*	get the master colors	*/
+	LSE_master_colors_max_min( &enc_c0, &enc_c1, channels, uncompressed );
+	/*	and fit the block to them	*/
+	encode_DDS_color_block( enc_c0, enc_c1, channels, uncompressed, compressed );
+}
+
+void
+	encode_DDS_color_block
+	(
+		int enc_c0, int enc_c1,
+		int channels,
+		const unsigned char *const uncompressed,
+		unsigned char compressed[8]
+	)
 {
 	/*	variables	*/
 	int i;
 	int next_bit;
-	int enc_c0, enc_c1;
 	int c0[4], c1[4];
 	float color_line[] = { 0.0f, 0.0f, 0.0f, 0.0f };
 	float vec_len2 = 0.0f, dot_offset = 0.0f;
 	/*	stupid order	*/
 	int swizzle4[] = { 0, 2, 3, 1 };
-	/*	get the master colors	*/
-	LSE_master_colors_max_min( &enc_c0, &enc_c1, channels, uncompressed );
 	/*	store the 565 color 0 and color 1	*/
 	compressed[0] = (enc_c0 >> 0) & 255;
 	compressed[1] = (enc_c0 >> 8) & 255;
@@ -546,6 +849,51 @@ void
 	color_line[2] *= vec_len2;
 	/*	compute the offset (constant) portion of the dot product	*/
 	dot_offset = color_line[0]*c0[0] + color_line[1]*c0[1] + color_line[2]*c0[2];
+	#if SOIL_DXT_SSE2
+	if( channels == 4 )
+	{
+		/*	4 pixels at a time, same float math as below	*/
+		const __m128 cl_r = _mm_set1_ps( color_line[0] );
+		const __m128 cl_g = _mm_set1_ps( color_line[1] );
+		const __m128 cl_b = _mm_set1_ps( color_line[2] );
+		const __m128 offset = _mm_set1_ps( dot_offset );
+		const __m128 three = _mm_set1_ps( 3.0f );
+		const __m128 half = _mm_set1_ps( 0.5f );
+		const __m128i mask = _mm_set1_epi32( 255 );
+		const __m128i three_i = _mm_set1_epi32( 3 );
+		unsigned int bits = 0;
+		int values[4];
+		for( i = 0; i < 16; i += 4 )
+		{
+			__m128i px = _mm_loadu_si128( (const __m128i*)(uncompressed + i*4) );
+			__m128 r = _mm_cvtepi32_ps( _mm_and_si128( px, mask ) );
+			__m128 g = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( px, 8 ), mask ) );
+			__m128 b = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( px, 16 ), mask ) );
+			__m128 dot_product = _mm_sub_ps(
+					_mm_add_ps( _mm_add_ps(
+						_mm_mul_ps( cl_r, r ),
+						_mm_mul_ps( cl_g, g ) ),
+						_mm_mul_ps( cl_b, b ) ),
+					offset );
+			/*	map to [0,3]	*/
+			__m128i v = _mm_cvttps_epi32(
+					_mm_add_ps( _mm_mul_ps( dot_product, three ), half ) );
+			__m128i over = _mm_cmpgt_epi32( v, three_i );
+			v = _mm_and_si128( v, _mm_cmpgt_epi32( v, _mm_setzero_si128() ) );
+			v = _mm_or_si128( _mm_and_si128( over, three_i ), _mm_andnot_si128( over, v ) );
+			_mm_storeu_si128( (__m128i*)values, v );
+			bits |= (unsigned int)swizzle4[ values[0] ] << (2*i + 0);
+			bits |= (unsigned int)swizzle4[ values[1] ] << (2*i + 2);
+			bits |= (unsigned int)swizzle4[ values[2] ] << (2*i + 4);
+			bits |= (unsigned int)swizzle4[ values[3] ] << (2*i + 6);
+		}
+		compressed[4] = (bits >> 0) & 255;
+		compressed[5] = (bits >> 8) & 255;
+		compressed[6] = (bits >> 16) & 255;
+		compressed[7] = (bits >> 24) & 255;
+		return;
+	}
+	#endif
 	/*	store the rest of the bits	*/
 	next_bit = 8*4;
 	for( i = 0; i < 16; ++i )
@@ -574,12 +922,484 @@ void
 	/*	done compressing to DXT1	*/
 }
 
+/*
+	Picks the index of the nearest palette entry for every pixel
+	of an RGBA block, given master colors with enc_c0 >= enc_c1
+	(a single color when they are equal).  Returns the squared error.
+*/
+static int
+	fit_DDS_color_indices
+	(
+		int enc_c0, int enc_c1,
+		const unsigned char *const uncompressed,
+		unsigned char compressed[8]
+	)
+{
+	/*	palette in order along the line, and the stupid order	*/
+	int c[4][3];
+	int swizzle4[] = { 0, 2, 3, 1 };
+	int i, k, t, colors, err = 0;
+	unsigned int bits = 0;
+	rgb_888_from_565( enc_c0, &c[0][0], &c[0][1], &c[0][2] );
+	rgb_888_from_565( enc_c1, &c[3][0], &c[3][1], &c[3][2] );
+	for( k = 0; k < 3; ++k )
+	{
+		c[1][k] = (2*c[0][k] + c[3][k]) / 3;
+		c[2][k] = (c[0][k] + 2*c[3][k]) / 3;
+	}
+	colors = (enc_c0 == enc_c1) ? 1 : 4;
+	for( i = 0; i < 16; ++i )
+	{
+		int best = 0, best_d = INT_MAX;
+		for( t = 0; t < colors; ++t )
+		{
+			int d = 0;
+			for( k = 0; k < 3; ++k )
+			{
+				int e = uncompressed[i*4+k] - c[t][k];
+				d += e * e;
+			}
+			if( d < best_d )
+			{
+				best_d = d;
+				best = t;
+			}
+		}
+		err += best_d;
+		bits |= (unsigned int)swizzle4[best] << (2*i);
+	}
+	compressed[0] = (enc_c0 >> 0) & 255;
+	compressed[1] = (enc_c0 >> 8) & 255;
+	compressed[2] = (enc_c1 >> 0) & 255;
+	compressed[3] = (enc_c1 >> 8) & 255;
+	compressed[4] = (bits >> 0) & 255;
+	compressed[5] = (bits >> 8) & 255;
+	compressed[6] = (bits >> 16) & 255;
+	compressed[7] = (bits >> 24) & 255;
+	return err;
+}
+
+/*
+	Turns a block's bounding box into master colors: inset it a
+	little, then take the diagonal that follows the channel with the
+	largest range.  cov[] holds 16*16 * the covariances r-g, r-b, g-b.
+*/
+static void
+	range_fit_finish
+	(
+		int *cmax, int *cmin,
+		int lo[3], int hi[3],
+		const int cov[3]
+	)
+{
+	/*	covariance of each channel with channel i	*/
+	const int with_r[3] = { 1, cov[0], cov[1] };
+	const int with_g[3] = { cov[0], 1, cov[2] };
+	const int with_b[3] = { cov[1], cov[2], 1 };
+	const int *with_ref = with_r;
+	int i, k, inset, tmp;
+	if( (hi[1] - lo[1] > hi[0] - lo[0]) && (hi[1] - lo[1] >= hi[2] - lo[2]) )
+	{
+		with_ref = with_g;
+	} else if( hi[2] - lo[2] > hi[0] - lo[0] )
+	{
+		with_ref = with_b;
+	}
+	for( k = 0; k < 3; ++k )
+	{
+		/*	inset by 1/16th of the range, so the ends get used	*/
+		inset = (hi[k] - lo[k]) >> 4;
+		lo[k] += inset;
+		hi[k] -= inset;
+		/*	falls as the reference rises? then flip the diagonal	*/
+		if( with_ref[k] < 0 )
+		{
+			tmp = lo[k];
+			lo[k] = hi[k];
+			hi[k] = tmp;
+		}
+	}
+	i = rgb_to_565( hi[0], hi[1], hi[2] );
+	k = rgb_to_565( lo[0], lo[1], lo[2] );
+	if( i > k )
+	{
+		*cmax = i;
+		*cmin = k;
+	} else
+	{
+		*cmax = k;
+		*cmin = i;
+	}
+}
+
+#if !SOIL_DXT_SSE2
+/*
+	Master colors from the bounding box of an RGBA block.
+	Cheaper and rougher than LSE_master_colors_max_min.
+*/
+static void
+	range_fit_master_colors
+	(
+		int *cmax, int *cmin,
+		const unsigned char *const uncompressed
+	)
+{
+	int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+	int sum[3] = { 0, 0, 0 }, sum_rg = 0, sum_rb = 0, sum_gb = 0;
+	int cov[3];
+	int i, k;
+	for( i = 0; i < 16*4; i += 4 )
+	{
+		for( k = 0; k < 3; ++k )
+		{
+			int v = uncompressed[i+k];
+			sum[k] += v;
+			lo[k] = (v < lo[k]) ? v : lo[k];
+			hi[k] = (v > hi[k]) ? v : hi[k];
+		}
+		sum_rg += uncompressed[i+0] * uncompressed[i+1];
+		sum_rb += uncompressed[i+0] * uncompressed[i+2];
+		sum_gb += uncompressed[i+1] * uncompressed[i+2];
+	}
+	cov[0] = 16*sum_rg - sum[0]*sum[1];
+	cov[1] = 16*sum_rb - sum[0]*sum[2];
+	cov[2] = 16*sum_gb - sum[1]*sum[2];
+	range_fit_finish( cmax, cmin, lo, hi, cov );
+}
+#endif
+
+#if SOIL_DXT_SSE2
+/*
+	range_fit_master_colors for 4 RGBA blocks, one per lane.  All the
+	sums stay below 2^24 so the float math is exact and matches the
+	scalar version.
+*/
+static void
+	range_fit_master_colors_SSE2
+	(
+		int cmax[4], int cmin[4],
+		const unsigned char *const ublocks
+	)
+{
+	const __m128 sixteen = _mm_set1_ps( 16.0f );
+	__m128 r[16], g[16], b[16];
+	__m128 lo_r, lo_g, lo_b, hi_r, hi_g, hi_b;
+	__m128 sum_r, sum_g, sum_b;
+	__m128 sum_rg = _mm_setzero_ps(), sum_rb = _mm_setzero_ps(), sum_gb = _mm_setzero_ps();
+	int lo[3][4], hi[3][4], cov[3][4];
+	int i, k;
+	load_blocks_SSE2( ublocks, r, g, b );
+	lo_r = hi_r = sum_r = r[0];
+	lo_g = hi_g = sum_g = g[0];
+	lo_b = hi_b = sum_b = b[0];
+	sum_rg = _mm_mul_ps( r[0], g[0] );
+	sum_rb = _mm_mul_ps( r[0], b[0] );
+	sum_gb = _mm_mul_ps( g[0], b[0] );
+	for( i = 1; i < 16; ++i )
+	{
+		lo_r = _mm_min_ps( lo_r, r[i] );
+		lo_g = _mm_min_ps( lo_g, g[i] );
+		lo_b = _mm_min_ps( lo_b, b[i] );
+		hi_r = _mm_max_ps( hi_r, r[i] );
+		hi_g = _mm_max_ps( hi_g, g[i] );
+		hi_b = _mm_max_ps( hi_b, b[i] );
+		sum_r = _mm_add_ps( sum_r, r[i] );
+		sum_g = _mm_add_ps( sum_g, g[i] );
+		sum_b = _mm_add_ps( sum_b, b[i] );
+		sum_rg = _mm_add_ps( sum_rg, _mm_mul_ps( r[i], g[i] ) );
+		sum_rb = _mm_add_ps( sum_rb, _mm_mul_ps( r[i], b[i] ) );
+		sum_gb = _mm_add_ps( sum_gb, _mm_mul_ps( g[i], b[i] ) );
+	}
+	_mm_storeu_si128( (__m128i*)lo[0], _mm_cvttps_epi32( lo_r ) );
+	_mm_storeu_si128( (__m128i*)lo[1], _mm_cvttps_epi32( lo_g ) );
+	_mm_storeu_si128( (__m128i*)lo[2], _mm_cvttps_epi32( lo_b ) );
+	_mm_storeu_si128( (__m128i*)hi[0], _mm_cvttps_epi32( hi_r ) );
+	_mm_storeu_si128( (__m128i*)hi[1], _mm_cvttps_epi32( hi_g ) );
+	_mm_storeu_si128( (__m128i*)hi[2], _mm_cvttps_epi32( hi_b ) );
+	_mm_storeu_si128( (__m128i*)cov[0], _mm_cvttps_epi32(
+			_mm_sub_ps( _mm_mul_ps( sixteen, sum_rg ), _mm_mul_ps( sum_r, sum_g ) ) ) );
+	_mm_storeu_si128( (__m128i*)cov[1], _mm_cvttps_epi32(
+			_mm_sub_ps( _mm_mul_ps( sixteen, sum_rb ), _mm_mul_ps( sum_r, sum_b ) ) ) );
+	_mm_storeu_si128( (__m128i*)cov[2], _mm_cvttps_epi32(
+			_mm_sub_ps( _mm_mul_ps( sixteen, sum_gb ), _mm_mul_ps( sum_g, sum_b ) ) ) );
+	for( k = 0; k < 4; ++k )
+	{
+		int lo_k[3], hi_k[3], cov_k[3];
+		for( i = 0; i < 3; ++i )
+		{
+			lo_k[i] = lo[i][k];
+			hi_k[i] = hi[i][k];
+			cov_k[i] = cov[i][k];
+		}
+		range_fit_finish( &cmax[k], &cmin[k], lo_k, hi_k, cov_k );
+	}
+}
+#endif
+
+/*	nearest 5 or 6 bit code for a [0,255] value	*/
+static int quantize_channel( float v, int bits )
+{
+	const int top = (1 << bits) - 1;
+	int q = (int)(v * top / 255.0f + 0.5f);
+	if( q < 0 )
+	{
+		q = 0;
+	} else if( q > top )
+	{
+		q = top;
+	}
+	return q;
+}
+
+/*
+	Iterative cluster fit: with the pixels sorted along the color
+	line, try every split into the 4 palette entries, solve for the
+	least squares end points of each, and keep the best.  The line
+	is then re-aimed through the new end points and the search
+	repeated while the ordering changes.  Starts from (and never does
+	worse than) the LSE_master_colors_max_min fit.
+*/
+static void
+	cluster_fit_DDS_color_block
+	(
+		const unsigned char *const uncompressed,
+		unsigned char compressed[8]
+	)
+{
+	float axis[3], avg[3];
+	float sum[17][3];
+	float dots[16];
+	int order[16], last_order[16];
+	unsigned char trial[8];
+	int cmax, cmin, err, best_err;
+	int i, j, k, a, b, c, iteration;
+	/*	the line fit is the one to beat	*/
+	LSE_master_colors_max_min( &cmax, &cmin, 4, uncompressed );
+	best_err = fit_DDS_color_indices( cmax, cmin, uncompressed, compressed );
+	compute_color_line_STDEV( uncompressed, 4, avg, axis );
+	for( iteration = 0; (iteration < 2) && (best_err > 0); ++iteration )
+	{
+		float best_cost = 0.0f;
+		float best_a[3], best_b[3];
+		int found = 0, enc_a, enc_b;
+		/*	sort the pixels along the axis	*/
+		for( i = 0; i < 16; ++i )
+		{
+			float d = axis[0]*uncompressed[i*4+0] +
+					axis[1]*uncompressed[i*4+1] +
+					axis[2]*uncompressed[i*4+2];
+			for( j = i; (j > 0) && (dots[j-1] > d); --j )
+			{
+				dots[j] = dots[j-1];
+				order[j] = order[j-1];
+			}
+			dots[j] = d;
+			order[j] = i;
+		}
+		if( (iteration > 0) && (0 == memcmp( order, last_order, sizeof( order ) )) )
+		{
+			break;
+		}
+		memcpy( last_order, order, sizeof( order ) );
+		/*	running sums, so each cluster sum is a difference	*/
+		sum[0][0] = sum[0][1] = sum[0][2] = 0.0f;
+		for( i = 0; i < 16; ++i )
+		{
+			for( k = 0; k < 3; ++k )
+			{
+				sum[i+1][k] = sum[i][k] + uncompressed[order[i]*4+k];
+			}
+		}
+		/*	[0,a) -> end a, [a,b) -> 2/3 a + 1/3 b, [b,c) -> 1/3 a + 2/3 b,
+			[c,16) -> end b.  The weighted sums this needs collapse to
+			ap = (sum[a] + sum[b] + sum[c]) / 3 and bp = sum[16] - ap	*/
+		for( a = 0; a <= 16; ++a )
+		{
+			for( b = a; b <= 16; ++b )
+			{
+				for( c = b; c <= 16; ++c )
+				{
+					const float n1 = (float)(b - a), n2 = (float)(c - b);
+					const float aa = a + (4.0f/9.0f)*n1 + (1.0f/9.0f)*n2;
+					const float bb = (16 - c) + (4.0f/9.0f)*n2 + (1.0f/9.0f)*n1;
+					const float ab = (2.0f/9.0f)*(n1 + n2);
+					const float det = aa*bb - ab*ab;
+					float ap[3], bp[3], cost;
+					if( det < 0.0001f )
+					{
+						/*	a single cluster, the line fit covers that	*/
+						continue;
+					}
+					for( k = 0; k < 3; ++k )
+					{
+						ap[k] = (sum[a][k] + sum[b][k] + sum[c][k]) * (1.0f/3.0f);
+						bp[k] = sum[16][k] - ap[k];
+					}
+					/*	at the least squares end points the error is
+						sum(p*p) minus this	*/
+					cost = -(
+						bb * (ap[0]*ap[0] + ap[1]*ap[1] + ap[2]*ap[2]) -
+						2.0f * ab * (ap[0]*bp[0] + ap[1]*bp[1] + ap[2]*bp[2]) +
+						aa * (bp[0]*bp[0] + bp[1]*bp[1] + bp[2]*bp[2]) ) / det;
+					if( !found || (cost < best_cost) )
+					{
+						found = 1;
+						best_cost = cost;
+						for( k = 0; k < 3; ++k )
+						{
+							best_a[k] = (ap[k]*bb - bp[k]*ab) / det;
+							best_b[k] = (bp[k]*aa - ap[k]*ab) / det;
+						}
+					}
+				}
+			}
+		}
+		if( !found )
+		{
+			break;
+		}
+		/*	snap to 565 and see how it really does	*/
+		enc_a = (quantize_channel( best_a[0], 5 ) << 11) |
+				(quantize_channel( best_a[1], 6 ) << 5) |
+				quantize_channel( best_a[2], 5 );
+		enc_b = (quantize_channel( best_b[0], 5 ) << 11) |
+				(quantize_channel( best_b[1], 6 ) << 5) |
+				quantize_channel( best_b[2], 5 );
+		err = (enc_a >= enc_b) ?
+				fit_DDS_color_indices( enc_a, enc_b, uncompressed, trial ) :
+				fit_DDS_color_indices( enc_b, enc_a, uncompressed, trial );
+		if( err < best_err )
+		{
+			best_err = err;
+			memcpy( compressed, trial, 8 );
+		}
+		/*	aim the line through the new end points	*/
+		for( k = 0; k < 3; ++k )
+		{
+			axis[k] = best_a[k] - best_b[k];
+		}
+		if( (axis[0] == 0.0f) && (axis[1] == 0.0f) && (axis[2] == 0.0f) )
+		{
+			break;
+		}
+	}
+}
+
+/*
+	High quality DXT5 alpha / BC4 block: nearest palette entry for
+	each pixel (instead of truncating), with the end points searched
+	a few steps inside the value range.
+*/
+static void
+	fit_DDS_channel_block
+	(
+		const unsigned char *const uncompressed,
+		int offset,
+		unsigned char compressed[8]
+	)
+{
+	int lo, hi, range, a0, a1, i, t;
+	int best_err = INT_MAX, best_a0 = 0, best_a1 = 0;
+	int best_codes[16], codes[16];
+	int next_bit;
+	lo = hi = uncompressed[offset];
+	for( i = 1; i < 16; ++i )
+	{
+		int v = uncompressed[i*4+offset];
+		if( v < lo )
+		{
+			lo = v;
+		} else if( v > hi )
+		{
+			hi = v;
+		}
+	}
+	range = (hi - lo) / 8;
+	if( range > 4 )
+	{
+		range = 4;
+	}
+	for( a0 = hi; a0 >= hi - range; --a0 )
+	{
+		for( a1 = lo; (a1 <= lo + range) && (a1 < a0); ++a1 )
+		{
+			/*	palette along the line from a0 (t=0) to a1 (t=7)	*/
+			int pal[8], err = 0;
+			for( t = 0; t < 8; ++t )
+			{
+				pal[t] = ((7 - t)*a0 + t*a1 + 3) / 7;
+			}
+			for( i = 0; (i < 16) && (err < best_err); ++i )
+			{
+				int v = uncompressed[i*4+offset];
+				int best_d = INT_MAX;
+				for( t = 0; t < 8; ++t )
+				{
+					int d = (v - pal[t]) * (v - pal[t]);
+					if( d < best_d )
+					{
+						best_d = d;
+						codes[i] = t;
+					}
+				}
+				err += best_d;
+			}
+			if( err < best_err )
+			{
+				best_err = err;
+				best_a0 = a0;
+				best_a1 = a1;
+				memcpy( best_codes, codes, sizeof( codes ) );
+			}
+		}
+	}
+	memset( compressed, 0, 8 );
+	if( best_err == INT_MAX )
+	{
+		/*	flat block	*/
+		compressed[0] = hi;
+		compressed[1] = lo;
+		return;
+	}
+	compressed[0] = best_a0;
+	compressed[1] = best_a1;
+	/*	codes 0 and 1 are the end points, 2..7 step from a0 to a1	*/
+	next_bit = 8*2;
+	for( i = 0; i < 16; ++i )
+	{
+		int svalue = (best_codes[i] == 0) ? 0 :
+			((best_codes[i] == 7) ? 1 : best_codes[i] + 1);
+		compressed[next_bit >> 3] |= svalue << (next_bit & 7);
+		if( (next_bit & 7) > 5 )
+		{
+			/*	spans 2 bytes, fill in the start of the 2nd byte	*/
+			compressed[1 + (next_bit >> 3)] |= svalue >> (8 - (next_bit & 7) );
+		}
+		next_bit += 3;
+	}
+}
+
 void
 	compress_DDS_alpha_block
 	(
 		const unsigned char *const uncompressed,
 		unsigned char compressed[8]
 	)
+{
+	compress_DDS_channel_block( uncompressed, 3, SOIL_DXT_QUALITY_NORMAL, compressed );
+}
+
+/*
+	Compresses one channel (at offset in each RGBA pixel) of a
+	4x4 block into a DXT5 alpha / BC4 block.
+*/
+static void
+	compress_DDS_channel_block
+	(
+		const unsigned char *const uncompressed,
+		int offset, int quality,
+		unsigned char compressed[8]
+	)
 {
 	/*	variables	*/
 	int i;
@@ -588,9 +1408,14 @@ void
 	float scale_me;
 	/*	stupid order	*/
 	int swizzle8[] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+	if( quality == SOIL_DXT_QUALITY_HIGH )
+	{
+		fit_DDS_channel_block( uncompressed, offset, compressed );
+		return;
+	}
 	/*	get the alpha limits (a0 > a1)	*/
-	a0 = a1 = uncompressed[3];
-	for( i = 4+3; i < 16*4; i += 4 )
+	a0 = a1 = uncompressed[offset];
+	for( i = 4+offset; i < 16*4; i += 4 )
 	{
 		if( uncompressed[i] > a0 )
 		{
@@ -613,7 +1438,7 @@ void
 	/*	store the all of the alpha values	*/
 	next_bit = 8*2;
 	scale_me = 7.9999f / (a0 - a1);
-	for( i = 3; i < 16*4; i += 4 )
+	for( i = offset; i < 16*4; i += 4 )
 	{
 		/*	convert this alpha value to a 3 bit number	*/
 		int svalue;
@@ -45,6 +45,63 @@ convert_image_to_DXT5
     int *out_size
 );
 
+/**
+	take an image and convert it to BC4 (RGTC1 / ATI1, one channel),
+	encoding the first channel
+**/
+unsigned char*
+convert_image_to_BC4
+(
+    const unsigned char *const uncompressed,
+    int width, int height, int channels,
+    int *out_size
+);
+
+/**
+	take an image and convert it to BC5 (RGTC2 / ATI2, two channels),
+	encoding red and green (luminance and alpha for 2 channel images)
+**/
+unsigned char*
+convert_image_to_BC5
+(
+    const unsigned char *const uncompressed,
+    int width, int height, int channels,
+    int *out_size
+);
+
+/**	encoder quality levels, see set_DXT_quality	**/
+#define SOIL_DXT_QUALITY_FAST	0
+#define SOIL_DXT_QUALITY_NORMAL	1
+#define SOIL_DXT_QUALITY_HIGH	2
+
+/**
+	pick the block fitting used by all the convert_image_to_* functions:
+	SOIL_DXT_QUALITY_FAST fits colors to the bounding box of the block,
+	SOIL_DXT_QUALITY_NORMAL (the default) fits a line through the block's
+	principal axis, SOIL_DXT_QUALITY_HIGH refines that with an iterative
+	cluster fit and searches the alpha / BC4 end points.  HIGH is about
+	two orders of magnitude slower than NORMAL, meant for offline baking
+	(tools/dxtbench prints the tradeoff for a given image).
+**/
+void
+set_DXT_quality
+(
+    int quality
+);
+
+/**
+	set how many threads the convert_image_to_* functions split the image's
+	block rows across.  0 (the default) uses one per CPU, skipping
+	threads for small images; 1 compresses on the calling thread.
+	The output does not depend on the thread count.  Set 1 before
+	compressing from several threads of your own.
+**/
+void
+set_DXT_thread_count
+(
+    int threads
+);
+
 /**	A bunch of DirectDraw Surface structures and flags **/
 typedef struct
 {
@@ -7,9 +7,146 @@
 */
 
 #include "image_helper.h"
+#include "image_threads.h"
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
+/*	the SSE2 kernels do the same arithmetic as the scalar code, so the
+	results are identical.  Define SOIL_HELPER_NO_SIMD to force the
+	scalar path.	*/
+#if !defined(SOIL_HELPER_NO_SIMD) && \
+	(defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+	#define SOIL_HELPER_SSE2 1
+	#include <emmintrin.h>
+#endif
+
+/*	0 => one thread per CPU	*/
+static int helper_thread_count = 0;
+
+void set_image_helper_thread_count( int threads )
+{
+	helper_thread_count = (threads < 0) ? 0 : threads;
+}
+
+/*	unless a thread count was set, keep at least this many output
+	rows on each thread	*/
+#define HELPER_MIN_ROWS	32
+
+/*	an up_scale_image call, bands of output rows go to each thread	*/
+typedef struct
+{
+	const unsigned char *orig;
+	int width, height, channels;
+	unsigned char *resampled;
+	int resampled_width;
+	float dy;
+	/*	per output column: index of the left sample, and its weight	*/
+	const int *base_x;
+	const float *frac_x;
+}
+up_scale_job;
+
+#if SOIL_HELPER_SSE2
+/*	1 pixel of 3 or 4 channels as 4 floats	*/
+static __m128 load_pixel_SSE2( const unsigned char *p, int channels )
+{
+	int bits;
+	__m128i v;
+	if( channels == 4 )
+	{
+		memcpy( &bits, p, 4 );
+	} else
+	{
+		bits = p[0] | (p[1] << 8) | (p[2] << 16);
+	}
+	v = _mm_cvtsi32_si128( bits );
+	v = _mm_unpacklo_epi8( v, _mm_setzero_si128() );
+	v = _mm_unpacklo_epi16( v, _mm_setzero_si128() );
+	return _mm_cvtepi32_ps( v );
+}
+#endif
+
+static void up_scale_rows( void *context, int row_start, int row_end )
+{
+	const up_scale_job *job = (const up_scale_job*)context;
+	const int channels = job->channels;
+	const int stride = job->width * channels;
+	int x, y, c;
+	for ( y = row_start; y < row_end; ++y )
+	{
+		/* find the base y index and fractional offset from that	*/
+		float sampley = y * job->dy;
+		int inty = (int)sampley;
+		const unsigned char *row;
+		unsigned char *out = job->resampled + y*job->resampled_width*channels;
+		/*	if( inty < 0 ) { inty = 0; } else	*/
+		if( inty > job->height - 2 ) { inty = job->height - 2; }
+		sampley -= inty;
+		row = job->orig + inty * stride;
+		#if SOIL_HELPER_SSE2
+		if( (channels == 3) || (channels == 4) )
+		{
+			/*	all channels of a pixel at once	*/
+			const __m128 wy0 = _mm_set1_ps( 1.0f-sampley );
+			const __m128 wy1 = _mm_set1_ps( sampley );
+			for ( x = 0; x < job->resampled_width; ++x )
+			{
+				const unsigned char *p = row + job->base_x[x];
+				const __m128 wx0 = _mm_set1_ps( 1.0f-job->frac_x[x] );
+				const __m128 wx1 = _mm_set1_ps( job->frac_x[x] );
+				__m128 value = _mm_set1_ps( 0.5f );
+				int bits;
+				__m128i v;
+				value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps(
+						load_pixel_SSE2( p, channels ), wx0 ), wy0 ) );
+				value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps(
+						load_pixel_SSE2( p + channels, channels ), wx1 ), wy0 ) );
+				value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps(
+						load_pixel_SSE2( p + stride, channels ), wx0 ), wy1 ) );
+				value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps(
+						load_pixel_SSE2( p + stride + channels, channels ), wx1 ), wy1 ) );
+				v = _mm_cvttps_epi32( value );
+				v = _mm_packs_epi32( v, v );
+				bits = _mm_cvtsi128_si32( _mm_packus_epi16( v, v ) );
+				out[0] = (unsigned char)(bits);
+				out[1] = (unsigned char)(bits >> 8);
+				out[2] = (unsigned char)(bits >> 16);
+				if( channels == 4 )
+				{
+					out[3] = (unsigned char)(bits >> 24);
+				}
+				out += channels;
+			}
+			continue;
+		}
+		#endif
+		for ( x = 0; x < job->resampled_width; ++x )
+		{
+			float samplex = job->frac_x[x];
+			/*	base index into the original image row	*/
+			int base_index = job->base_x[x];
+			for ( c = 0; c < channels; ++c )
+			{
+				/*	do the sampling	*/
+				float value = 0.5f;
+				value += row[base_index]
+							*(1.0f-samplex)*(1.0f-sampley);
+				value += row[base_index+channels]
+							*(samplex)*(1.0f-sampley);
+				value += row[base_index+stride]
+							*(1.0f-samplex)*(sampley);
+				value += row[base_index+stride+channels]
+							*(samplex)*(sampley);
+				/*	move to the next channel	*/
+				++base_index;
+				/*	save the new value	*/
+				*out++ = (unsigned char)(value);
+			}
+		}
+	}
+}
+
 /*	Upscaling the image uses simple bilinear interpolation	*/
 int
 	up_scale_image
@@ -20,8 +157,11 @@ int
 		int resampled_width, int resampled_height
 	)
 {
-	float dx, dy;
-	int x, y, c;
+	up_scale_job job;
+	int *base_x;
+	float *frac_x;
+	float dx;
+	int x;
 
     /* error(s) check	*/
     if ( 	(width < 1) || (height < 1) ||
@@ -35,63 +175,210 @@ int
     /*
 		for each given pixel in the new map, find the exact location
 		from the original map which would contribute to this guy
+		(the columns are the same for every row, so look them up once)
 	*/
+	base_x = (int*)malloc( resampled_width * sizeof( int ) );
+	frac_x = (float*)malloc( resampled_width * sizeof( float ) );
+	if( (NULL == base_x) || (NULL == frac_x) )
+	{
+		free( base_x );
+		free( frac_x );
+		return 0;
+	}
     dx = (width - 1.0f) / (resampled_width - 1.0f);
-    dy = (height - 1.0f) / (resampled_height - 1.0f);
-    for ( y = 0; y < resampled_height; ++y )
-    {
-    	/* find the base y index and fractional offset from that	*/
-    	float sampley = y * dy;
-    	int inty = (int)sampley;
-    	/*	if( inty < 0 ) { inty = 0; } else	*/
-		if( inty > height - 2 ) { inty = height - 2; }
-		sampley -= inty;
-        for ( x = 0; x < resampled_width; ++x )
-        {
-			float samplex = x * dx;
-			int intx = (int)samplex;
-			int base_index;
-			/* find the base x index and fractional offset from that	*/
-			/*	if( intx < 0 ) { intx = 0; } else	*/
-			if( intx > width - 2 ) { intx = width - 2; }
-			samplex -= intx;
-			/*	base index into the original image	*/
-			base_index = (inty * width + intx) * channels;
-            for ( c = 0; c < channels; ++c )
-            {
-            	/*	do the sampling	*/
-				float value = 0.5f;
-				value += orig[base_index]
-							*(1.0f-samplex)*(1.0f-sampley);
-				value += orig[base_index+channels]
-							*(samplex)*(1.0f-sampley);
-				value += orig[base_index+width*channels]
-							*(1.0f-samplex)*(sampley);
-				value += orig[base_index+width*channels+channels]
-							*(samplex)*(sampley);
-				/*	move to the next channel	*/
-				++base_index;
-            	/*	save the new value	*/
-            	resampled[y*resampled_width*channels+x*channels+c] =
-						(unsigned char)(value);
-            }
-        }
-    }
+	for ( x = 0; x < resampled_width; ++x )
+	{
+		float samplex = x * dx;
+		int intx = (int)samplex;
+		/* find the base x index and fractional offset from that	*/
+		/*	if( intx < 0 ) { intx = 0; } else	*/
+		if( intx > width - 2 ) { intx = width - 2; }
+		samplex -= intx;
+		base_x[x] = intx * channels;
+		frac_x[x] = samplex;
+	}
+	job.orig = orig;
+	job.width = width;
+	job.height = height;
+	job.channels = channels;
+	job.resampled = resampled;
+	job.resampled_width = resampled_width;
+	job.dy = (height - 1.0f) / (resampled_height - 1.0f);
+	job.base_x = base_x;
+	job.frac_x = frac_x;
+	SOIL_run_row_bands( up_scale_rows, &job, resampled_height, helper_thread_count,
+			(helper_thread_count > 0) ? 1 : HELPER_MIN_ROWS );
+	free( base_x );
+	free( frac_x );
     /*	done	*/
     return 1;
 }
 
-int
-	mipmap_image
+/*	a mipmap_image call, bands of output rows go to each thread	*/
+typedef struct
+{
+	const unsigned char *orig;
+	int width, channels;
+	unsigned char *resampled;
+	int mip_width;
+	int block_size_x, block_size_y;
+	/*	the block actually used (smaller for tiny images)	*/
+	int u_block, v_block;
+	/*	for the sRGB version: the channels before color_channels
+		are sRGB (byte -> linear through to_linear, back through the
+		linear values half way between codes), alpha stays linear	*/
+	int srgb, color_channels;
+	const float *to_linear;
+	const float *thresholds;
+}
+mipmap_job;
+
+/*	acc[i] += row[i] for n bytes	*/
+static void accumulate_row( unsigned int *acc, const unsigned char *row, int n )
+{
+	int i = 0;
+	#if SOIL_HELPER_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for( ; i + 16 <= n; i += 16 )
+	{
+		__m128i bytes = _mm_loadu_si128( (const __m128i*)(row + i) );
+		__m128i lo = _mm_unpacklo_epi8( bytes, zero );
+		__m128i hi = _mm_unpackhi_epi8( bytes, zero );
+		__m128i *a = (__m128i*)(acc + i);
+		_mm_storeu_si128( a + 0, _mm_add_epi32( _mm_loadu_si128( a + 0 ), _mm_unpacklo_epi16( lo, zero ) ) );
+		_mm_storeu_si128( a + 1, _mm_add_epi32( _mm_loadu_si128( a + 1 ), _mm_unpackhi_epi16( lo, zero ) ) );
+		_mm_storeu_si128( a + 2, _mm_add_epi32( _mm_loadu_si128( a + 2 ), _mm_unpacklo_epi16( hi, zero ) ) );
+		_mm_storeu_si128( a + 3, _mm_add_epi32( _mm_loadu_si128( a + 3 ), _mm_unpackhi_epi16( hi, zero ) ) );
+	}
+	#endif
+	for( ; i < n; ++i )
+	{
+		acc[i] += row[i];
+	}
+}
+
+/*	nearest sRGB code for a linear value	*/
+static unsigned char linear_to_sRGB_code( float v, const float *thresholds )
+{
+	/*	thresholds[k] lies between codes k and k+1	*/
+	int lo = 0, hi = 255;
+	while( lo < hi )
+	{
+		int mid = (lo + hi) >> 1;
+		if( v > thresholds[mid] )
+		{
+			lo = mid + 1;
+		} else
+		{
+			hi = mid;
+		}
+	}
+	return (unsigned char)lo;
+}
+
+static void mipmap_rows( void *context, int row_start, int row_end )
+{
+	const mipmap_job *job = (const mipmap_job*)context;
+	const int channels = job->channels;
+	const int block_area = job->u_block * job->v_block;
+	/*	only the columns that land in a block are summed	*/
+	const int n = ((job->mip_width - 1) * job->block_size_x + job->u_block) * channels;
+	unsigned int *acc = NULL;
+	float *lin = NULL;
+	int i, j, c, u, v;
+	if( job->srgb )
+	{
+		lin = (float*)malloc( n * sizeof( float ) );
+	} else
+	{
+		acc = (unsigned int*)malloc( n * sizeof( unsigned int ) );
+	}
+	if( (NULL == acc) && (NULL == lin) )
+	{
+		return;
+	}
+	for( j = row_start; j < row_end; ++j )
+	{
+		unsigned char *out = job->resampled + j*job->mip_width*channels;
+		const unsigned char *row = job->orig + (j*job->block_size_y)*job->width*channels;
+		/*	sum the block's rows first, then across each block	*/
+		if( job->srgb )
+		{
+			memset( lin, 0, n * sizeof( float ) );
+			for( v = 0; v < job->v_block; ++v )
+			{
+				for( i = 0; i < n; i += channels )
+				{
+					for( c = 0; c < job->color_channels; ++c )
+					{
+						lin[i+c] += job->to_linear[row[i+c]];
+					}
+					for( ; c < channels; ++c )
+					{
+						lin[i+c] += row[i+c] * (1.0f / 255.0f);
+					}
+				}
+				row += job->width*channels;
+			}
+			for( i = 0; i < job->mip_width; ++i )
+			{
+				for( c = 0; c < channels; ++c )
+				{
+					float sum_value = 0.0f;
+					for( u = 0; u < job->u_block; ++u )
+					{
+						sum_value += lin[(i*job->block_size_x + u)*channels + c];
+					}
+					sum_value /= block_area;
+					if( c < job->color_channels )
+					{
+						*out++ = linear_to_sRGB_code( sum_value, job->thresholds );
+					} else
+					{
+						*out++ = (unsigned char)(sum_value * 255.0f + 0.5f);
+					}
+				}
+			}
+		} else
+		{
+			memset( acc, 0, n * sizeof( unsigned int ) );
+			for( v = 0; v < job->v_block; ++v )
+			{
+				accumulate_row( acc, row, n );
+				row += job->width*channels;
+			}
+			for( i = 0; i < job->mip_width; ++i )
+			{
+				for( c = 0; c < channels; ++c )
+				{
+					/*	note: start the sum at the rounding value, not at 0	*/
+					unsigned int sum_value = block_area >> 1;
+					for( u = 0; u < job->u_block; ++u )
+					{
+						sum_value += acc[(i*job->block_size_x + u)*channels + c];
+					}
+					*out++ = sum_value / block_area;
+				}
+			}
+		}
+	}
+	free( acc );
+	free( lin );
+}
+
+static int
+	mipmap_image_internal
 	(
 		const unsigned char* const orig,
 		int width, int height, int channels,
 		unsigned char* resampled,
-		int block_size_x, int block_size_y
+		int block_size_x, int block_size_y,
+		int srgb
 	)
 {
-	int mip_width, mip_height;
-	int i, j, c;
+	mipmap_job job;
+	float to_linear[256], thresholds[256];
+	int mip_height, i;
 
 	/*	error check	*/
 	if( (width < 1) || (height < 1) ||
@@ -102,55 +389,72 @@ int
 		/*	nothing to do	*/
 		return 0;
 	}
-	mip_width = width / block_size_x;
+	job.orig = orig;
+	job.width = width;
+	job.channels = channels;
+	job.resampled = resampled;
+	job.block_size_x = block_size_x;
+	job.block_size_y = block_size_y;
+	job.mip_width = width / block_size_x;
 	mip_height = height / block_size_y;
-	if( mip_width < 1 )
+	if( job.mip_width < 1 )
 	{
-		mip_width = 1;
+		job.mip_width = 1;
 	}
 	if( mip_height < 1 )
 	{
 		mip_height = 1;
 	}
-	for( j = 0; j < mip_height; ++j )
+	/*	do a bit of checking so we don't over-run the boundaries
+		(necessary for non-square textures!)	*/
+	job.u_block = (block_size_x > width) ? width : block_size_x;
+	job.v_block = (block_size_y > height) ? height : block_size_y;
+	job.srgb = srgb;
+	/*	alpha (the last of 2 or 4 channels) is averaged as is	*/
+	job.color_channels = (channels & 1) ? channels : channels - 1;
+	job.to_linear = to_linear;
+	job.thresholds = thresholds;
+	if( srgb )
 	{
-		for( i = 0; i < mip_width; ++i )
+		for( i = 0; i < 256; ++i )
 		{
-			for( c = 0; c < channels; ++c )
-			{
-				const int index = (j*block_size_y)*width*channels + (i*block_size_x)*channels + c;
-				int sum_value;
-				int u,v;
-				int u_block = block_size_x;
-				int v_block = block_size_y;
-				int block_area;
-				/*	do a bit of checking so we don't over-run the boundaries
-					(necessary for non-square textures!)	*/
-				if( block_size_x * (i+1) > width )
-				{
-					u_block = width - i*block_size_y;
-				}
-				if( block_size_y * (j+1) > height )
-				{
-					v_block = height - j*block_size_y;
-				}
-				block_area = u_block*v_block;
-				/*	for this pixel, see what the average
-					of all the values in the block are.
-					note: start the sum at the rounding value, not at 0	*/
-				sum_value = block_area >> 1;
-				for( v = 0; v < v_block; ++v )
-				for( u = 0; u < u_block; ++u )
-				{
-					sum_value += orig[index + v*width*channels + u*channels];
-				}
-				resampled[j*mip_width*channels + i*channels + c] = sum_value / block_area;
-			}
+			float s = i / 255.0f;
+			float m = (i + 0.5f) / 255.0f;
+			to_linear[i] = (s <= 0.04045f) ? s / 12.92f : (float)pow( (s + 0.055f) / 1.055f, 2.4 );
+			thresholds[i] = (m <= 0.04045f) ? m / 12.92f : (float)pow( (m + 0.055f) / 1.055f, 2.4 );
 		}
 	}
+	SOIL_run_row_bands( mipmap_rows, &job, mip_height, helper_thread_count,
+			(helper_thread_count > 0) ? 1 : HELPER_MIN_ROWS );
 	return 1;
 }
 
+int
+	mipmap_image
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int block_size_x, int block_size_y
+	)
+{
+	return mipmap_image_internal( orig, width, height, channels,
+			resampled, block_size_x, block_size_y, 0 );
+}
+
+int
+	mipmap_image_sRGB
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int block_size_x, int block_size_y
+	)
+{
+	return mipmap_image_internal( orig, width, height, channels,
+			resampled, block_size_x, block_size_y, 1 );
+}
+
 int
 	scale_image_RGB_to_NTSC_safe
 	(
@@ -43,6 +43,34 @@ int
 		int block_size_x, int block_size_y
 	);
 
+/**
+	Same as mipmap_image, but gamma-correct: the color channels are
+	treated as sRGB and averaged in linear space (alpha, the last of
+	2 or 4 channels, is averaged as is).  Keeps mips of high contrast
+	detail from darkening.
+**/
+int
+	mipmap_image_sRGB
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int block_size_x, int block_size_y
+	);
+
+/**
+	set how many threads up_scale_image and mipmap_image(_sRGB)
+	split their output rows across.  0 (the default) uses one per
+	CPU, skipping threads for small images; 1 works on the calling
+	thread.  The output does not depend on the thread count.  Set 1
+	before resampling from several threads of your own.
+**/
+void
+	set_image_helper_thread_count
+	(
+		int threads
+	);
+
 /**
 	This function takes the RGB components of the image
 	and scales each channel from [0,255] to [16,235].
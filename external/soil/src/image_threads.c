@@ -0,0 +1,139 @@
+/*
+	Row band threading shared by the image helper and DXT code
+
+	public domain
+*/
+
+#include "image_threads.h"
+
+#ifndef SOIL_NO_THREADS
+	#ifdef _WIN32
+		#include <windows.h>
+	#else
+		#include <pthread.h>
+		#include <unistd.h>
+	#endif
+#endif
+
+#define SOIL_MAX_THREADS	64
+
+typedef struct
+{
+	void (*band)( void *context, int row_start, int row_end );
+	void *context;
+	int row_start, row_end;
+}
+row_band;
+
+#ifndef SOIL_NO_THREADS
+#ifdef _WIN32
+static DWORD WINAPI row_band_thread( LPVOID arg )
+{
+	row_band *b = (row_band*)arg;
+	b->band( b->context, b->row_start, b->row_end );
+	return 0;
+}
+#else
+static void* row_band_thread( void *arg )
+{
+	row_band *b = (row_band*)arg;
+	b->band( b->context, b->row_start, b->row_end );
+	return NULL;
+}
+#endif
+
+static int cpu_count( void )
+{
+	#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+	return (int)info.dwNumberOfProcessors;
+	#elif defined(_SC_NPROCESSORS_ONLN)
+	return (int)sysconf( _SC_NPROCESSORS_ONLN );
+	#else
+	return 1;
+	#endif
+}
+#endif
+
+void
+	SOIL_run_row_bands
+	(
+		void (*band)( void *context, int row_start, int row_end ),
+		void *context,
+		int rows, int max_threads, int min_rows
+	)
+{
+	#ifndef SOIL_NO_THREADS
+	row_band bands[SOIL_MAX_THREADS];
+	#ifdef _WIN32
+	HANDLE handles[SOIL_MAX_THREADS];
+	#else
+	pthread_t handles[SOIL_MAX_THREADS];
+	#endif
+	int started[SOIL_MAX_THREADS];
+	int threads, t;
+	if( rows < 1 )
+	{
+		return;
+	}
+	threads = (max_threads > 0) ? max_threads : cpu_count();
+	if( min_rows < 1 )
+	{
+		min_rows = 1;
+	}
+	if( threads > rows / min_rows )
+	{
+		threads = rows / min_rows;
+	}
+	if( threads > SOIL_MAX_THREADS )
+	{
+		threads = SOIL_MAX_THREADS;
+	}
+	if( threads > 1 )
+	{
+		for( t = 0; t < threads; ++t )
+		{
+			bands[t].band = band;
+			bands[t].context = context;
+			bands[t].row_start = rows * t / threads;
+			bands[t].row_end = rows * (t+1) / threads;
+		}
+		/*	the calling thread takes the first band itself	*/
+		for( t = 1; t < threads; ++t )
+		{
+			#ifdef _WIN32
+			handles[t] = CreateThread( NULL, 0, row_band_thread, &bands[t], 0, NULL );
+			started[t] = (handles[t] != NULL);
+			#else
+			started[t] = (pthread_create( &handles[t], NULL, row_band_thread, &bands[t] ) == 0);
+			#endif
+		}
+		band( context, bands[0].row_start, bands[0].row_end );
+		for( t = 1; t < threads; ++t )
+		{
+			if( !started[t] )
+			{
+				/*	could not get a thread, do it here	*/
+				band( context, bands[t].row_start, bands[t].row_end );
+				continue;
+			}
+			#ifdef _WIN32
+			WaitForSingleObject( handles[t], INFINITE );
+			CloseHandle( handles[t] );
+			#else
+			pthread_join( handles[t], NULL );
+			#endif
+		}
+		return;
+	}
+	#else
+	(void)max_threads;
+	(void)min_rows;
+	#endif
+	/*	single threaded	*/
+	if( rows > 0 )
+	{
+		band( context, 0, rows );
+	}
+}
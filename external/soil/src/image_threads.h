@@ -0,0 +1,34 @@
+/*
+	Row band threading shared by the image helper and DXT code
+
+	public domain
+*/
+
+#ifndef HEADER_IMAGE_THREADS
+#define HEADER_IMAGE_THREADS
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	Splits rows [0,rows) into contiguous bands and calls
+	band( context, row_start, row_end ) once per band, each on its
+	own thread.  max_threads = 0 uses one thread per CPU.  Every
+	thread gets at least min_rows rows, so small images stay on the
+	calling thread, which always runs the first band itself.
+	Define SOIL_NO_THREADS to build without any threading.
+**/
+void
+	SOIL_run_row_bands
+	(
+		void (*band)( void *context, int row_start, int row_end ),
+		void *context,
+		int rows, int max_threads, int min_rows
+	);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HEADER_IMAGE_THREADS	*/
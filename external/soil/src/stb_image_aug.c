@@ -14,9 +14,9 @@
       writes BMP,TGA (define STBI_NO_WRITE to remove code)
       decoded from memory or through stdio FILE (define STBI_NO_STDIO to remove code)
       supports installable dequantizing-IDCT, YCbCr-to-RGB conversion (define STBI_SIMD)
-
-   TODO:
-      stbi_info_*
+      SSE2 IDCT, YCbCr-to-RGB and chroma upsampling on SSE2 targets (define STBI_NO_SIMD to disable)
+      JPEG restart intervals decoded on several threads (stbi_set_thread_count)
+      size and components of every format from the header alone (stbi_info_*)
 
    history:
       1.16   major bugfix - convert_format converted one too many pixels
@@ -77,6 +77,24 @@
 #include <memory.h>
 #include <assert.h>
 #include <stdarg.h>
+#include "image_threads.h"
+
+// SIMD builds on SSE2 targets install SSE2 kernels as the default IDCT and
+// color conversion, and vectorize the chroma upsamplers and PNG unfiltering
+#if STBI_SIMD && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define STBI_SSE2 1
+#include <emmintrin.h>
+#else
+#define STBI_SSE2 0
+#endif
+
+#if STBI_SIMD
+  #ifdef _MSC_VER
+  #define STBI_ALIGN16 __declspec(align(16))
+  #else
+  #define STBI_ALIGN16 __attribute__((aligned(16)))
+  #endif
+#endif
 
 #ifndef _MSC_VER
   #ifdef __cplusplus
@@ -94,9 +112,23 @@ typedef   signed short  int16;
 typedef unsigned int   uint32;
 typedef   signed int    int32;
 typedef unsigned int   uint;
+#ifdef _MSC_VER
+typedef unsigned __int64 uint64;
+#else
+typedef unsigned long long uint64;
+#endif
 
 // should produce compiler error if size is wrong
 typedef unsigned char validate_uint32[sizeof(uint32)==4];
+typedef unsigned char validate_uint64[sizeof(uint64)==8];
+
+// little-endian targets refill the zlib bit buffer with one 8-byte load
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__) || \
+    (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define STBI_LITTLE_ENDIAN 1
+#else
+#define STBI_LITTLE_ENDIAN 0
+#endif
 
 #if defined(STBI_NO_STDIO) && !defined(STBI_NO_WRITE)
 #define STBI_NO_WRITE
@@ -114,8 +146,17 @@ typedef unsigned char validate_uint32[sizeof(uint32)==4];
 // Generic API that works on all image types
 //
 
-// this is not threadsafe
-static char *failure_reason;
+// one per thread where the compiler supports it, so concurrent loads and
+// stbi_info probes don't race on it
+#if defined(_MSC_VER)
+   #define STBI_THREAD_LOCAL  __declspec(thread)
+#elif defined(__GNUC__)
+   #define STBI_THREAD_LOCAL  __thread
+#else
+   #define STBI_THREAD_LOCAL
+#endif
+
+static STBI_THREAD_LOCAL char *failure_reason;
 
 char *stbi_failure_reason(void)
 {
@@ -128,6 +169,14 @@ static int e(char *str)
    return 0;
 }
 
+// threads the JPEG decoder may spread restart intervals over; 0 = one per CPU
+static int stbi_thread_count = 0;
+
+void stbi_set_thread_count(int count)
+{
+   stbi_thread_count = count < 0 ? 0 : count;
+}
+
 #ifdef STBI_NO_FAILURE_STRINGS
    #define e(x,y)  0
 #elif defined(STBI_FAILURE_USERMSG)
@@ -320,12 +369,91 @@ extern int      stbi_is_hdr_from_file(FILE *f)
 
 #endif
 
-// @TODO: get image dimensions & components without fully decoding
+// get image dimensions & components without fully decoding; formats are
+// tested in the same order as stbi_load, then only their headers are read
 #ifndef STBI_NO_STDIO
-extern int      stbi_info            (char const *filename,           int *x, int *y, int *comp);
-extern int      stbi_info_from_file  (FILE *f,                  int *x, int *y, int *comp);
+int stbi_info(char const *filename, int *x, int *y, int *comp)
+{
+   FILE *f = fopen(filename, "rb");
+   int result;
+   if (!f) return e("can't fopen", "Unable to open file");
+   result = stbi_info_from_file(f,x,y,comp);
+   fclose(f);
+   return result;
+}
+
+int stbi_info_from_file(FILE *f, int *x, int *y, int *comp)
+{
+   int i;
+   if (stbi_jpeg_test_file(f))
+      return stbi_jpeg_info_from_file(f,x,y,comp);
+   if (stbi_png_test_file(f))
+      return stbi_png_info_from_file(f,x,y,comp);
+   if (stbi_bmp_test_file(f))
+      return stbi_bmp_info_from_file(f,x,y,comp);
+   if (stbi_psd_test_file(f))
+      return stbi_psd_info_from_file(f,x,y,comp);
+   #ifndef STBI_NO_DDS
+   if (stbi_dds_test_file(f))
+      return stbi_dds_info_from_file(f,x,y,comp);
+   #endif
+   #ifndef STBI_NO_HDR
+   if (stbi_hdr_test_file(f))
+      return stbi_hdr_info_from_file(f,x,y,comp);
+   #endif
+   // loaders added at runtime have no header probe, so decode and drop the image
+   for (i=0; i < max_loaders; ++i)
+      if (loaders[i]->test_file(f)) {
+         int n, w, h, pos = ftell(f);
+         stbi_uc *data = loaders[i]->load_from_file(f,&w,&h,&n,0);
+         fseek(f,pos,SEEK_SET);
+         if (data == NULL) return 0;
+         free(data);
+         if (x) *x = w;
+         if (y) *y = h;
+         if (comp) *comp = n;
+         return 1;
+      }
+   if (stbi_tga_test_file(f))
+      return stbi_tga_info_from_file(f,x,y,comp);
+   return e("unknown image type", "Image not of any known type, or corrupt");
+}
 #endif
-extern int      stbi_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp);
+
+int stbi_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp)
+{
+   int i;
+   if (stbi_jpeg_test_memory(buffer,len))
+      return stbi_jpeg_info_from_memory(buffer,len,x,y,comp);
+   if (stbi_png_test_memory(buffer,len))
+      return stbi_png_info_from_memory(buffer,len,x,y,comp);
+   if (stbi_bmp_test_memory(buffer,len))
+      return stbi_bmp_info_from_memory(buffer,len,x,y,comp);
+   if (stbi_psd_test_memory(buffer,len))
+      return stbi_psd_info_from_memory(buffer,len,x,y,comp);
+   #ifndef STBI_NO_DDS
+   if (stbi_dds_test_memory(buffer,len))
+      return stbi_dds_info_from_memory(buffer,len,x,y,comp);
+   #endif
+   #ifndef STBI_NO_HDR
+   if (stbi_hdr_test_memory(buffer,len))
+      return stbi_hdr_info_from_memory(buffer,len,x,y,comp);
+   #endif
+   for (i=0; i < max_loaders; ++i)
+      if (loaders[i]->test_memory(buffer,len)) {
+         int n, w, h;
+         stbi_uc *data = loaders[i]->load_from_memory(buffer,len,&w,&h,&n,0);
+         if (data == NULL) return 0;
+         free(data);
+         if (x) *x = w;
+         if (y) *y = h;
+         if (comp) *comp = n;
+         return 1;
+      }
+   if (stbi_tga_test_memory(buffer,len))
+      return stbi_tga_info_from_memory(buffer,len,x,y,comp);
+   return e("unknown image type", "Image not of any known type, or corrupt");
+}
 
 #ifndef STBI_NO_HDR
 static float h2l_gamma_i=1.0f/2.2f, h2l_scale_i=1.0f;
@@ -351,6 +479,15 @@ enum
    SCAN_header,
 };
 
+// caller memory that the stbi_load_*_into functions decode into
+typedef struct
+{
+   uint8 *dest;         // row 0 of the image
+   int pitch;           // bytes from one row to the next, negative when flipping
+   int max_x, max_y;    // the largest image dest can hold
+   int comp;            // components per pixel
+} stbi_target;
+
 typedef struct
 {
    uint32 img_x, img_y;
@@ -360,12 +497,17 @@ typedef struct
    FILE  *img_file;
    #endif
    uint8 *img_buffer, *img_buffer_end;
+
+   // set when decoding into caller memory; the JPEG and PNG loaders then write
+   // there directly and return target->dest
+   stbi_target *target;
 } stbi;
 
 #ifndef STBI_NO_STDIO
 static void start_file(stbi *s, FILE *f)
 {
    s->img_file = f;
+   s->target = NULL;
 }
 #endif
 
@@ -374,6 +516,7 @@ static void start_mem(stbi *s, uint8 const *buffer, int len)
 #ifndef STBI_NO_STDIO
    s->img_file = NULL;
 #endif
+   s->target = NULL;
    s->img_buffer = (uint8 *) buffer;
    s->img_buffer_end = (uint8 *) buffer+len;
 }
@@ -467,23 +610,21 @@ static uint8 compute_y(int r, int g, int b)
    return (uint8) (((r*77) + (g*150) +  (29*b)) >> 8);
 }
 
-static unsigned char *convert_format(unsigned char *data, int img_n, int req_comp, uint x, uint y)
+// converts a tightly packed image with img_n components into req_comp
+// component rows dest_pitch bytes apart
+static void convert_rows(unsigned char const *data, int img_n, unsigned char *out, int dest_pitch, int req_comp, uint x, uint y)
 {
    int i,j;
-   unsigned char *good;
-
-   if (req_comp == img_n) return data;
    assert(req_comp >= 1 && req_comp <= 4);
 
-   good = (unsigned char *) malloc(req_comp * x * y);
-   if (good == NULL) {
-      free(data);
-      return epuc("outofmem", "Out of memory");
-   }
-
    for (j=0; j < (int) y; ++j) {
-      unsigned char *src  = data + j * x * img_n   ;
-      unsigned char *dest = good + j * x * req_comp;
+      unsigned char const *src = data + j * x * img_n;
+      unsigned char *dest = out + j * dest_pitch;
+
+      if (img_n == req_comp) {
+         memcpy(dest, src, x * img_n);
+         continue;
+      }
 
       #define COMBO(a,b)  ((a)*8+(b))
       #define CASE(a,b)   case COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
@@ -506,11 +647,46 @@ static unsigned char *convert_format(unsigned char *data, int img_n, int req_com
       }
       #undef CASE
    }
+}
+
+static unsigned char *convert_format(unsigned char *data, int img_n, int req_comp, uint x, uint y)
+{
+   unsigned char *good;
+
+   if (req_comp == img_n) return data;
+   assert(req_comp >= 1 && req_comp <= 4);
 
+   good = (unsigned char *) malloc(req_comp * x * y);
+   if (good == NULL) {
+      free(data);
+      return epuc("outofmem", "Out of memory");
+   }
+   convert_rows(data, img_n, good, req_comp * x, req_comp, x, y);
    free(data);
    return good;
 }
 
+static int target_fits(stbi_target *t, uint32 x, uint32 y)
+{
+   if (x > (uint32) t->max_x || y > (uint32) t->max_y)
+      return e("too large for dest", "Image larger than the destination");
+   return 1;
+}
+
+// finishes a load into caller memory from an image decoded into its own
+// buffer with n components, converting or copying it into the destination
+static uint8 *store_into_target(stbi_target *t, uint8 *data, int n, int x, int y)
+{
+   if (data == NULL || data == t->dest) return data;
+   if (!target_fits(t, x, y)) {
+      free(data);
+      return NULL;
+   }
+   convert_rows(data, n, t->dest, t->pitch, t->comp, x, y);
+   free(data);
+   return t->dest;
+}
+
 #ifndef STBI_NO_HDR
 static float   *ldr_to_hdr(stbi_uc *data, int x, int y, int comp)
 {
@@ -684,9 +860,12 @@ static void grow_buffer_unsafe(jpeg *j)
       if (b == 0xff) {
          int c = get8(&j->s);
          if (c != 0) {
+            // keep feeding zero bits past the marker; returning with fewer
+            // than FAST_BITS buffered made decode() shift by a negative count
+            // and garble the last block before RSTn / EOI
             j->marker = (unsigned char) c;
             j->nomore = 1;
-            return;
+            b = 0;
          }
       }
       j->code_buffer = (j->code_buffer << 8) | b;
@@ -976,7 +1155,191 @@ static void idct_block(uint8 *out, int out_stride, short data[64], unsigned shor
       o[4] = clamp((x3-t0) >> 17);
    }
 }
+
+#if STBI_SSE2
+#define dct_const(x,y)  _mm_setr_epi16((short) (x),(short) (y),(short) (x),(short) (y),(short) (x),(short) (y),(short) (x),(short) (y))
+
+// out0 = c0[even]*x + c0[odd]*y, out1 = c1[even]*x + c1[odd]*y   (16-bit in, 32-bit out)
+#define dct_rot(out0,out1, x,y,c0,c1) \
+   __m128i c0##lo = _mm_unpacklo_epi16((x),(y)); \
+   __m128i c0##hi = _mm_unpackhi_epi16((x),(y)); \
+   __m128i out0##_l = _mm_madd_epi16(c0##lo, c0); \
+   __m128i out0##_h = _mm_madd_epi16(c0##hi, c0); \
+   __m128i out1##_l = _mm_madd_epi16(c0##lo, c1); \
+   __m128i out1##_h = _mm_madd_epi16(c0##hi, c1)
+
+// out = in << 12   (16-bit in, 32-bit out)
+#define dct_widen(out, in) \
+   __m128i out##_l = _mm_srai_epi32(_mm_unpacklo_epi16(_mm_setzero_si128(), (in)), 4); \
+   __m128i out##_h = _mm_srai_epi32(_mm_unpackhi_epi16(_mm_setzero_si128(), (in)), 4)
+
+#define dct_wadd(out, a, b) \
+   __m128i out##_l = _mm_add_epi32(a##_l, b##_l); \
+   __m128i out##_h = _mm_add_epi32(a##_h, b##_h)
+
+#define dct_wsub(out, a, b) \
+   __m128i out##_l = _mm_sub_epi32(a##_l, b##_l); \
+   __m128i out##_h = _mm_sub_epi32(a##_h, b##_h)
+
+// butterfly a/b, add bias, shift down by s and pack to 16 bits
+#define dct_bfly32o(out0, out1, a,b,bias,s) \
+   { \
+      __m128i abiased_l = _mm_add_epi32(a##_l, bias); \
+      __m128i abiased_h = _mm_add_epi32(a##_h, bias); \
+      dct_wadd(sum, abiased, b); \
+      dct_wsub(dif, abiased, b); \
+      out0 = _mm_packs_epi32(_mm_srai_epi32(sum_l, s), _mm_srai_epi32(sum_h, s)); \
+      out1 = _mm_packs_epi32(_mm_srai_epi32(dif_l, s), _mm_srai_epi32(dif_h, s)); \
+   }
+
+#define dct_interleave8(a, b) \
+   tmp = a; \
+   a = _mm_unpacklo_epi8(a, b); \
+   b = _mm_unpackhi_epi8(tmp, b)
+
+#define dct_interleave16(a, b) \
+   tmp = a; \
+   a = _mm_unpacklo_epi16(a, b); \
+   b = _mm_unpackhi_epi16(tmp, b)
+
+// one IDCT_1D over eight columns (or rows) at once
+#define dct_pass(bias,shift) \
+   { \
+      /* even part */ \
+      dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+      __m128i sum04 = _mm_add_epi16(row0, row4); \
+      __m128i dif04 = _mm_sub_epi16(row0, row4); \
+      dct_widen(t0e, sum04); \
+      dct_widen(t1e, dif04); \
+      dct_wadd(x0, t0e, t3e); \
+      dct_wsub(x3, t0e, t3e); \
+      dct_wadd(x1, t1e, t2e); \
+      dct_wsub(x2, t1e, t2e); \
+      /* odd part */ \
+      dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+      dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+      __m128i sum17 = _mm_add_epi16(row1, row7); \
+      __m128i sum35 = _mm_add_epi16(row3, row5); \
+      dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+      dct_wadd(x4, y0o, y4o); \
+      dct_wadd(x5, y1o, y5o); \
+      dct_wadd(x6, y2o, y5o); \
+      dct_wadd(x7, y3o, y4o); \
+      dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+      dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+      dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+      dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+   }
+
+// largest column sum of |coefficient| for which idct_block_SSE2 can use 16-bit
+// lanes: the first pass then stays within +-16383, so the sums of pairs the
+// second pass forms still fit in 16 bits. Pass 1 weighs a coefficient by at
+// most 5683/4096, giving |out| <= (2880*5683 + 512) >> 10 = 15983
+#define IDCT_SSE2_MAX_COLUMN 2880
+
+// a 16-bit lane version of idct_block; all intermediates are exact, so the
+// output matches the scalar code bit for bit. Blocks whose coefficients are
+// too large for that (only seen in corrupt streams) use the scalar code
+static void idct_block_SSE2(uint8 *out, int out_stride, short data[64], unsigned short *dequantize)
+{
+   __m128i row0, row1, row2, row3, row4, row5, row6, row7, tmp;
+
+   // 16-bit constant pairs for _mm_madd_epi16: the even/odd rotations of IDCT_1D
+   __m128i rot0_0 = dct_const(f2f(0.5411961f), f2f(0.5411961f) + f2f(-1.847759065f));
+   __m128i rot0_1 = dct_const(f2f(0.5411961f) + f2f( 0.765366865f), f2f(0.5411961f));
+   __m128i rot1_0 = dct_const(f2f(1.175875602f) + f2f(-0.899976223f), f2f(1.175875602f));
+   __m128i rot1_1 = dct_const(f2f(1.175875602f), f2f(1.175875602f) + f2f(-2.562915447f));
+   __m128i rot2_0 = dct_const(f2f(-1.961570560f) + f2f( 0.298631336f), f2f(-1.961570560f));
+   __m128i rot2_1 = dct_const(f2f(-1.961570560f), f2f(-1.961570560f) + f2f( 3.072711026f));
+   __m128i rot3_0 = dct_const(f2f(-0.390180644f) + f2f( 2.053119869f), f2f(-0.390180644f));
+   __m128i rot3_1 = dct_const(f2f(-0.390180644f), f2f(-0.390180644f) + f2f( 1.501321110f));
+
+   // rounding of the two passes; the second also folds in clamp's +128
+   __m128i bias_0 = _mm_set1_epi32(512);
+   __m128i bias_1 = _mm_set1_epi32(65536 + (128 << 17));
+
+   // dequantize, checking every product fits in 16 bits and the column sums stay in range
+   {
+      __m128i overflow = _mm_setzero_si128();
+      __m128i column = _mm_setzero_si128();
+      #define dct_dequant(row, k) \
+         { \
+            __m128i d = _mm_loadu_si128((const __m128i *) (data + k*8)); \
+            __m128i q = _mm_loadu_si128((const __m128i *) (dequantize + k*8)); \
+            __m128i lo = _mm_mullo_epi16(d, q); \
+            overflow = _mm_or_si128(overflow, _mm_xor_si128(_mm_mulhi_epi16(d, q), _mm_srai_epi16(lo, 15))); \
+            column = _mm_adds_epu16(column, _mm_max_epi16(lo, _mm_sub_epi16(_mm_setzero_si128(), lo))); \
+            row = lo; \
+         }
+      dct_dequant(row0, 0);
+      dct_dequant(row1, 1);
+      dct_dequant(row2, 2);
+      dct_dequant(row3, 3);
+      dct_dequant(row4, 4);
+      dct_dequant(row5, 5);
+      dct_dequant(row6, 6);
+      dct_dequant(row7, 7);
+      #undef dct_dequant
+      overflow = _mm_or_si128(overflow, _mm_subs_epu16(column, _mm_set1_epi16(IDCT_SSE2_MAX_COLUMN)));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(overflow, _mm_setzero_si128())) != 0xffff) {
+         idct_block(out, out_stride, data, dequantize);
+         return;
+      }
+   }
+
+   // columns
+   dct_pass(bias_0, 10);
+
+   // 16-bit 8x8 transpose
+   dct_interleave16(row0, row4);
+   dct_interleave16(row1, row5);
+   dct_interleave16(row2, row6);
+   dct_interleave16(row3, row7);
+
+   dct_interleave16(row0, row2);
+   dct_interleave16(row1, row3);
+   dct_interleave16(row4, row6);
+   dct_interleave16(row5, row7);
+
+   dct_interleave16(row0, row1);
+   dct_interleave16(row2, row3);
+   dct_interleave16(row4, row5);
+   dct_interleave16(row6, row7);
+
+   // rows
+   dct_pass(bias_1, 17);
+
+   {
+      // pack to bytes with clamping, then 8-bit 8x8 transpose back to rows
+      __m128i p0 = _mm_packus_epi16(row0, row1);
+      __m128i p1 = _mm_packus_epi16(row2, row3);
+      __m128i p2 = _mm_packus_epi16(row4, row5);
+      __m128i p3 = _mm_packus_epi16(row6, row7);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      dct_interleave8(p0, p1);
+      dct_interleave8(p2, p3);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      _mm_storel_epi64((__m128i *) out, p0); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p0, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p2); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p2, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p1); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p1, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p3); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p3, 0x4e));
+   }
+}
+
+static stbi_idct_8x8 stbi_idct_installed = idct_block_SSE2;
+#else
 static stbi_idct_8x8 stbi_idct_installed = idct_block;
+#endif
 
 extern void stbi_install_idct(stbi_idct_8x8 func)
 {
@@ -1017,13 +1380,14 @@ static void reset(jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
-static int parse_entropy_coded_data(jpeg *z)
+// decode MCUs [first,last) of the current scan in raster order, counting down
+// the restart interval as we go; in non-interleaved scans every block is an MCU
+static int decode_mcus(jpeg *z, int first, int last)
 {
-   reset(z);
+   int m;
    if (z->scan_n == 1) {
-      int i,j;
       #if STBI_SIMD
-      __declspec(align(16))
+      STBI_ALIGN16
       #endif
       short data[64];
       int n = z->order[0];
@@ -1032,63 +1396,181 @@ static int parse_entropy_coded_data(jpeg *z)
       // number of blocks to do just depends on how many actual "pixels" this
       // component has, independent of interleaved MCU blocking and such
       int w = (z->img_comp[n].x+7) >> 3;
-      int h = (z->img_comp[n].y+7) >> 3;
-      for (j=0; j < h; ++j) {
-         for (i=0; i < w; ++i) {
-            if (!decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+z->img_comp[n].ha, n)) return 0;
-            #if STBI_SIMD
-            stbi_idct_installed(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
-            #else
-            idct_block(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
-            #endif
-            // every data block is an MCU, so countdown the restart interval
-            if (--z->todo <= 0) {
-               if (z->code_bits < 24) grow_buffer_unsafe(z);
-               // if it's NOT a restart, then just bail, so we get corrupt data
-               // rather than no data
-               if (!RESTART(z->marker)) return 1;
-               reset(z);
-            }
+      int i = first % w, j = first / w;
+      for (m=first; m < last; ++m) {
+         if (!decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+z->img_comp[n].ha, n)) return 0;
+         #if STBI_SIMD
+         stbi_idct_installed(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
+         #else
+         idct_block(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
+         #endif
+         if (++i == w) { i = 0; ++j; }
+         // every data block is an MCU, so countdown the restart interval
+         if (--z->todo <= 0) {
+            if (z->code_bits < 24) grow_buffer_unsafe(z);
+            // if it's NOT a restart, then just bail, so we get corrupt data
+            // rather than no data
+            if (!RESTART(z->marker)) return 1;
+            reset(z);
          }
       }
    } else { // interleaved!
-      int i,j,k,x,y;
+      int i = first % z->img_mcu_x, j = first / z->img_mcu_x, k, x, y;
+      #if STBI_SIMD
+      STBI_ALIGN16
+      #endif
       short data[64];
-      for (j=0; j < z->img_mcu_y; ++j) {
-         for (i=0; i < z->img_mcu_x; ++i) {
-            // scan an interleaved mcu... process scan_n components in order
-            for (k=0; k < z->scan_n; ++k) {
-               int n = z->order[k];
-               // scan out an mcu's worth of this component; that's just determined
-               // by the basic H and V specified for the component
-               for (y=0; y < z->img_comp[n].v; ++y) {
-                  for (x=0; x < z->img_comp[n].h; ++x) {
-                     int x2 = (i*z->img_comp[n].h + x)*8;
-                     int y2 = (j*z->img_comp[n].v + y)*8;
-                     if (!decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+z->img_comp[n].ha, n)) return 0;
-                     #if STBI_SIMD
-                     stbi_idct_installed(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
-                     #else
-                     idct_block(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
-                     #endif
-                  }
+      for (m=first; m < last; ++m) {
+         // scan an interleaved mcu... process scan_n components in order
+         for (k=0; k < z->scan_n; ++k) {
+            int n = z->order[k];
+            // scan out an mcu's worth of this component; that's just determined
+            // by the basic H and V specified for the component
+            for (y=0; y < z->img_comp[n].v; ++y) {
+               for (x=0; x < z->img_comp[n].h; ++x) {
+                  int x2 = (i*z->img_comp[n].h + x)*8;
+                  int y2 = (j*z->img_comp[n].v + y)*8;
+                  if (!decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+z->img_comp[n].ha, n)) return 0;
+                  #if STBI_SIMD
+                  stbi_idct_installed(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
+                  #else
+                  idct_block(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
+                  #endif
                }
             }
-            // after all interleaved components, that's an interleaved MCU,
-            // so now count down the restart interval
-            if (--z->todo <= 0) {
-               if (z->code_bits < 24) grow_buffer_unsafe(z);
-               // if it's NOT a restart, then just bail, so we get corrupt data
-               // rather than no data
-               if (!RESTART(z->marker)) return 1;
-               reset(z);
-            }
          }
+         if (++i == z->img_mcu_x) { i = 0; ++j; }
+         // after all interleaved components, that's an interleaved MCU,
+         // so now count down the restart interval
+         if (--z->todo <= 0) {
+            if (z->code_bits < 24) grow_buffer_unsafe(z);
+            // if it's NOT a restart, then just bail, so we get corrupt data
+            // rather than no data
+            if (!RESTART(z->marker)) return 1;
+            reset(z);
+         }
+      }
+   }
+   return 1;
+}
+
+static int scan_mcu_count(jpeg *z)
+{
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      return ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+   }
+   return z->img_mcu_x * z->img_mcu_y;
+}
+
+// each restart interval starts with a fresh entropy decoder and dc prediction,
+// so once the RSTn markers are located the intervals decode independently
+#define RESTART_MIN_MCUS   256   // fewest MCUs worth handing to another thread
+
+typedef struct
+{
+   jpeg *z;
+   uint8 **segment;   // first entropy-coded byte of each restart interval
+   int segments, mcus;
+   int failed;
+   // decoder state after the last interval, where the marker parser resumes
+   uint8 *img_buffer;
+   uint32 code_buffer;
+   int code_bits, nomore, todo;
+   unsigned char marker;
+} restart_job;
+
+static void decode_restart_band(void *context, int first, int last)
+{
+   restart_job *job = (restart_job *) context;
+   jpeg j = *job->z;
+   int k;
+   for (k=first; k < last; ++k) {
+      int end = (k+1) * j.restart_interval;
+      j.s.img_buffer = job->segment[k];
+      reset(&j);
+      if (!decode_mcus(&j, k * j.restart_interval, end < job->mcus ? end : job->mcus)) {
+         job->failed = 1;
+         return;
+      }
+   }
+   if (last == job->segments) {
+      job->img_buffer  = j.s.img_buffer;
+      job->code_buffer = j.code_buffer;
+      job->code_bits   = j.code_bits;
+      job->nomore      = j.nomore;
+      job->todo        = j.todo;
+      job->marker      = j.marker;
+   }
+}
+
+// decodes the scan on several threads when it is in memory and split into
+// restart intervals; returns -1 when the scan should be decoded serially
+static int decode_restart_intervals(jpeg *z)
+{
+   restart_job job;
+   uint8 *p, *end;
+   int count;
+
+   if (!z->restart_interval || stbi_thread_count == 1) return -1;
+   #ifndef STBI_NO_STDIO
+   if (z->s.img_file) return -1;
+   #endif
+
+   job.mcus = scan_mcu_count(z);
+   job.segments = (job.mcus + z->restart_interval - 1) / z->restart_interval;
+   if (job.mcus < 2*RESTART_MIN_MCUS || job.segments < 2) return -1;
+   job.segment = (uint8 **) malloc(job.segments * sizeof(uint8 *));
+   if (!job.segment) return -1;
+
+   // find the RSTn markers; the first other marker ends the scan
+   p = z->s.img_buffer;
+   end = z->s.img_buffer_end;
+   job.segment[0] = p;
+   count = 1;
+   while (p + 1 < end) {
+      p = (uint8 *) memchr(p, 0xff, end - 1 - p);
+      if (!p) break;
+      if (p[1] == 0) {
+         p += 2;   // stuffed 0xff data byte
+      } else if (RESTART(p[1]) && count < job.segments) {
+         p += 2;
+         job.segment[count++] = p;
+      } else {
+         break;
       }
    }
+   if (count != job.segments) {
+      // damaged or truncated; the serial decoder copes with that
+      free(job.segment);
+      return -1;
+   }
+
+   job.z = z;
+   job.failed = 0;
+   SOIL_run_row_bands(decode_restart_band, &job, job.segments, stbi_thread_count,
+                      (RESTART_MIN_MCUS + z->restart_interval - 1) / z->restart_interval);
+   free(job.segment);
+   if (job.failed) return 0;
+
+   z->s.img_buffer = job.img_buffer;
+   z->code_buffer  = job.code_buffer;
+   z->code_bits    = job.code_bits;
+   z->nomore       = job.nomore;
+   z->todo         = job.todo;
+   z->marker       = job.marker;
    return 1;
 }
 
+static int parse_entropy_coded_data(jpeg *z)
+{
+   int r;
+   reset(z);
+   r = decode_restart_intervals(z);
+   if (r >= 0) return r;
+   return decode_mcus(z, 0, scan_mcu_count(z));
+}
+
 static int process_marker(jpeg *z, int m)
 {
    int L;
@@ -1116,7 +1598,7 @@ static int process_marker(jpeg *z, int m)
                z->dequant[t][dezigzag[i]] = get8u(&z->s);
             #if STBI_SIMD
             for (i=0; i < 64; ++i)
-               z->dequant2[t][i] = dequant[t][i];
+               z->dequant2[t][i] = z->dequant[t][i];
             #endif
             L -= 65;
          }
@@ -1288,6 +1770,7 @@ static int decode_jpeg_image(jpeg *j)
    int m;
    j->restart_interval = 0;
    if (!decode_jpeg_header(j, SCAN_load)) return 0;
+   if (j->s.target && !target_fits(j->s.target, j->s.img_x, j->s.img_y)) return 0;
    m = get_marker(j);
    while (!EOI(m)) {
       if (SOS(m)) {
@@ -1335,7 +1818,22 @@ static uint8*  resample_row_h_2(uint8 *out, uint8 *in_near, uint8 *in_far, int w
 
    out[0] = input[0];
    out[1] = div4(input[0]*3 + input[1] + 2);
-   for (i=1; i < w-1; ++i) {
+   i = 1;
+   #if STBI_SSE2
+   {
+      __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+      for (; i+9 <= w; i += 8) {
+         __m128i prev = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (input + i-1)), zero);
+         __m128i cur  = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (input + i  )), zero);
+         __m128i next = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (input + i+1)), zero);
+         __m128i n = _mm_add_epi16(_mm_add_epi16(cur, _mm_add_epi16(cur, cur)), two);
+         __m128i even = _mm_srli_epi16(_mm_add_epi16(n, prev), 2);
+         __m128i odd  = _mm_srli_epi16(_mm_add_epi16(n, next), 2);
+         _mm_storeu_si128((__m128i *) (out + i*2), _mm_packus_epi16(_mm_unpacklo_epi16(even, odd), _mm_unpackhi_epi16(even, odd)));
+      }
+   }
+   #endif
+   for (; i < w-1; ++i) {
       int n = 3*input[i]+2;
       out[i*2+0] = div4(n+input[i-1]);
       out[i*2+1] = div4(n+input[i+1]);
@@ -1358,7 +1856,26 @@ static uint8 *resample_row_hv_2(uint8 *out, uint8 *in_near, uint8 *in_far, int w
 
    t1 = 3*in_near[0] + in_far[0];
    out[0] = div4(t1+2);
-   for (i=1; i < w; ++i) {
+   i = 1;
+   #if STBI_SSE2
+   {
+      __m128i zero = _mm_setzero_si128(), eight = _mm_set1_epi16(8);
+      for (; i+8 <= w; i += 8) {
+         // t for samples i-1..i+6 and i..i+7
+         __m128i near0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (in_near + i-1)), zero);
+         __m128i far0  = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (in_far  + i-1)), zero);
+         __m128i near1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (in_near + i  )), zero);
+         __m128i far1  = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (in_far  + i  )), zero);
+         __m128i prev = _mm_add_epi16(_mm_add_epi16(near0, _mm_add_epi16(near0, near0)), far0);
+         __m128i cur  = _mm_add_epi16(_mm_add_epi16(near1, _mm_add_epi16(near1, near1)), far1);
+         __m128i odd  = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(prev, _mm_add_epi16(prev, prev)), _mm_add_epi16(cur, eight)), 4);
+         __m128i even = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(cur, _mm_add_epi16(cur, cur)), _mm_add_epi16(prev, eight)), 4);
+         _mm_storeu_si128((__m128i *) (out + i*2-1), _mm_packus_epi16(_mm_unpacklo_epi16(odd, even), _mm_unpackhi_epi16(odd, even)));
+      }
+      t1 = 3*in_near[i-1] + in_far[i-1];
+   }
+   #endif
+   for (; i < w; ++i) {
       t0 = t1;
       t1 = 3*in_near[i]+in_far[i];
       out[i*2-1] = div16(3*t0 + t1 + 8);
@@ -1407,8 +1924,78 @@ static void YCbCr_to_RGB_row(uint8 *out, uint8 *y, uint8 *pcb, uint8 *pcr, int c
    }
 }
 
+#if STBI_SSE2
+// 8 pixels per step in 16-bit lanes. Each 16.16 constant is split into a whole
+// number, applied with a 16-bit multiply, and a remainder in -32768..32767
+// that _mm_madd_epi16 takes; the shift by 16 is exact across that split, so
+// the result matches YCbCr_to_RGB_row
+static void YCbCr_to_RGB_row_SSE2(uint8 *out, uint8 const *y, uint8 const *pcb, uint8 const *pcr, int count, int step)
+{
+   int cr_r =  float2fixed(1.40200f), cr_g = -float2fixed(0.71414f);
+   int cb_g = -float2fixed(0.34414f), cb_b =  float2fixed(1.77200f);
+   int k_cr_r = (cr_r + 32768) >> 16, k_cr_g = (cr_g + 32768) >> 16;
+   int k_cb_g = (cb_g + 32768) >> 16, k_cb_b = (cb_b + 32768) >> 16;
+   __m128i mul_r = dct_const(cr_r - k_cr_r*65536, 0);
+   __m128i mul_g = dct_const(cr_g - k_cr_g*65536, cb_g - k_cb_g*65536);
+   __m128i mul_b = dct_const(0, cb_b - k_cb_b*65536);
+   __m128i whole_cr_r = _mm_set1_epi16((short) k_cr_r), whole_cr_g = _mm_set1_epi16((short) k_cr_g);
+   __m128i whole_cb_g = _mm_set1_epi16((short) k_cb_g), whole_cb_b = _mm_set1_epi16((short) k_cb_b);
+   __m128i rounding = _mm_set1_epi32(32768);
+   __m128i bias = _mm_set1_epi16(128);
+   __m128i zero = _mm_setzero_si128();
+   __m128i alpha = _mm_set1_epi8(-1);
+   int i = 0;
+
+   if (step != 3 && step != 4) {
+      YCbCr_to_RGB_row(out, (uint8 *) y, (uint8 *) pcb, (uint8 *) pcr, count, step);
+      return;
+   }
+
+   for (; i+8 <= count; i += 8) {
+      __m128i y16  = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (y + i)), zero);
+      __m128i cb16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (pcb + i)), zero), bias);
+      __m128i cr16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (pcr + i)), zero), bias);
+      __m128i crcb_l = _mm_unpacklo_epi16(cr16, cb16);
+      __m128i crcb_h = _mm_unpackhi_epi16(cr16, cb16);
+      #define ycc_frac(mul) \
+         _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(crcb_l, mul), rounding), 16), \
+                         _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(crcb_h, mul), rounding), 16))
+      __m128i r16 = _mm_add_epi16(_mm_add_epi16(y16, _mm_mullo_epi16(cr16, whole_cr_r)), ycc_frac(mul_r));
+      __m128i g16 = _mm_add_epi16(_mm_add_epi16(y16, _mm_add_epi16(_mm_mullo_epi16(cr16, whole_cr_g),
+                                                                   _mm_mullo_epi16(cb16, whole_cb_g))), ycc_frac(mul_g));
+      __m128i b16 = _mm_add_epi16(_mm_add_epi16(y16, _mm_mullo_epi16(cb16, whole_cb_b)), ycc_frac(mul_b));
+      #undef ycc_frac
+      __m128i r8 = _mm_packus_epi16(r16, r16);
+      __m128i g8 = _mm_packus_epi16(g16, g16);
+      __m128i b8 = _mm_packus_epi16(b16, b16);
+      if (step == 4) {
+         __m128i rg = _mm_unpacklo_epi8(r8, g8);
+         __m128i ba = _mm_unpacklo_epi8(b8, alpha);
+         _mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi16(rg, ba));
+         _mm_storeu_si128((__m128i *) (out + 16), _mm_unpackhi_epi16(rg, ba));
+         out += 32;
+      } else {
+         uint8 rgb[3][8];
+         int k;
+         _mm_storel_epi64((__m128i *) rgb[0], r8);
+         _mm_storel_epi64((__m128i *) rgb[1], g8);
+         _mm_storel_epi64((__m128i *) rgb[2], b8);
+         for (k=0; k < 8; ++k, out += 3) {
+            out[0] = rgb[0][k];
+            out[1] = rgb[1][k];
+            out[2] = rgb[2][k];
+         }
+      }
+   }
+   YCbCr_to_RGB_row(out, (uint8 *) y + i, (uint8 *) pcb + i, (uint8 *) pcr + i, count - i, step);
+}
+
+static stbi_YCbCr_to_RGB_run stbi_YCbCr_installed = YCbCr_to_RGB_row_SSE2;
+#elif STBI_SIMD
+static stbi_YCbCr_to_RGB_run stbi_YCbCr_installed = (stbi_YCbCr_to_RGB_run) YCbCr_to_RGB_row;
+#endif
+
 #if STBI_SIMD
-static stbi_YCbCr_to_RGB_run stbi_YCbCr_installed = YCbCr_to_RGB_row;
 
 void stbi_install_YCbCr_to_RGB(stbi_YCbCr_to_RGB_run func)
 {
@@ -1463,9 +2050,9 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
 
    // resample and color-convert
    {
-      int k;
+      int k, pitch;
       uint i,j;
-      uint8 *output;
+      uint8 *output, *scratch = NULL;
       uint8 *coutput[4];
 
       stbi_resample res_comp[4];
@@ -1492,13 +2079,30 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
          else                               r->resample = resample_row_generic;
       }
 
-      // can't error after this so, this is safe
-      output = (uint8 *) malloc(n * z->s.img_x * z->s.img_y + 1);
-      if (!output) { cleanup_jpeg(z); return epuc("outofmem", "Out of memory"); }
+      if (z->s.target) {
+         output = z->s.target->dest;
+         pitch = z->s.target->pitch;
+         // 3 component rows get a 4th byte stored past their end, which is
+         // only harmless where the next row follows directly and is written
+         // later; other rows go through a scratch row
+         if (n == 3) {
+            scratch = (uint8 *) malloc(n * z->s.img_x + 1);
+            if (!scratch) { cleanup_jpeg(z); return epuc("outofmem", "Out of memory"); }
+         }
+      } else {
+         // can't error after this so, this is safe
+         output = (uint8 *) malloc(n * z->s.img_x * z->s.img_y + 1);
+         if (!output) { cleanup_jpeg(z); return epuc("outofmem", "Out of memory"); }
+         pitch = n * z->s.img_x;
+      }
 
       // now go ahead and resample
       for (j=0; j < z->s.img_y; ++j) {
-         uint8 *out = output + n * z->s.img_x * j;
+         uint8 *row = output + pitch * (int) j;
+         uint8 *line = row, *out;
+         if (scratch && (pitch != n * (int) z->s.img_x || j+1 == z->s.img_y))
+            line = scratch;
+         out = line;
          for (k=0; k < decode_n; ++k) {
             stbi_resample *r = &res_comp[k];
             int y_bot = r->ystep >= (r->vs >> 1);
@@ -1534,7 +2138,10 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
             else
                for (i=0; i < z->s.img_x; ++i) *out++ = y[i], *out++ = 255;
          }
+         if (line != row)
+            memcpy(row, line, n * z->s.img_x);
       }
+      free(scratch);
       cleanup_jpeg(z);
       *out_x = z->s.img_x;
       *out_y = z->s.img_y;
@@ -1544,13 +2151,41 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
 }
 
 #ifndef STBI_NO_STDIO
-unsigned char *stbi_jpeg_load_from_file(FILE *f, int *x, int *y, int *comp, int req_comp)
+static uint8 *jpeg_load_file(FILE *f, int *x, int *y, int *comp, int req_comp, stbi_target *t)
 {
    jpeg j;
+   // decode from memory when the rest of the file can be read in one go: that
+   // avoids a stdio call per byte and lets restart intervals decode in parallel
+   long start = ftell(f);
+   if (start >= 0 && fseek(f, 0, SEEK_END) == 0) {
+      long len = ftell(f) - start;
+      uint8 *buffer = len > 0 && len < (1 << 30) ? (uint8 *) malloc(len) : NULL;
+      fseek(f, start, SEEK_SET);
+      if (buffer) {
+         if (fread(buffer, 1, len, f) == (size_t) len) {
+            unsigned char *result;
+            start_mem(&j.s, buffer, (int) len);
+            j.s.target = t;
+            result = load_jpeg_image(&j, x,y,comp,req_comp);
+            // leave the file pointing just past the image, as the stdio path does
+            fseek(f, start + (long) (j.s.img_buffer - buffer), SEEK_SET);
+            free(buffer);
+            return result;
+         }
+         free(buffer);
+         fseek(f, start, SEEK_SET);
+      }
+   }
    start_file(&j.s, f);
+   j.s.target = t;
    return load_jpeg_image(&j, x,y,comp,req_comp);
 }
 
+unsigned char *stbi_jpeg_load_from_file(FILE *f, int *x, int *y, int *comp, int req_comp)
+{
+   return jpeg_load_file(f,x,y,comp,req_comp,NULL);
+}
+
 unsigned char *stbi_jpeg_load(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
    unsigned char *data;
@@ -1589,29 +2224,71 @@ int stbi_jpeg_test_memory(stbi_uc const *buffer, int len)
    return decode_jpeg_header(&j, SCAN_type);
 }
 
-// @TODO:
+// the frame header has everything; no tables or buffers are set up
+static int jpeg_info(jpeg *j, int *x, int *y, int *comp)
+{
+   if (!decode_jpeg_header(j, SCAN_header)) return 0;
+   if (x) *x = j->s.img_x;
+   if (y) *y = j->s.img_y;
+   if (comp) *comp = j->s.img_n;
+   return 1;
+}
+
 #ifndef STBI_NO_STDIO
-extern int      stbi_jpeg_info            (char const *filename,           int *x, int *y, int *comp);
-extern int      stbi_jpeg_info_from_file  (FILE *f,                  int *x, int *y, int *comp);
+int stbi_jpeg_info(char const *filename, int *x, int *y, int *comp)
+{
+   FILE *f = fopen(filename, "rb");
+   int result;
+   if (!f) return e("can't fopen", "Unable to open file");
+   result = stbi_jpeg_info_from_file(f,x,y,comp);
+   fclose(f);
+   return result;
+}
+
+int stbi_jpeg_info_from_file(FILE *f, int *x, int *y, int *comp)
+{
+   int n,r;
+   jpeg j;
+   n = ftell(f);
+   start_file(&j.s, f);
+   r = jpeg_info(&j, x,y,comp);
+   fseek(f,n,SEEK_SET);
+   return r;
+}
 #endif
-extern int      stbi_jpeg_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp);
+
+int stbi_jpeg_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp)
+{
+   jpeg j;
+   start_mem(&j.s, buffer,len);
+   return jpeg_info(&j, x,y,comp);
+}
 
 // public domain zlib decode    v0.2  Sean Barrett 2006-11-18
 //    simple implementation
 //      - all input must be provided in an upfront buffer
 //      - all output is written to a single output buffer (can malloc/realloc)
 //    performance
-//      - fast huffman
+//      - fast huffman, resolving two literals per lookup where they fit
+//      - 64-bit bit buffer, refilled a word at a time
 
 // fast-way is faster to check than jpeg huffman, but slow way is slower
-#define ZFAST_BITS  9 // accelerate all cases in default tables
+#define ZFAST_BITS  11 // accelerate all cases in default tables, and literal pairs
 #define ZFAST_MASK  ((1 << ZFAST_BITS) - 1)
 
+// fast table entries, 0 where the code is longer than ZFAST_BITS:
+//    bits  0-3   length of the first code
+//    bits  4-7   length of both codes when a second literal follows, else 0
+//    bits  8-15  the second literal
+//    bits 16-24  the first symbol
+#define ZFAST_SIZE(f)       ((f) & 15)
+#define ZFAST_PAIR_SIZE(f)  (((f) >> 4) & 15)
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
 {
-   uint16 fast[1 << ZFAST_BITS];
+   uint32 fast[1 << ZFAST_BITS];
    uint16 firstcode[16];
    int maxcode[17];
    uint16 firstsymbol[16];
@@ -1643,7 +2320,7 @@ static int zbuild_huffman(zhuffman *z, uint8 *sizelist, int num)
 
    // DEFLATE spec for generating codes
    memset(sizes, 0, sizeof(sizes));
-   memset(z->fast, 255, sizeof(z->fast));
+   memset(z->fast, 0, sizeof(z->fast));
    for (i=0; i < num; ++i)
       ++sizes[sizelist[i]];
    sizes[0] = 0;
@@ -1670,14 +2347,28 @@ static int zbuild_huffman(zhuffman *z, uint8 *sizelist, int num)
          z->value[c] = (uint16)i;
          if (s <= ZFAST_BITS) {
             int k = bit_reverse(next_code[s],s);
+            uint32 f = ((uint32) i << 16) | s;
             while (k < (1 << ZFAST_BITS)) {
-               z->fast[k] = (uint16) c;
+               z->fast[k] = f;
                k += (1 << s);
             }
          }
          ++next_code[s];
       }
    }
+   if (num > 256) {
+      // literal/length table: where a literal's code leaves room for a whole
+      // second literal code, resolve both at once. walking down, the entry
+      // for the bits after the first code (a lower index) is still single
+      for (k=(1 << ZFAST_BITS)-1; k >= 0; --k) {
+         uint32 f = z->fast[k], g;
+         int s = ZFAST_SIZE(f);
+         if (!f || (f >> 16) >= 256) continue;
+         g = z->fast[k >> s];
+         if (g && (g >> 16) < 256 && s + ZFAST_SIZE(g) <= ZFAST_BITS)
+            z->fast[k] = f | ((g >> 16) << 8) | ((s + ZFAST_SIZE(g)) << 4);
+      }
+   }
    return 1;
 }
 
@@ -1691,7 +2382,7 @@ typedef struct
 {
    uint8 *zbuffer, *zbuffer_end;
    int num_bits;
-   uint32 code_buffer;
+   uint64 code_buffer;   // bits above num_bits may already hold the next input
 
    char *zout;
    char *zout_start;
@@ -1709,18 +2400,29 @@ __forceinline static int zget8(zbuf *z)
 
 static void fill_bits(zbuf *z)
 {
+   #if STBI_LITTLE_ENDIAN
+   if (z->zbuffer_end - z->zbuffer >= 8) {
+      // top up to 56-63 bits with one unaligned load; the bytes only partly
+      // taken are reloaded next time into the same bit positions
+      uint64 v;
+      memcpy(&v, z->zbuffer, 8);
+      z->code_buffer |= v << z->num_bits;
+      z->zbuffer += (63 - z->num_bits) >> 3;
+      z->num_bits |= 56;
+      return;
+   }
+   #endif
    do {
-      assert(z->code_buffer < (1U << z->num_bits));
-      z->code_buffer |= zget8(z) << z->num_bits;
+      z->code_buffer |= (uint64) zget8(z) << z->num_bits;
       z->num_bits += 8;
-   } while (z->num_bits <= 24);
+   } while (z->num_bits <= 56);
 }
 
 __forceinline static unsigned int zreceive(zbuf *z, int n)
 {
    unsigned int k;
    if (z->num_bits < n) fill_bits(z);
-   k = z->code_buffer & ((1 << n) - 1);
+   k = (unsigned int) (z->code_buffer & ((1 << n) - 1));
    z->code_buffer >>= n;
    z->num_bits -= n;
    return k;
@@ -1729,18 +2431,19 @@ __forceinline static unsigned int zreceive(zbuf *z, int n)
 __forceinline static int zhuffman_decode(zbuf *a, zhuffman *z)
 {
    int b,s,k;
+   uint32 f;
    if (a->num_bits < 16) fill_bits(a);
-   b = z->fast[a->code_buffer & ZFAST_MASK];
-   if (b < 0xffff) {
-      s = z->size[b];
+   f = z->fast[a->code_buffer & ZFAST_MASK];
+   if (f) {
+      s = ZFAST_SIZE(f);
       a->code_buffer >>= s;
       a->num_bits -= s;
-      return z->value[b];
+      return (int) (f >> 16);
    }
 
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = bit_reverse(a->code_buffer, 16);
+   k = bit_reverse((int) (a->code_buffer & 0xffff), 16);
    for (s=ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
@@ -1786,16 +2489,43 @@ static int dist_extra[32] =
 
 static int parse_huffman_block(zbuf *a)
 {
+   char *zout = a->zout; // kept in a local, written back around expand()
    for(;;) {
-      int z = zhuffman_decode(a, &a->z_length);
+      int z;
+      uint32 f;
+      if (a->num_bits < 16) fill_bits(a);
+      f = a->z_length.fast[a->code_buffer & ZFAST_MASK];
+      if (ZFAST_PAIR_SIZE(f)) {
+         // two literals from one lookup
+         int s = ZFAST_PAIR_SIZE(f);
+         if (zout + 2 > a->zout_end) {
+            a->zout = zout;
+            if (!expand(a, 2)) return 0;
+            zout = a->zout;
+         }
+         zout[0] = (char) (f >> 16);
+         zout[1] = (char) (f >> 8);
+         zout += 2;
+         a->code_buffer >>= s;
+         a->num_bits -= s;
+         continue;
+      }
+      z = zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return e("bad huffman code","Corrupt PNG"); // error in huffman codes
-         if (a->zout >= a->zout_end) if (!expand(a, 1)) return 0;
-         *a->zout++ = (char) z;
+         if (zout >= a->zout_end) {
+            a->zout = zout;
+            if (!expand(a, 1)) return 0;
+            zout = a->zout;
+         }
+         *zout++ = (char) z;
       } else {
-         uint8 *p;
+         char *p;
          int len,dist;
-         if (z == 256) return 1;
+         if (z == 256) {
+            a->zout = zout;
+            return 1;
+         }
          z -= 257;
          len = length_base[z];
          if (length_extra[z]) len += zreceive(a, length_extra[z]);
@@ -1803,11 +2533,31 @@ static int parse_huffman_block(zbuf *a)
          if (z < 0) return e("bad huffman code","Corrupt PNG");
          dist = dist_base[z];
          if (dist_extra[z]) dist += zreceive(a, dist_extra[z]);
-         if (a->zout - a->zout_start < dist) return e("bad dist","Corrupt PNG");
-         if (a->zout + len > a->zout_end) if (!expand(a, len)) return 0;
-         p = (uint8 *) (a->zout - dist);
-         while (len--)
-            *a->zout++ = *p++;
+         if (zout - a->zout_start < dist) return e("bad dist","Corrupt PNG");
+         if (zout + len > a->zout_end) {
+            a->zout = zout;
+            if (!expand(a, len)) return 0;
+            zout = a->zout;
+         }
+         p = zout - dist;
+         if (dist == 1) {
+            // run of one byte
+            memset(zout, *p, len);
+            zout += len;
+         } else if (dist >= 8 && a->zout_end - zout >= len + 7) {
+            // the source stays 8 behind the destination, so move 8 at a time;
+            // the last move may spill up to 7 bytes, which later output overwrites
+            char *end = zout + len;
+            do {
+               memcpy(zout, p, 8);
+               zout += 8;
+               p += 8;
+            } while (zout < end);
+            zout = end;
+         } else {
+            while (len--)
+               *zout++ = *p++;
+         }
       }
    }
 }
@@ -1815,7 +2565,7 @@ static int parse_huffman_block(zbuf *a)
 static int compute_huffman_codes(zbuf *a)
 {
    static uint8 length_dezigzag[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
-   static zhuffman z_codelength; // static just to save stack space
+   zhuffman z_codelength; // on the stack, so concurrent decodes don't share it
    uint8 lencodes[286+32+137];//padding for maximum single op
    uint8 codelength_sizes[19];
    int i,n;
@@ -1864,23 +2614,32 @@ static int parse_uncompressed_block(zbuf *a)
    int len,nlen,k;
    if (a->num_bits & 7)
       zreceive(a, a->num_bits & 7); // discard
+   // drop the read-ahead above num_bits: the stored bytes are copied straight
+   // from zbuffer, which the bit buffer then no longer mirrors
+   a->code_buffer &= ((uint64) 1 << a->num_bits) - 1;
    // drain the bit-packed data into header
    k = 0;
-   while (a->num_bits > 0) {
+   while (a->num_bits > 0 && k < 4) {
       header[k++] = (uint8) (a->code_buffer & 255); // wtf this warns?
       a->code_buffer >>= 8;
       a->num_bits -= 8;
    }
-   assert(a->num_bits == 0);
    // now fill header the normal way
    while (k < 4)
       header[k++] = (uint8) zget8(a);
    len  = header[1] * 256 + header[0];
    nlen = header[3] * 256 + header[2];
    if (nlen != (len ^ 0xffff)) return e("zlib corrupt","Corrupt PNG");
-   if (a->zbuffer + len > a->zbuffer_end) return e("read past buffer","Corrupt PNG");
    if (a->zout + len > a->zout_end)
       if (!expand(a, len)) return 0;
+   // the 64-bit buffer can still hold the first few bytes of the block
+   while (a->num_bits > 0 && len > 0) {
+      *a->zout++ = (char) (a->code_buffer & 255);
+      a->code_buffer >>= 8;
+      a->num_bits -= 8;
+      --len;
+   }
+   if (a->zbuffer + len > a->zbuffer_end) return e("read past buffer","Corrupt PNG");
    memcpy(a->zout, a->zbuffer, len);
    a->zbuffer += len;
    a->zout += len;
@@ -1900,18 +2659,27 @@ static int parse_zlib_header(zbuf *a)
    return 1;
 }
 
-// @TODO: should statically initialize these for optimal thread safety
-static uint8 default_length[288], default_distance[32];
-static void init_defaults(void)
+// statically initialized so that concurrent decodes on several threads never race on them
+static uint8 default_length[288] =
+{
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,7,7,7,7,7,7,7,7,
+   7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,8,8,8,8,8,8,8,8
+};
+static uint8 default_distance[32] =
 {
-   int i;   // use <= to match clearly with spec
-   for (i=0; i <= 143; ++i)     default_length[i]   = 8;
-   for (   ; i <= 255; ++i)     default_length[i]   = 9;
-   for (   ; i <= 279; ++i)     default_length[i]   = 7;
-   for (   ; i <= 287; ++i)     default_length[i]   = 8;
-
-   for (i=0; i <=  31; ++i)     default_distance[i] = 5;
-}
+   5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,
+   5,5,5,5,5,5,5,5
+};
 
 static int parse_zlib(zbuf *a, int parse_header)
 {
@@ -1930,7 +2698,6 @@ static int parse_zlib(zbuf *a, int parse_header)
       } else {
          if (type == 1) {
             // use fixed code lengths
-            if (!default_distance[31]) init_defaults();
             if (!zbuild_huffman(&a->z_length  , default_length  , 288)) return 0;
             if (!zbuild_huffman(&a->z_distance, default_distance,  32)) return 0;
          } else {
@@ -2051,6 +2818,7 @@ typedef struct
 {
    stbi s;
    uint8 *idata, *expanded, *out;
+   int pitch; // bytes between rows of out, which may be the caller's target
 } png;
 
 
@@ -2075,20 +2843,138 @@ static int paeth(int a, int b, int c)
    return c;
 }
 
-// create the png data from post-deflated data
-static int create_png_image(png *a, uint8 *raw, uint32 raw_len, int out_n)
+#if STBI_SSE2
+// loads an n byte pixel (n = 3 or 4) into the low bytes of a register
+__forceinline static __m128i png_load_pixel(uint8 const *p, int n)
 {
-   stbi *s = &a->s;
-   uint32 i,j,stride = s->img_x*out_n;
-   int k;
-   int img_n = s->img_n; // copy it into a local for later
+   int v = 0;
+   if (n == 4) memcpy(&v, p, 4); else memcpy(&v, p, 3);
+   return _mm_cvtsi32_si128(v);
+}
+
+__forceinline static void png_store_pixel(uint8 *p, __m128i v, int n)
+{
+   int w = _mm_cvtsi128_si32(v);
+   if (n == 4) memcpy(p, &w, 4); else memcpy(p, &w, 3);
+}
+
+// unfilters pixels 1 to count of a 3 or 4 channel row. Sub, Avg and Paeth
+// depend on the pixel to the left, so they run one pixel per register with
+// all channels in parallel; Up has no such dependency and runs 16 bytes at
+// a time when the row isn't being widened. out_n == 4 with img_n == 3 fills
+// in opaque alpha. Exactly matches the scalar filters.
+// Pixels move 4 bytes at a time but for the last of the row, so with 3 byte
+// pixels the extra byte read is ignored and the one written is the next pixel's;
+// rows may be a caller's, with nothing readable or writable past their end
+static void unfilter_row_SSE2(uint8 *cur, uint8 const *prior, uint8 const *raw, uint32 count, int img_n, int out_n, int filter)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i alpha = _mm_slli_epi32(_mm_cvtsi32_si128(img_n != out_n ? 255 : 0), 24);
+   __m128i a = png_load_pixel(cur - out_n, out_n); // the pixel to the left
+   __m128i b, c, x;
+   uint32 i = 0, n;
+
+   #define PIXEL_LOOP(step_prior) \
+      for (; i < count; ++i, raw += img_n, cur += out_n, prior += (step_prior)) { \
+         int rn = i+1 < count ? 4 : img_n, wn = i+1 < count ? 4 : out_n;
+   #define PIXEL_END(v) \
+         png_store_pixel(cur, _mm_or_si128(v, alpha), wn); \
+      }
+
+   switch (filter) {
+      case F_up:
+         if (img_n == out_n) {
+            n = count * img_n;
+            for (; i+16 <= n; i += 16) {
+               x = _mm_loadu_si128((__m128i const *) (raw + i));
+               b = _mm_loadu_si128((__m128i const *) (prior + i));
+               _mm_storeu_si128((__m128i *) (cur + i), _mm_add_epi8(x, b));
+            }
+            for (; i < n; ++i)
+               cur[i] = raw[i] + prior[i];
+            break;
+         }
+         PIXEL_LOOP(out_n)
+            x = _mm_add_epi8(png_load_pixel(raw, rn), png_load_pixel(prior, wn));
+         PIXEL_END(x)
+         break;
+
+      case F_sub:
+      case F_paeth_first: // paeth(a,0,0) is always a
+         PIXEL_LOOP(0)
+            a = _mm_add_epi8(png_load_pixel(raw, rn), a);
+         PIXEL_END(a)
+         break;
+
+      case F_avg:
+         // floor((a+b)/2): the rounding-up pavgb, less the bit it rounded up
+         c = _mm_set1_epi8(1);
+         PIXEL_LOOP(out_n)
+            b = png_load_pixel(prior, wn);
+            x = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), c));
+            a = _mm_add_epi8(png_load_pixel(raw, rn), x);
+         PIXEL_END(a)
+         break;
+
+      case F_avg_first:
+         c = _mm_set1_epi8(0x7f);
+         PIXEL_LOOP(0)
+            x = _mm_and_si128(_mm_srli_epi16(a, 1), c);
+            a = _mm_add_epi8(png_load_pixel(raw, rn), x);
+         PIXEL_END(a)
+         break;
+
+      case F_paeth:
+         // 16-bit lanes; with p = a+b-c, |p-a| = |b-c|, |p-b| = |a-c|, |p-c| = |b-c + a-c|
+         a = _mm_unpacklo_epi8(a, zero);
+         c = _mm_unpacklo_epi8(png_load_pixel(prior - out_n, 4), zero);
+         PIXEL_LOOP(out_n)
+            __m128i pa, pb, pc, smallest, nearest, t;
+            b = _mm_unpacklo_epi8(png_load_pixel(prior, wn), zero);
+            pa = _mm_sub_epi16(b, c);
+            pb = _mm_sub_epi16(a, c);
+            pc = _mm_add_epi16(pa, pb);
+            pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+            pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+            pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+            smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+            // ties go to a, then b, then c
+            t = _mm_cmpeq_epi16(smallest, pb);
+            nearest = _mm_or_si128(_mm_and_si128(t, b), _mm_andnot_si128(t, c));
+            t = _mm_cmpeq_epi16(smallest, pa);
+            nearest = _mm_or_si128(_mm_and_si128(t, a), _mm_andnot_si128(t, nearest));
+            x = _mm_add_epi8(png_load_pixel(raw, rn), _mm_packus_epi16(nearest, nearest));
+            a = _mm_unpacklo_epi8(x, zero);
+            c = b;
+         PIXEL_END(x)
+         break;
+   }
+   #undef PIXEL_LOOP
+   #undef PIXEL_END
+}
+#endif
+
+// create the png data from post-deflated data, into dest rows pitch bytes
+// apart when given, else into a new image
+static int create_png_image(png *a, uint8 *raw, uint32 raw_len, int out_n, uint8 *dest, int pitch)
+{
+   stbi *s = &a->s;
+   uint32 i,j;
+   int k;
+   int img_n = s->img_n; // copy it into a local for later
    assert(out_n == s->img_n || out_n == s->img_n+1);
-   a->out = (uint8 *) malloc(s->img_x * s->img_y * out_n);
-   if (!a->out) return e("outofmem", "Out of memory");
+   if (dest) {
+      a->out = dest;
+      a->pitch = pitch;
+   } else {
+      a->out = (uint8 *) malloc(s->img_x * s->img_y * out_n);
+      if (!a->out) return e("outofmem", "Out of memory");
+      a->pitch = s->img_x * out_n;
+   }
    if (raw_len != (img_n * s->img_x + 1) * s->img_y) return e("not enough pixels","Corrupt PNG");
    for (j=0; j < s->img_y; ++j) {
-      uint8 *cur = a->out + stride*j;
-      uint8 *prior = cur - stride;
+      uint8 *cur = a->out + a->pitch * (int) j;
+      uint8 *prior = cur - a->pitch;
       int filter = *raw++;
       if (filter > 4) return e("invalid filter","Corrupt PNG");
       // if first row, use special filter that doesn't sample previous row
@@ -2109,6 +2995,18 @@ static int create_png_image(png *a, uint8 *raw, uint32 raw_len, int out_n)
       raw += img_n;
       cur += out_n;
       prior += out_n;
+      if (filter == F_none && img_n == out_n) {
+         memcpy(cur, raw, (s->img_x-1) * img_n);
+         raw += (s->img_x-1) * img_n;
+         continue;
+      }
+      #if STBI_SSE2
+      if (img_n >= 3 && filter != F_none) {
+         unfilter_row_SSE2(cur, prior, raw, s->img_x-1, img_n, out_n, filter);
+         raw += (s->img_x-1) * img_n;
+         continue;
+      }
+      #endif
       // this is a little gross, so that we don't switch per-pixel or per-component
       if (img_n == out_n) {
          #define CASE(f) \
@@ -2149,59 +3047,70 @@ static int create_png_image(png *a, uint8 *raw, uint32 raw_len, int out_n)
 static int compute_transparency(png *z, uint8 tc[3], int out_n)
 {
    stbi *s = &z->s;
-   uint32 i, pixel_count = s->img_x * s->img_y;
-   uint8 *p = z->out;
+   uint32 i, j;
 
    // compute color-based transparency, assuming we've
    // already got 255 as the alpha value in the output
    assert(out_n == 2 || out_n == 4);
 
-   if (out_n == 2) {
-      for (i=0; i < pixel_count; ++i) {
-         p[1] = (p[0] == tc[0] ? 0 : 255);
-         p += 2;
-      }
-   } else {
-      for (i=0; i < pixel_count; ++i) {
-         if (p[0] == tc[0] && p[1] == tc[1] && p[2] == tc[2])
-            p[3] = 0;
-         p += 4;
+   for (j=0; j < s->img_y; ++j) {
+      uint8 *p = z->out + z->pitch * (int) j;
+      if (out_n == 2) {
+         for (i=0; i < s->img_x; ++i) {
+            p[1] = (p[0] == tc[0] ? 0 : 255);
+            p += 2;
+         }
+      } else {
+         for (i=0; i < s->img_x; ++i) {
+            if (p[0] == tc[0] && p[1] == tc[1] && p[2] == tc[2])
+               p[3] = 0;
+            p += 4;
+         }
       }
    }
    return 1;
 }
 
-static int expand_palette(png *a, uint8 *palette, int len, int pal_img_n)
+// expands the index image in out, into dest rows pitch bytes apart when
+// given, else into a new image
+static int expand_palette(png *a, uint8 *palette, int len, int pal_img_n, uint8 *dest, int pitch)
 {
-   uint32 i, pixel_count = a->s.img_x * a->s.img_y;
+   uint32 i, j;
    uint8 *p, *temp_out, *orig = a->out;
 
-   p = (uint8 *) malloc(pixel_count * pal_img_n);
-   if (p == NULL) return e("outofmem", "Out of memory");
+   if (dest == NULL) {
+      dest = (uint8 *) malloc(a->s.img_x * a->s.img_y * pal_img_n);
+      if (dest == NULL) return e("outofmem", "Out of memory");
+      pitch = a->s.img_x * pal_img_n;
+   }
 
    // between here and free(out) below, exitting would leak
-   temp_out = p;
-
-   if (pal_img_n == 3) {
-      for (i=0; i < pixel_count; ++i) {
-         int n = orig[i]*4;
-         p[0] = palette[n  ];
-         p[1] = palette[n+1];
-         p[2] = palette[n+2];
-         p += 3;
-      }
-   } else {
-      for (i=0; i < pixel_count; ++i) {
-         int n = orig[i]*4;
-         p[0] = palette[n  ];
-         p[1] = palette[n+1];
-         p[2] = palette[n+2];
-         p[3] = palette[n+3];
-         p += 4;
+   temp_out = dest;
+
+   for (j=0; j < a->s.img_y; ++j, orig += a->pitch) {
+      p = dest + pitch * (int) j;
+      if (pal_img_n == 3) {
+         for (i=0; i < a->s.img_x; ++i) {
+            int n = orig[i]*4;
+            p[0] = palette[n  ];
+            p[1] = palette[n+1];
+            p[2] = palette[n+2];
+            p += 3;
+         }
+      } else {
+         for (i=0; i < a->s.img_x; ++i) {
+            int n = orig[i]*4;
+            p[0] = palette[n  ];
+            p[1] = palette[n+1];
+            p[2] = palette[n+2];
+            p[3] = palette[n+3];
+            p += 4;
+         }
       }
    }
    free(a->out);
    a->out = temp_out;
+   a->pitch = pitch;
    return 1;
 }
 
@@ -2235,6 +3144,7 @@ static int parse_png_file(png *z, int scan, int req_comp)
             filter= get8(s);  if (filter) return e("bad filter method","Corrupt PNG");
             interlace = get8(s); if (interlace) return e("interlaced","PNG not supported: interlaced mode");
             if (!s->img_x || !s->img_y) return e("0-pixel image","Corrupt PNG");
+            if (scan == SCAN_load && s->target && !target_fits(s->target, s->img_x, s->img_y)) return 0;
             if (!pal_img_n) {
                s->img_n = (color & 2 ? 3 : 1) + (color & 4 ? 1 : 0);
                if ((1 << 30) / s->img_x / s->img_n < s->img_y) return e("too large", "Image too large to decode");
@@ -2309,16 +3219,25 @@ static int parse_png_file(png *z, int scan, int req_comp)
 
          case PNG_TYPE('I','E','N','D'): {
             uint32 raw_len;
+            stbi_target *t = s->target;
             if (scan != SCAN_load) return 1;
             if (z->idata == NULL) return e("no IDAT","Corrupt PNG");
-            z->expanded = (uint8 *) stbi_zlib_decode_malloc((char *) z->idata, ioff, (int *) &raw_len);
+            // the filtered size is known, so inflate into a buffer that never needs to grow
+            raw_len = (s->img_n * s->img_x + 1) * s->img_y;
+            z->expanded = (uint8 *) stbi_zlib_decode_malloc_guesssize((char *) z->idata, ioff, raw_len, (int *) &raw_len);
             if (z->expanded == NULL) return 0; // zlib should set error
             free(z->idata); z->idata = NULL;
             if ((req_comp == s->img_n+1 && req_comp != 3 && !pal_img_n) || has_trans)
                s->img_out_n = s->img_n+1;
             else
                s->img_out_n = s->img_n;
-            if (!create_png_image(z, z->expanded, raw_len, s->img_out_n)) return 0;
+            // when decoding into caller memory, the final pass writes there
+            // if it produces the requested components; else do_png converts
+            if (t && !pal_img_n && t->comp == s->img_out_n) {
+               if (!create_png_image(z, z->expanded, raw_len, s->img_out_n, t->dest, t->pitch)) return 0;
+            } else {
+               if (!create_png_image(z, z->expanded, raw_len, s->img_out_n, NULL, 0)) return 0;
+            }
             if (has_trans)
                if (!compute_transparency(z, tc, s->img_out_n)) return 0;
             if (pal_img_n) {
@@ -2326,8 +3245,11 @@ static int parse_png_file(png *z, int scan, int req_comp)
                s->img_n = pal_img_n; // record the actual colors we had
                s->img_out_n = pal_img_n;
                if (req_comp >= 3) s->img_out_n = req_comp;
-               if (!expand_palette(z, palette, pal_len, s->img_out_n))
-                  return 0;
+               if (t && t->comp == s->img_out_n) {
+                  if (!expand_palette(z, palette, pal_len, s->img_out_n, t->dest, t->pitch)) return 0;
+               } else {
+                  if (!expand_palette(z, palette, pal_len, s->img_out_n, NULL, 0)) return 0;
+               }
             }
             free(z->expanded); z->expanded = NULL;
             return 1;
@@ -2364,7 +3286,11 @@ static unsigned char *do_png(png *p, int *x, int *y, int *n, int req_comp)
    if (parse_png_file(p, SCAN_load, req_comp)) {
       result = p->out;
       p->out = NULL;
-      if (req_comp && req_comp != p->s.img_out_n) {
+      if (p->s.target) {
+         // decoded in place, or converted into the target in one pass
+         result = store_into_target(p->s.target, result, p->s.img_out_n, p->s.img_x, p->s.img_y);
+         if (result == NULL) return result;
+      } else if (req_comp && req_comp != p->s.img_out_n) {
          result = convert_format(result, p->s.img_out_n, req_comp, p->s.img_x, p->s.img_y);
          p->s.img_out_n = req_comp;
          if (result == NULL) return result;
@@ -2373,7 +3299,9 @@ static unsigned char *do_png(png *p, int *x, int *y, int *n, int req_comp)
       *y = p->s.img_y;
       if (n) *n = p->s.img_n;
    }
-   free(p->out);      p->out      = NULL;
+   if (!p->s.target || p->out != p->s.target->dest)
+      free(p->out);
+   p->out = NULL;
    free(p->expanded); p->expanded = NULL;
    free(p->idata);    p->idata    = NULL;
 
@@ -2426,12 +3354,47 @@ int stbi_png_test_memory(stbi_uc const *buffer, int len)
    return parse_png_file(&p, SCAN_type,STBI_default);
 }
 
-// TODO: load header from png
+// reads IHDR, and for paletted images the chunks up to the first IDAT to see
+// whether a tRNS adds alpha
+static int png_info(png *p, int *x, int *y, int *comp)
+{
+   p->idata = NULL;
+   if (!parse_png_file(p, SCAN_header, 0)) return 0;
+   if (x) *x = p->s.img_x;
+   if (y) *y = p->s.img_y;
+   if (comp) *comp = p->s.img_n;
+   return 1;
+}
+
 #ifndef STBI_NO_STDIO
-extern int      stbi_png_info             (char const *filename,           int *x, int *y, int *comp);
-extern int      stbi_png_info_from_file   (FILE *f,                  int *x, int *y, int *comp);
+int stbi_png_info(char const *filename, int *x, int *y, int *comp)
+{
+   FILE *f = fopen(filename, "rb");
+   int result;
+   if (!f) return e("can't fopen", "Unable to open file");
+   result = stbi_png_info_from_file(f,x,y,comp);
+   fclose(f);
+   return result;
+}
+
+int stbi_png_info_from_file(FILE *f, int *x, int *y, int *comp)
+{
+   png p;
+   int n,r;
+   n = ftell(f);
+   start_file(&p.s, f);
+   r = png_info(&p, x,y,comp);
+   fseek(f,n,SEEK_SET);
+   return r;
+}
 #endif
-extern int      stbi_png_info_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp);
+
+int stbi_png_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp)
+{
+   png p;
+   start_mem(&p.s, buffer, len);
+   return png_info(&p, x,y,comp);
+}
 
 // Microsoft/Windows BMP image
 
@@ -2508,20 +3471,25 @@ static int shiftsigned(int v, int shift, int bits)
    return result;
 }
 
-static stbi_uc *bmp_load(stbi *s, int *x, int *y, int *comp, int req_comp)
+typedef struct
 {
-   uint8 *out;
+   int bpp, offset, hsz, psize, flip_vertically;
+   unsigned int mr,mg,mb,ma;
+} bmp_header;
+
+// reads the file and info headers, leaving s at the palette or masks' end
+// and s->img_x, s->img_y and s->img_n set
+static int bmp_parse_header(stbi *s, bmp_header *h)
+{
+   int i, hsz, bpp, offset, psize=0, compress=0;
    unsigned int mr=0,mg=0,mb=0,ma=0;
-   stbi_uc pal[256][4];
-   int psize=0,i,j,compress=0,width;
-   int bpp, flip_vertically, pad, target, offset, hsz;
-   if (get8(s) != 'B' || get8(s) != 'M') return epuc("not BMP", "Corrupt BMP");
+   if (get8(s) != 'B' || get8(s) != 'M') return e("not BMP", "Corrupt BMP");
    get32le(s); // discard filesize
    get16le(s); // discard reserved
    get16le(s); // discard reserved
    offset = get32le(s);
    hsz = get32le(s);
-   if (hsz != 12 && hsz != 40 && hsz != 56 && hsz != 108) return epuc("unknown BMP", "BMP type not supported: unknown");
+   if (hsz != 12 && hsz != 40 && hsz != 56 && hsz != 108) return e("unknown BMP", "BMP type not supported: unknown");
    failure_reason = "bad BMP";
    if (hsz == 12) {
       s->img_x = get16le(s);
@@ -2532,15 +3500,15 @@ static stbi_uc *bmp_load(stbi *s, int *x, int *y, int *comp, int req_comp)
    }
    if (get16le(s) != 1) return 0;
    bpp = get16le(s);
-   if (bpp == 1) return epuc("monochrome", "BMP type not supported: 1-bit");
-   flip_vertically = ((int) s->img_y) > 0;
+   if (bpp == 1) return e("monochrome", "BMP type not supported: 1-bit");
+   h->flip_vertically = ((int) s->img_y) > 0;
    s->img_y = abs((int) s->img_y);
    if (hsz == 12) {
       if (bpp < 24)
          psize = (offset - 14 - 24) / 3;
    } else {
       compress = get32le(s);
-      if (compress == 1 || compress == 2) return epuc("BMP RLE", "BMP type not supported: RLE");
+      if (compress == 1 || compress == 2) return e("BMP RLE", "BMP type not supported: RLE");
       get32le(s); // discard sizeof
       get32le(s); // discard hres
       get32le(s); // discard vres
@@ -2572,10 +3540,10 @@ static stbi_uc *bmp_load(stbi *s, int *x, int *y, int *comp, int req_comp)
                // not documented, but generated by photoshop and handled by mspaint
                if (mr == mg && mg == mb) {
                   // ?!?!?
-                  return NULL;
+                  return 0;
                }
             } else
-               return NULL;
+               return 0;
          }
       } else {
          assert(hsz == 108);
@@ -2591,6 +3559,35 @@ static stbi_uc *bmp_load(stbi *s, int *x, int *y, int *comp, int req_comp)
          psize = (offset - 14 - hsz) >> 2;
    }
    s->img_n = ma ? 4 : 3;
+   h->bpp = bpp;
+   h->offset = offset;
+   h->hsz = hsz;
+   h->psize = psize;
+   h->mr = mr;
+   h->mg = mg;
+   h->mb = mb;
+   h->ma = ma;
+   return 1;
+}
+
+static stbi_uc *bmp_load(stbi *s, int *x, int *y, int *comp, int req_comp)
+{
+   uint8 *out;
+   unsigned int mr,mg,mb,ma;
+   stbi_uc pal[256][4];
+   int psize,i,j,width;
+   int bpp, flip_vertically, pad, target, offset, hsz;
+   bmp_header h;
+   if (!bmp_parse_header(s, &h)) return NULL;
+   bpp = h.bpp;
+   offset = h.offset;
+   hsz = h.hsz;
+   psize = h.psize;
+   flip_vertically = h.flip_vertically;
+   mr = h.mr;
+   mg = h.mg;
+   mb = h.mb;
+   ma = h.ma;
    if (req_comp && req_comp >= 3) // we can directly decode 3 or 4
       target = req_comp;
    else
@@ -2728,6 +3725,35 @@ stbi_uc *stbi_bmp_load_from_memory (stbi_uc const *buffer, int len, int *x, int
    return bmp_load(&s, x,y,comp,req_comp);
 }
 
+static int bmp_info(stbi *s, int *x, int *y, int *comp)
+{
+   bmp_header h;
+   if (!bmp_parse_header(s, &h)) return 0;
+   if (x) *x = s->img_x;
+   if (y) *y = s->img_y;
+   if (comp) *comp = s->img_n;
+   return 1;
+}
+
+#ifndef STBI_NO_STDIO
+int stbi_bmp_info_from_file(FILE *f, int *x, int *y, int *comp)
+{
+   stbi s;
+   int r,n = ftell(f);
+   start_file(&s, f);
+   r = bmp_info(&s, x,y,comp);
+   fseek(f,n,SEEK_SET);
+   return r;
+}
+#endif
+
+int stbi_bmp_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp)
+{
+   stbi s;
+   start_mem(&s, buffer, len);
+   return bmp_info(&s, x,y,comp);
+}
+
 // Targa Truevision - TGA
 // by Jonathan Dummer
 
@@ -3014,6 +4040,65 @@ stbi_uc *stbi_tga_load_from_memory (stbi_uc const *buffer, int len, int *x, int
    return tga_load(&s, x,y,comp,req_comp);
 }
 
+static int tga_info(stbi *s, int *x, int *y, int *comp)
+{
+	int tga_indexed, tga_image_type, tga_palette_bits;
+	int tga_width, tga_height, tga_bits_per_pixel;
+	get8u(s);		//	discard Offset
+	tga_indexed = get8u(s);
+	tga_image_type = get8u(s);
+	get16le(s);		//	discard palette start
+	get16le(s);		//	discard palette length
+	tga_palette_bits = get8u(s);
+	get16le(s);		//	discard x origin
+	get16le(s);		//	discard y origin
+	tga_width = get16le(s);
+	tga_height = get16le(s);
+	tga_bits_per_pixel = get8u(s);
+	if( tga_image_type >= 8 )
+	{
+		tga_image_type -= 8;
+	}
+	//	the same checks as tga_load
+	if( (tga_indexed > 1) ||
+		(tga_width < 1) || (tga_height < 1) ||
+		(tga_image_type < 1) || (tga_image_type > 3) ||
+		((tga_bits_per_pixel != 8) && (tga_bits_per_pixel != 16) &&
+		(tga_bits_per_pixel != 24) && (tga_bits_per_pixel != 32))
+		)
+	{
+		return e("bad TGA", "Corrupt TGA");
+	}
+	//	paletted images have the components of their palette
+	if( tga_indexed )
+	{
+		tga_bits_per_pixel = tga_palette_bits;
+	}
+	if (x) *x = tga_width;
+	if (y) *y = tga_height;
+	if (comp) *comp = tga_bits_per_pixel / 8;
+	return 1;
+}
+
+#ifndef STBI_NO_STDIO
+int stbi_tga_info_from_file(FILE *f, int *x, int *y, int *comp)
+{
+   stbi s;
+   int r,n = ftell(f);
+   start_file(&s, f);
+   r = tga_info(&s, x,y,comp);
+   fseek(f,n,SEEK_SET);
+   return r;
+}
+#endif
+
+int stbi_tga_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp)
+{
+   stbi s;
+   start_mem(&s, buffer, len);
+   return tga_info(&s, x,y,comp);
+}
+
 
 // *************************************************************************************************
 // Photoshop PSD loader -- PD by Thatcher Ulrich, integration by Nicholas Schulz, tweaked by STB
@@ -3228,6 +4313,58 @@ stbi_uc *stbi_psd_load_from_memory (stbi_uc const *buffer, int len, int *x, int
    return psd_load(&s, x,y,comp,req_comp);
 }
 
+static int psd_info(stbi *s, int *x, int *y, int *comp)
+{
+	int channelCount, w, h;
+
+	// Same header checks as psd_load, up to the image data
+	if (get32(s) != 0x38425053)	// "8BPS"
+		return e("not PSD", "Corrupt PSD image");
+	if (get16(s) != 1)
+		return e("wrong version", "Unsupported version of PSD image");
+	skip(s, 6 );
+	channelCount = get16(s);
+	if (channelCount < 0 || channelCount > 16)
+		return e("wrong channel count", "Unsupported number of channels in PSD image");
+   h = get32(s);
+   w = get32(s);
+	if (get16(s) != 8)
+		return e("unsupported bit depth", "PSD bit depth is not 8 bit");
+	if (get16(s) != 3)
+		return e("wrong color format", "PSD is not in RGB color format");
+
+	// Skip the mode data, image resources and reserved data to the compression
+	skip(s,get32(s) );
+	skip(s, get32(s) );
+	skip(s, get32(s) );
+	if (get16(s) > 1)
+		return e("bad compression", "PSD has an unknown compression format");
+
+	if (x) *x = w;
+	if (y) *y = h;
+	if (comp) *comp = channelCount;
+	return 1;
+}
+
+#ifndef STBI_NO_STDIO
+int stbi_psd_info_from_file(FILE *f, int *x, int *y, int *comp)
+{
+   stbi s;
+   int r,n = ftell(f);
+   start_file(&s, f);
+   r = psd_info(&s, x,y,comp);
+   fseek(f,n,SEEK_SET);
+   return r;
+}
+#endif
+
+int stbi_psd_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp)
+{
+   stbi s;
+   start_mem(&s, buffer, len);
+   return psd_info(&s, x,y,comp);
+}
+
 
 // *************************************************************************************************
 // Radiance RGBE HDR loader
@@ -3314,22 +4451,16 @@ static void hdr_convert(float *output, stbi_uc *input, int req_comp)
 }
 
 
-static float *hdr_load(stbi *s, int *x, int *y, int *comp, int req_comp)
+// reads the text header up to the pixel data
+static int hdr_parse_header(stbi *s, int *width, int *height)
 {
    char buffer[HDR_BUFLEN];
 	char *token;
 	int valid = 0;
-	int width, height;
-   stbi_uc *scanline;
-	float *hdr_data;
-	int len;
-	unsigned char count, value;
-	int i, j, k, c1,c2, z;
-
 
 	// Check identifier
 	if (strcmp(hdr_gettoken(s,buffer), "#?RADIANCE") != 0)
-		return epf("not HDR", "Corrupt HDR image");
+		return e("not HDR", "Corrupt HDR image");
 
 	// Parse header
 	while(1) {
@@ -3338,18 +4469,31 @@ static float *hdr_load(stbi *s, int *x, int *y, int *comp, int req_comp)
 		if (strcmp(token, "FORMAT=32-bit_rle_rgbe") == 0) valid = 1;
    }
 
-	if (!valid)    return epf("unsupported format", "Unsupported HDR format");
+	if (!valid)    return e("unsupported format", "Unsupported HDR format");
 
    // Parse width and height
    // can't use sscanf() if we're not using stdio!
    token = hdr_gettoken(s,buffer);
-   if (strncmp(token, "-Y ", 3))  return epf("unsupported data layout", "Unsupported HDR format");
+   if (strncmp(token, "-Y ", 3))  return e("unsupported data layout", "Unsupported HDR format");
    token += 3;
-   height = strtol(token, &token, 10);
+   *height = strtol(token, &token, 10);
    while (*token == ' ') ++token;
-   if (strncmp(token, "+X ", 3))  return epf("unsupported data layout", "Unsupported HDR format");
+   if (strncmp(token, "+X ", 3))  return e("unsupported data layout", "Unsupported HDR format");
    token += 3;
-   width = strtol(token, NULL, 10);
+   *width = strtol(token, NULL, 10);
+   return 1;
+}
+
+static float *hdr_load(stbi *s, int *x, int *y, int *comp, int req_comp)
+{
+	int width, height;
+   stbi_uc *scanline;
+	float *hdr_data;
+	int len;
+	unsigned char count, value;
+	int i, j, k, c1,c2, z;
+
+	if (!hdr_parse_header(s, &width, &height)) return NULL;
 
 	*x = width;
 	*y = height;
@@ -3423,9 +4567,6 @@ static float *hdr_load(stbi *s, int *x, int *y, int *comp, int req_comp)
 
 static stbi_uc *hdr_load_rgbe(stbi *s, int *x, int *y, int *comp, int req_comp)
 {
-   char buffer[HDR_BUFLEN];
-	char *token;
-	int valid = 0;
 	int width, height;
    stbi_uc *scanline;
 	stbi_uc *rgbe_data;
@@ -3433,30 +4574,7 @@ static stbi_uc *hdr_load_rgbe(stbi *s, int *x, int *y, int *comp, int req_comp)
 	unsigned char count, value;
 	int i, j, k, c1,c2, z;
 
-
-	// Check identifier
-	if (strcmp(hdr_gettoken(s,buffer), "#?RADIANCE") != 0)
-		return epuc("not HDR", "Corrupt HDR image");
-
-	// Parse header
-	while(1) {
-		token = hdr_gettoken(s,buffer);
-      if (token[0] == 0) break;
-		if (strcmp(token, "FORMAT=32-bit_rle_rgbe") == 0) valid = 1;
-   }
-
-	if (!valid)    return epuc("unsupported format", "Unsupported HDR format");
-
-   // Parse width and height
-   // can't use sscanf() if we're not using stdio!
-   token = hdr_gettoken(s,buffer);
-   if (strncmp(token, "-Y ", 3))  return epuc("unsupported data layout", "Unsupported HDR format");
-   token += 3;
-   height = strtol(token, &token, 10);
-   while (*token == ' ') ++token;
-   if (strncmp(token, "+X ", 3))  return epuc("unsupported data layout", "Unsupported HDR format");
-   token += 3;
-   width = strtol(token, NULL, 10);
+	if (!hdr_parse_header(s, &width, &height)) return NULL;
 
 	*x = width;
 	*y = height;
@@ -3568,8 +4686,116 @@ stbi_uc *stbi_hdr_load_rgbe_memory(stbi_uc *buffer, int len, int *x, int *y, int
    return hdr_load_rgbe(&s,x,y,comp,req_comp);
 }
 
+// stbi_load hands HDR images back as 3 component LDR
+static int hdr_info(stbi *s, int *x, int *y, int *comp)
+{
+   int width, height;
+   if (!hdr_parse_header(s, &width, &height)) return 0;
+   if (x) *x = width;
+   if (y) *y = height;
+   if (comp) *comp = 3;
+   return 1;
+}
+
+#ifndef STBI_NO_STDIO
+int stbi_hdr_info_from_file(FILE *f, int *x, int *y, int *comp)
+{
+   stbi s;
+   int r,n = ftell(f);
+   start_file(&s,f);
+   r = hdr_info(&s,x,y,comp);
+   fseek(f,n,SEEK_SET);
+   return r;
+}
+#endif
+
+int stbi_hdr_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp)
+{
+   stbi s;
+   start_mem(&s,buffer, len);
+   return hdr_info(&s,x,y,comp);
+}
+
 #endif // STBI_NO_HDR
 
+/////////////////////// load into caller memory ///////////////////////
+
+static int start_target(stbi_target *t, int req_comp, stbi_uc *dest, int dest_pitch, int max_x, int max_y)
+{
+   if (req_comp < 1 || req_comp > 4) return e("bad req_comp", "Internal error");
+   if (dest == NULL || max_x < 1 || max_y < 1 || abs(dest_pitch) < max_x * req_comp)
+      return e("bad dest", "Invalid destination");
+   t->dest = dest;
+   t->pitch = dest_pitch;
+   t->max_x = max_x;
+   t->max_y = max_y;
+   t->comp = req_comp;
+   return 1;
+}
+
+// JPEG and PNG decode into the target directly; every other format decodes
+// into its own buffer exactly as stbi_load would, whose rows are then copied
+// into the target
+static uint8 *load_memory_into(stbi_uc const *buffer, int len, int *x, int *y, int *comp, stbi_target *t)
+{
+   uint8 *data;
+   int n;
+   if (stbi_jpeg_test_memory(buffer,len)) {
+      jpeg j;
+      start_mem(&j.s, buffer,len);
+      j.s.target = t;
+      return load_jpeg_image(&j, x,y,comp,t->comp);
+   }
+   if (stbi_png_test_memory(buffer,len)) {
+      png p;
+      start_mem(&p.s, buffer,len);
+      p.s.target = t;
+      return do_png(&p, x,y,comp,t->comp);
+   }
+   // not every loader accepts a NULL comp
+   data = stbi_load_from_memory(buffer,len,x,y,&n,t->comp);
+   if (comp) *comp = n;
+   return store_into_target(t, data, t->comp, *x, *y);
+}
+
+int stbi_load_from_memory_into(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, stbi_uc *dest, int dest_pitch, int max_x, int max_y)
+{
+   stbi_target t;
+   if (!start_target(&t, req_comp, dest, dest_pitch, max_x, max_y)) return 0;
+   return load_memory_into(buffer,len,x,y,comp,&t) != NULL;
+}
+
+#ifndef STBI_NO_STDIO
+int stbi_load_from_file_into(FILE *f, int *x, int *y, int *comp, int req_comp, stbi_uc *dest, int dest_pitch, int max_x, int max_y)
+{
+   stbi_target t;
+   uint8 *data;
+   int n;
+   if (!start_target(&t, req_comp, dest, dest_pitch, max_x, max_y)) return 0;
+   if (stbi_jpeg_test_file(f))
+      return jpeg_load_file(f,x,y,comp,req_comp,&t) != NULL;
+   if (stbi_png_test_file(f)) {
+      png p;
+      start_file(&p.s, f);
+      p.s.target = &t;
+      return do_png(&p, x,y,comp,req_comp) != NULL;
+   }
+   data = stbi_load_from_file(f,x,y,&n,req_comp);
+   if (comp) *comp = n;
+   return store_into_target(&t, data, req_comp, *x, *y) != NULL;
+}
+
+int stbi_load_into(char const *filename, int *x, int *y, int *comp, int req_comp, stbi_uc *dest, int dest_pitch, int max_x, int max_y)
+{
+   FILE *f = fopen(filename, "rb");
+   int result;
+   if (!f) return e("can't fopen", "Unable to open file");
+   result = stbi_load_from_file_into(f,x,y,comp,req_comp,dest,dest_pitch,max_x,max_y);
+   fclose(f);
+   return result;
+}
+#endif
+
 /////////////////////// write image ///////////////////////
 
 #ifndef STBI_NO_WRITE
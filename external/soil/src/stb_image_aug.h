@@ -14,9 +14,7 @@
       writes BMP,TGA (define STBI_NO_WRITE to remove code)
       decoded from memory or through stdio FILE (define STBI_NO_STDIO to remove code)
       supports installable dequantizing-IDCT, YCbCr-to-RGB conversion (define STBI_SIMD)
-        
-   TODO:
-      stbi_info_*
+      size and components of every format from the header alone (stbi_info_*)
   
    history:
       1.16   major bugfix - convert_format converted one too many pixels
@@ -197,6 +195,18 @@ extern int      stbi_info_from_file  (FILE *f,                  int *x, int *y,
 extern stbi_uc *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp);
 // for stbi_load_from_file, file pointer is left pointing immediately after image
 
+// decode into caller memory (a mapped pixel buffer, an arena slice, ...) instead
+// of a new image: row r, req_comp (1-4) components per pixel, starts at
+// dest + r*dest_pitch, so a negative pitch with dest at the last row flips the
+// image vertically. JPEG and PNG are decoded straight into dest, other formats
+// are decoded as by stbi_load and copied in. Returns 1 on success, 0 on failure; dest
+// is left untouched if the image is larger than max_x by max_y
+#ifndef STBI_NO_STDIO
+extern int      stbi_load_into            (char const *filename,     int *x, int *y, int *comp, int req_comp, stbi_uc *dest, int dest_pitch, int max_x, int max_y);
+extern int      stbi_load_from_file_into  (FILE *f,                  int *x, int *y, int *comp, int req_comp, stbi_uc *dest, int dest_pitch, int max_x, int max_y);
+#endif
+extern int      stbi_load_from_memory_into(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, stbi_uc *dest, int dest_pitch, int max_x, int max_y);
+
 #ifndef STBI_NO_HDR
 #ifndef STBI_NO_STDIO
 extern float *stbi_loadf            (char const *filename,     int *x, int *y, int *comp, int req_comp);
@@ -212,14 +222,25 @@ extern void   stbi_ldr_to_hdr_scale(float scale);
 
 #endif // STBI_NO_HDR
 
-// get a VERY brief reason for failure
+// JPEG files with restart intervals are decoded on up to 'count' threads;
+// 0 (the default) uses one per CPU, 1 decodes on the calling thread only.
+// Callers that decode many images on their own threads should set 1 first,
+// or every decode starts another thread per CPU
 // NOT THREADSAFE
+extern void     stbi_set_thread_count(int count);
+
+// get a VERY brief reason for failure of the last call on this thread
+// (shared by all threads on compilers without thread-local storage)
 extern char    *stbi_failure_reason  (void); 
 
 // free the loaded image -- this is just free()
 extern void     stbi_image_free      (void *retval_from_stbi_load);
 
-// get image dimensions & components without fully decoding
+// get image dimensions & components without fully decoding; comp is what
+// stbi_load would report, except for DDS, where it is what the header declares
+// and a load may keep or drop alpha after decoding. x, y and comp may be NULL.
+// Only the header is read, except for loaders added with stbi_register_loader,
+// which are decoded
 extern int      stbi_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp);
 extern int      stbi_is_hdr_from_memory(stbi_uc const *buffer, int len);
 #ifndef STBI_NO_STDIO
@@ -271,9 +292,11 @@ extern int      stbi_bmp_test_memory      (stbi_uc const *buffer, int len);
 
 extern stbi_uc *stbi_bmp_load             (char const *filename,     int *x, int *y, int *comp, int req_comp);
 extern stbi_uc *stbi_bmp_load_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp);
+extern int      stbi_bmp_info_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp);
 #ifndef STBI_NO_STDIO
 extern int      stbi_bmp_test_file        (FILE *f);
 extern stbi_uc *stbi_bmp_load_from_file   (FILE *f,                  int *x, int *y, int *comp, int req_comp);
+extern int      stbi_bmp_info_from_file   (FILE *f,                  int *x, int *y, int *comp);
 #endif
 
 // is it a tga?
@@ -281,9 +304,11 @@ extern int      stbi_tga_test_memory      (stbi_uc const *buffer, int len);
 
 extern stbi_uc *stbi_tga_load             (char const *filename,     int *x, int *y, int *comp, int req_comp);
 extern stbi_uc *stbi_tga_load_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp);
+extern int      stbi_tga_info_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp);
 #ifndef STBI_NO_STDIO
 extern int      stbi_tga_test_file        (FILE *f);
 extern stbi_uc *stbi_tga_load_from_file   (FILE *f,                  int *x, int *y, int *comp, int req_comp);
+extern int      stbi_tga_info_from_file   (FILE *f,                  int *x, int *y, int *comp);
 #endif
 
 // is it a psd?
@@ -291,9 +316,11 @@ extern int      stbi_psd_test_memory      (stbi_uc const *buffer, int len);
 
 extern stbi_uc *stbi_psd_load             (char const *filename,     int *x, int *y, int *comp, int req_comp);
 extern stbi_uc *stbi_psd_load_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp);
+extern int      stbi_psd_info_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp);
 #ifndef STBI_NO_STDIO
 extern int      stbi_psd_test_file        (FILE *f);
 extern stbi_uc *stbi_psd_load_from_file   (FILE *f,                  int *x, int *y, int *comp, int req_comp);
+extern int      stbi_psd_info_from_file   (FILE *f,                  int *x, int *y, int *comp);
 #endif
 
 // is it an hdr?
@@ -303,10 +330,12 @@ extern float *  stbi_hdr_load             (char const *filename,     int *x, int
 extern float *  stbi_hdr_load_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp);
 extern stbi_uc *stbi_hdr_load_rgbe        (char const *filename,           int *x, int *y, int *comp, int req_comp);
 extern float *  stbi_hdr_load_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp);
+extern int      stbi_hdr_info_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp);
 #ifndef STBI_NO_STDIO
 extern int      stbi_hdr_test_file        (FILE *f);
 extern float *  stbi_hdr_load_from_file   (FILE *f,                  int *x, int *y, int *comp, int req_comp);
 extern stbi_uc *stbi_hdr_load_rgbe_file   (FILE *f,                  int *x, int *y, int *comp, int req_comp);
+extern int      stbi_hdr_info_from_file   (FILE *f,                  int *x, int *y, int *comp);
 #endif
 
 // define new loaders
@@ -326,13 +355,19 @@ typedef struct
 extern int stbi_register_loader(stbi_loader *loader);
 
 // define faster low-level operations (typically SIMD support)
+// SSE2 targets turn this on by themselves and install SSE2 kernels by default;
+// define STBI_NO_SIMD to keep the plain C code paths
+#if !defined(STBI_SIMD) && !defined(STBI_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define STBI_SIMD 1
+#endif
+
 #if STBI_SIMD
-typedef void (*stbi_idct_8x8)(uint8 *out, int out_stride, short data[64], unsigned short *dequantize);
+typedef void (*stbi_idct_8x8)(stbi_uc *out, int out_stride, short data[64], unsigned short *dequantize);
 // compute an integer IDCT on "input"
 //     input[x] = data[x] * dequantize[x]
 //     write results to 'out': 64 samples, each run of 8 spaced by 'out_stride'
 //                             CLAMP results to 0..255
-typedef void (*stbi_YCbCr_to_RGB_run)(uint8 *output, uint8 const *y, uint8 const *cb, uint8 const *cr, int count, int step);
+typedef void (*stbi_YCbCr_to_RGB_run)(stbi_uc *output, stbi_uc const *y, stbi_uc const *cb, stbi_uc const *cr, int count, int step);
 // compute a conversion from YCbCr to RGB
 //     'count' pixels
 //     write pixels to 'output'; each pixel is 'step' bytes (either 3 or 4; if 4, write '255' as 4th), order R,G,B
@@ -265,37 +265,44 @@ void stbi_decode_DXT_color_block(
 	}
 	//	done
 }
-static stbi_uc *dds_load(stbi *s, int *x, int *y, int *comp, int req_comp)
+static int dds_parse_header(stbi *s, DDS_header *header)
 {
-	//	all variables go up front
-	stbi_uc *dds_data = NULL;
-	stbi_uc block[16*4];
-	stbi_uc compressed[8];
-	int flags, DXT_family;
-	int has_alpha, has_mipmap;
-	int is_compressed, cubemap_faces;
-	int block_pitch, num_blocks;
-	DDS_header header;
-	int i, sz, cf;
+	int flags;
 	//	load the header
 	if( sizeof( DDS_header ) != 128 )
 	{
-		return NULL;
+		return 0;
 	}
-	getn( s, (stbi_uc*)(&header), 128 );
+	getn( s, (stbi_uc*)header, 128 );
 	//	and do some checking
-	if( header.dwMagic != (('D' << 0) | ('D' << 8) | ('S' << 16) | (' ' << 24)) ) return NULL;
-	if( header.dwSize != 124 ) return NULL;
+	if( header->dwMagic != (('D' << 0) | ('D' << 8) | ('S' << 16) | (' ' << 24)) ) return 0;
+	if( header->dwSize != 124 ) return 0;
 	flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT;
-	if( (header.dwFlags & flags) != flags ) return NULL;
+	if( (header->dwFlags & flags) != flags ) return 0;
 	/*	According to the MSDN spec, the dwFlags should contain
 		DDSD_LINEARSIZE if it's compressed, or DDSD_PITCH if
 		uncompressed.  Some DDS writers do not conform to the
 		spec, so I need to make my reader more tolerant	*/
-	if( header.sPixelFormat.dwSize != 32 ) return NULL;
+	if( header->sPixelFormat.dwSize != 32 ) return 0;
 	flags = DDPF_FOURCC | DDPF_RGB;
-	if( (header.sPixelFormat.dwFlags & flags) == 0 ) return NULL;
-	if( (header.sCaps.dwCaps1 & DDSCAPS_TEXTURE) == 0 ) return NULL;
+	if( (header->sPixelFormat.dwFlags & flags) == 0 ) return 0;
+	if( (header->sCaps.dwCaps1 & DDSCAPS_TEXTURE) == 0 ) return 0;
+	return 1;
+}
+
+static stbi_uc *dds_load(stbi *s, int *x, int *y, int *comp, int req_comp)
+{
+	//	all variables go up front
+	stbi_uc *dds_data = NULL;
+	stbi_uc block[16*4];
+	stbi_uc compressed[8];
+	int DXT_family;
+	int has_alpha, has_mipmap;
+	int is_compressed, cubemap_faces;
+	int block_pitch, num_blocks;
+	DDS_header header;
+	int i, sz, cf;
+	if( !dds_parse_header( s, &header ) ) return NULL;
 	//	get the image data
 	s->img_x = header.dwWidth;
 	s->img_y = header.dwHeight;
@@ -509,3 +516,46 @@ stbi_uc *stbi_dds_load_from_memory (stbi_uc const *buffer, int len, int *x, int
    start_mem(&s,buffer, len);
    return dds_load(&s,x,y,comp,req_comp);
 }
+
+/*	the components are those the header declares; a full load
+	drops an alpha channel that turns out to be fully opaque	*/
+static int dds_info(stbi *s, int *x, int *y, int *comp)
+{
+	DDS_header header;
+	int n, cubemap_faces;
+	if( !dds_parse_header( s, &header ) ) return e("bad DDS", "Corrupt DDS");
+	if( header.sPixelFormat.dwFlags & DDPF_FOURCC )
+	{
+		int DXT_family = 1 + (header.sPixelFormat.dwFourCC >> 24) - '1';
+		if( (DXT_family < 1) || (DXT_family > 5) ) return e("bad DDS", "DDS type not supported");
+		n = (DXT_family == 1) ? 3 : 4;
+	} else
+	{
+		n = (header.sPixelFormat.dwFlags & DDPF_ALPHAPIXELS) ? 4 : 3;
+	}
+	/*	cubemaps load as their 6 square faces stacked vertically	*/
+	cubemap_faces = (header.sCaps.dwCaps2 & DDSCAPS2_CUBEMAP) && (header.dwWidth == header.dwHeight) ? 6 : 1;
+	if( x ) *x = header.dwWidth;
+	if( y ) *y = header.dwHeight * cubemap_faces;
+	if( comp ) *comp = n;
+	return 1;
+}
+
+#ifndef STBI_NO_STDIO
+int      stbi_dds_info_from_file   (FILE *f,                  int *x, int *y, int *comp)
+{
+   stbi s;
+   int r,n = ftell(f);
+   start_file(&s,f);
+   r = dds_info(&s,x,y,comp);
+   fseek(f,n,SEEK_SET);
+   return r;
+}
+#endif
+
+int      stbi_dds_info_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp)
+{
+   stbi s;
+   start_mem(&s,buffer, len);
+   return dds_info(&s,x,y,comp);
+}
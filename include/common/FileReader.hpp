@@ -1,8 +1,45 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <cstddef>
+
+/// Read-only view of a whole file without copying it. Memory-mapped on POSIX,
+/// a single sized read into an owned buffer elsewhere.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &fileName);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    inline bool isOpen() const {
+        return open_;
+    }
+
+    inline const char *data() const {
+        return data_;
+    }
+
+    inline size_t size() const {
+        return size_;
+    }
+
+private:
+    const char *data_;
+    size_t size_;
+    bool open_;
+    bool mapped_;
+    std::vector<char> buffer_;
+};
 
 class FileReader {
 public:
+    /// Whole file as a string, one allocation
     static const std::string ReadFromFile(std::string fileName);
-};
\ No newline at end of file
+
+    /// Whole file in a malloc'd buffer with a terminating null (not counted in size). Caller frees, NULL on failure
+    static char *ReadBytes(const std::string &fileName, size_t *size = NULL);
+};
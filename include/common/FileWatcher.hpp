@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+
+/// Watches files for modification on a background thread (inotify on Linux, mtime polling elsewhere).
+/// The parent directory is watched so that editors that save by rename are picked up too.
+class FileWatcher {
+public:
+    FileWatcher();
+
+    ~FileWatcher();
+
+    /// Start watching a file, changes are reported with the path exactly as given here
+    void watch(const std::string &path);
+
+    /// Files that changed since the last call, never blocks
+    std::vector<std::string> takeChanges();
+
+private:
+    std::set<std::string> files_;
+    std::set<std::string> changes_;
+    std::mutex mutex_;
+    std::thread thread_;
+    std::atomic<bool> running_;
+
+#ifdef __linux__
+    int fd_;
+    std::map<int, std::set<std::string>> directories_;
+#else
+    std::map<std::string, long long> mtimes_;
+#endif
+
+    void run();
+};
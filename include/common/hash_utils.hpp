@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/// 64-bit FNV-1a, stable across runs and platforms so it can key on-disk caches
+inline uint64_t fnv1a_64(const void *data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline uint64_t fnv1a_64(const std::string &string, uint64_t hash = 14695981039346656037ULL) {
+    // Hash the terminating null too so that ("ab", "c") and ("a", "bc") differ
+    return fnv1a_64(string.c_str(), string.size() + 1, hash);
+}
+
+inline std::string to_hex_string(uint64_t hash) {
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(hash));
+    return std::string(buffer);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <rendering/StreamBuffer.hpp>
+
+/// Camera and lighting shared by every program, the std140 "Frame" block of shaders/frame.glsl. Written
+/// once per frame into the frame stream and bound to one binding point, programs find it there through
+/// ShaderProgram::bindUniformBlock. Members are vec4 and mat4 only, so the C++ layout matches std140
+/// without padding; keep it that way when adding members.
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 camera_position; // w = 1
+    glm::vec4 light_direction; // Normalized, w = 0
+
+    static const GLuint BINDING = 0;
+
+    /// Bind the "Frame" block of programs built from now on to BINDING
+    static void registerBlock();
+
+    /// Copy into a slice of the stream and bind it to BINDING. The stream still has to be flushed before
+    /// drawing. Returns false if the stream is full
+    bool upload(StreamBuffer &stream) const;
+};
+
+static_assert(sizeof(FrameUniforms) == 160, "FrameUniforms must match the std140 layout of the Frame block");
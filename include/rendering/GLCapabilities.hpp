@@ -0,0 +1,56 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <string>
+#include <unordered_set>
+#include <unordered_map>
+
+/// Extensions and limits of the current GL context, read once. Extensions are enumerated with
+/// glGetStringi on GL 3.0+ (GL_EXTENSIONS is gone from glGetString in core profiles) into a hashed
+/// set, so a query is one lookup instead of a scan of the whole extension string.
+class GLCapabilities {
+public:
+    /// Limits read by init(), the rest are cached on first use by integer()
+    struct Limits {
+        GLint maxTextureSize;
+        GLint maxCubeMapTextureSize;
+        GLint maxRectangleTextureSize;
+        GLint maxTextureImageUnits;
+        GLint maxCombinedTextureImageUnits;
+        GLint maxVertexAttribs;
+        GLint maxUniformBufferBindings;
+        GLint maxUniformBlockSize;
+        GLint maxElementsVertices;
+        GLint maxElementsIndices;
+        GLint maxSamples;
+    };
+
+    /// Read the capabilities of the current context and answer SOIL's capability queries from them.
+    /// Called by the first query if not called explicitly; call again after switching contexts
+    static void init();
+
+    /// True if the driver lists the extension
+    static bool hasExtension(const std::string &name);
+
+    /// True if the driver lists the extension or the context version includes it as core feature
+    static bool supports(const std::string &extension);
+
+    /// True if the context is at least version major.minor
+    static bool version(int major, int minor);
+
+    static const Limits &limits();
+
+    /// glGetIntegerv of a single value, cached per pname
+    static GLint integer(GLenum pname);
+
+    /// Number of extensions listed by the driver
+    static size_t extensionCount();
+
+private:
+    static bool initialized_;
+    static int major_, minor_;
+    static Limits limits_;
+    static std::unordered_set<std::string> extensions_;
+    static std::unordered_map<GLenum, GLint> integers_;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+
+/// Shadow of the GL binding and fixed function state of the current context. Calls that would not
+/// change the state are dropped before they reach the driver, which matters on CPU-bound frames.
+/// The shadow is only right if every change goes through here: after code that calls GL directly
+/// (SOIL, other libraries) call invalidate(). GL thread only.
+class GLState {
+public:
+    static void useProgram(GLuint program);
+
+    /// Changing the VAO also changes the element array buffer binding, which is VAO state
+    static void bindVertexArray(GLuint vao);
+
+    static void activeTexture(GLenum unit);
+
+    /// Bind to the active texture unit
+    static void bindTexture(GLenum target, GLuint texture);
+
+    /// Bind to the given unit (0, 1, ...), the active unit only changes if the binding does
+    static void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+    static void bindBuffer(GLenum target, GLuint buffer);
+
+    /// Bind a range to an indexed binding point. Always issued, but the generic binding it also changes
+    /// is recorded
+    static void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+    static void enable(GLenum capability);
+    static void disable(GLenum capability);
+
+    static void clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+
+    /// Core profiles only have GL_FRONT_AND_BACK
+    static void polygonMode(GLenum mode);
+
+    static void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+    /// Delete through here so a new object that reuses the name is not taken as already bound
+    static void deleteProgram(GLuint program);
+    static void deleteVertexArrays(GLsizei count, const GLuint *vaos);
+    static void deleteTextures(GLsizei count, const GLuint *textures);
+    static void deleteBuffers(GLsizei count, const GLuint *buffers);
+
+    /// Forget all shadowed state, the next call of each kind reaches the driver
+    static void invalidate();
+
+    /// Calls passed on to GL and calls dropped since the last resetCounters()
+    static size_t issued();
+    static size_t elided();
+    static void resetCounters();
+};
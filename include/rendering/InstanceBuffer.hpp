@@ -0,0 +1,59 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <rendering/Mesh.hpp>
+#include <rendering/StreamBuffer.hpp>
+
+#include <vector>
+
+/// Per-instance model matrices for a mesh, drawn with one instanced call. The matrices live in their
+/// own buffer, attached to the mesh VAO as a mat4 attribute (four consecutive locations) that
+/// advances once per instance.
+class InstanceBuffer {
+public:
+    /// Attach to the mesh, the matrix takes locations location..location+3 of its VAO
+    explicit InstanceBuffer(const Mesh &mesh, GLuint location = 2);
+
+    ~InstanceBuffer();
+
+    InstanceBuffer(const InstanceBuffer &) = delete;
+    InstanceBuffer &operator=(const InstanceBuffer &) = delete;
+
+    /// Replace the transforms, contiguous and in draw order. The buffer is orphaned first so the
+    /// upload does not wait for draws still reading the previous contents
+    void update(const glm::mat4 *transforms, size_t count);
+
+    inline void update(const std::vector<glm::mat4> &transforms) {
+        update(transforms.data(), transforms.size());
+    }
+
+    /// Write the transforms into this frame's slice of the stream and draw from there, for instances
+    /// that move every frame. Falls back to update() if the stream is full
+    void update(StreamBuffer &stream, const glm::mat4 *transforms, size_t count);
+
+    inline void update(StreamBuffer &stream, const std::vector<glm::mat4> &transforms) {
+        update(stream, transforms.data(), transforms.size());
+    }
+
+    /// Draw the mesh once per transform
+    void draw() const;
+
+    inline size_t count() const {
+        return count_;
+    }
+
+private:
+    /// Point the matrix attribute at the transforms starting at offset in buffer
+    void attach(GLuint buffer, GLintptr offset);
+
+    const Mesh &mesh_;
+    GLuint location_;
+    GLuint buffer_ = 0;
+    GLuint source_ = 0;
+    GLintptr source_offset_ = 0;
+    size_t capacity_ = 0;
+    size_t count_ = 0;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <vector>
+#include <cstdint>
+
+/// Indexed triangle mesh with interleaved float vertices in one VAO. Duplicate vertices are welded,
+/// triangles are reordered for the post-transform vertex cache and vertices for fetch locality,
+/// and indices are stored as 16-bit whenever the vertex count allows it.
+class Mesh {
+public:
+    /// One float vertex attribute, attributes are interleaved in the order given
+    struct Attribute {
+        GLuint location;
+        GLint components;
+    };
+
+    /// Weld an unindexed triangle list (3 vertices per triangle) of interleaved vertices and upload it
+    Mesh(const GLfloat *vertices, size_t vertex_count, const std::vector<Attribute> &layout);
+
+    /// Upload an indexed triangle list, vertices are welded as well
+    Mesh(const std::vector<GLfloat> &vertices, const std::vector<uint32_t> &indices,
+         const std::vector<Attribute> &layout);
+
+    ~Mesh();
+
+    Mesh(const Mesh &) = delete;
+    Mesh &operator=(const Mesh &) = delete;
+
+    /// Bind the VAO and draw all triangles
+    void draw() const;
+
+    inline GLuint vao() const {
+        return vao_;
+    }
+
+    inline GLuint vertexBuffer() const {
+        return vbo_;
+    }
+
+    inline GLuint indexBuffer() const {
+        return ebo_;
+    }
+
+    inline GLsizei indexCount() const {
+        return index_count_;
+    }
+
+    /// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    inline GLenum indexType() const {
+        return index_type_;
+    }
+
+    /// Vertices after welding
+    inline size_t vertexCount() const {
+        return vertex_count_;
+    }
+
+    /// Merge bitwise identical vertices (stride in floats). Fills vertices with the unique ones in
+    /// order of first appearance and indices with one entry per input index
+    static void weld(const GLfloat *input, size_t input_count, size_t stride, const uint32_t *input_indices,
+                     size_t index_count, std::vector<GLfloat> &vertices, std::vector<uint32_t> &indices);
+
+    /// Reorder triangles for the post-transform vertex cache, Forsyth's linear-speed algorithm
+    static void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertex_count);
+
+    /// Renumber vertices in order of first use so that fetches walk the buffer forwards, unused
+    /// vertices are dropped
+    static void optimizeVertexFetch(std::vector<GLfloat> &vertices, size_t stride, std::vector<uint32_t> &indices);
+
+    /// Average vertex shader invocations per triangle with a FIFO cache of the given size,
+    /// 0.5 is the ideal for large regular meshes and 3 means no reuse at all
+    static float averageCacheMissRatio(const std::vector<uint32_t> &indices, size_t vertex_count,
+                                       size_t cache_size = 16);
+
+private:
+    GLuint vao_ = 0;
+    GLuint vbo_ = 0;
+    GLuint ebo_ = 0;
+    GLsizei index_count_ = 0;
+    GLenum index_type_ = GL_UNSIGNED_INT;
+    size_t vertex_count_ = 0;
+
+    void build(std::vector<GLfloat> &vertices, std::vector<uint32_t> &indices, const std::vector<Attribute> &layout);
+};
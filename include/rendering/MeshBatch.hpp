@@ -0,0 +1,114 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <rendering/Mesh.hpp>
+
+#include <vector>
+#include <cstdint>
+
+/// Many meshes of one vertex layout packed into shared vertex and index buffers, drawn per material
+/// bucket with a single glMultiDrawElementsIndirect (GL 4.3, base instance from 4.2). Submissions of
+/// the same mesh in a bucket become one command with an instance count, and each object's model
+/// matrix is a per-instance mat4 attribute found through the command's base instance.
+/// Without multi draw indirect every command is a glDrawElementsInstancedBaseVertex instead, so the
+/// CPU cost follows the number of distinct meshes per bucket, not the number of objects.
+class MeshBatch {
+public:
+    typedef uint32_t MeshId;
+
+    /// The model matrix takes locations transform_location..transform_location+3
+    explicit MeshBatch(const std::vector<Mesh::Attribute> &layout, GLuint transform_location = 2);
+
+    ~MeshBatch();
+
+    MeshBatch(const MeshBatch &) = delete;
+    MeshBatch &operator=(const MeshBatch &) = delete;
+
+    /// Add an unindexed triangle list, welded and optimized like Mesh. Geometry is uploaded on the next draw
+    MeshId add(const GLfloat *vertices, size_t vertex_count);
+
+    /// Add an indexed triangle list
+    MeshId add(const std::vector<GLfloat> &vertices, const std::vector<uint32_t> &indices);
+
+    /// Forget the submissions of the last frame
+    void clear();
+
+    /// Queue one object, bucket is the material it is drawn with
+    void submit(uint32_t bucket, MeshId mesh, const glm::mat4 &transform);
+
+    /// Draw everything submitted to the bucket, bind its shader and textures first.
+    /// The first draw after submitting builds and uploads the commands of all buckets
+    void draw(uint32_t bucket);
+
+    /// Draw calls the bucket needs: 1 with multi draw indirect, else its command count
+    size_t drawCalls(uint32_t bucket);
+
+    /// Objects submitted since clear()
+    inline size_t objectCount() const {
+        return submissions_.size();
+    }
+
+    static bool multiDrawIndirectSupported();
+
+private:
+    /// Layout fixed by GL for indirect element draws
+    struct DrawElementsIndirectCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    struct Range {
+        GLuint firstIndex;
+        GLuint indexCount;
+        GLint baseVertex;
+    };
+
+    struct Submission {
+        uint64_t key;
+        glm::mat4 transform;
+    };
+
+    struct Bucket {
+        size_t firstCommand;
+        size_t commandCount;
+    };
+
+    std::vector<Mesh::Attribute> layout_;
+    size_t stride_;
+    GLuint transform_location_;
+    bool indirect_;
+
+    GLuint vao_ = 0;
+    GLuint vertex_buffer_ = 0;
+    GLuint index_buffer_ = 0;
+    GLuint transform_buffer_ = 0;
+    GLuint indirect_buffer_ = 0;
+    size_t transform_capacity_ = 0;
+    size_t indirect_capacity_ = 0;
+
+    // Geometry, kept on the CPU until uploaded
+    std::vector<GLfloat> vertices_;
+    std::vector<uint32_t> indices_;
+    std::vector<Range> ranges_;
+    size_t largest_mesh_ = 0;
+    GLenum index_type_ = GL_UNSIGNED_SHORT;
+    bool geometry_dirty_ = false;
+
+    // Per frame
+    std::vector<Submission> submissions_;
+    std::vector<DrawElementsIndirectCommand> commands_;
+    std::vector<Bucket> buckets_;
+    bool commands_dirty_ = false;
+
+    MeshId addWelded(std::vector<GLfloat> &vertices, std::vector<uint32_t> &indices);
+
+    void uploadGeometry();
+
+    void buildCommands();
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+
+/// On-disk cache of linked program binaries (ARB_get_program_binary / GL 4.1).
+/// Binaries are keyed on every stage source plus the GL vendor/renderer/version
+/// strings, so a driver update or a different GPU simply misses the cache.
+class ProgramBinaryCache {
+public:
+    /// Enable the cache, binaries are stored as <directory>/<key>.bin. Requires a current GL context
+    static void setDirectory(const std::string &directory);
+
+    /// True if a directory is set and the driver can save and load program binaries
+    static bool isEnabled();
+
+    /// Key for a program built from the given stage sources (order matters)
+    static std::string makeKey(const std::vector<GLuint> &stage_types, const std::vector<std::string> &sources);
+
+    /// Load a cached binary into program. Returns false on a miss or if the driver rejects the binary
+    static bool load(const std::string &key, GLuint program);
+
+    /// Store the binary of a successfully linked program
+    static void store(const std::string &key, GLuint program);
+
+private:
+    static std::string directory_;
+    static bool supported_;
+
+    static std::string pathForKey(const std::string &key);
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <rendering/Mesh.hpp>
+#include <rendering/ShaderProgram.hpp>
+
+#include <vector>
+#include <cstdint>
+
+/// Draws recorded during the frame and executed in the order of a 64-bit sort key instead of code order.
+/// From the most significant bits down the key holds the pass, the program, the material and the
+/// quantized view depth, so program and texture changes are grouped and opaque geometry is drawn front
+/// to back for early depth rejection. Keys are radix sorted, linear in the number of draws.
+class RenderQueue {
+public:
+    typedef uint16_t MaterialId;
+
+    /// Returned by addMaterial() when the key has no room for another program or material
+    static const MaterialId INVALID_MATERIAL = 0xFFFF;
+
+    /// Passes execute in this order. Transparent draws are sorted back to front within a material
+    enum Pass {
+        PASS_OPAQUE = 0,
+        PASS_TRANSPARENT = 1
+    };
+
+    /// A sorted entry, index refers to the recorded draw
+    struct Item {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    /// A program and the textures it samples, bound to units 0, 1, ... in order. The program takes the
+    /// model matrix as mat4 uniform "M" and the camera from the Frame block, the sampler uniforms are left
+    /// to the caller. Up to 4096 programs and 65535 materials fit the sort key, beyond that INVALID_MATERIAL
+    /// is returned and draws with it are dropped
+    MaterialId addMaterial(ShaderProgram &program, const std::vector<GLuint> &textures);
+
+    /// Swap the textures of a material, e.g. when a streamed texture became resident
+    void setTextures(MaterialId material, const std::vector<GLuint> &textures);
+
+    /// Start recording a frame, draws deeper than far_plane share the last depth bucket. The view only
+    /// orders the draws, shaders get it from the Frame block
+    void begin(const glm::mat4 &view, float far_plane);
+
+    /// Record a draw of the mesh, the mesh must outlive execute()
+    void submit(Pass pass, MaterialId material, const Mesh &mesh, const glm::mat4 &model);
+
+    /// Sort the recorded draws and issue them
+    void execute();
+
+    /// Draws recorded since begin()
+    inline size_t size() const {
+        return draws_.size();
+    }
+
+    /// Pass in bits 60-63, program in 48-59, material in 32-47, depth (0 near, 1 far) in 8-31
+    static uint64_t makeKey(Pass pass, uint32_t program, uint32_t material, float depth);
+
+    /// Ascending LSD radix sort on the key, 8 bits per pass. Passes where every key has the same
+    /// digit are skipped, which are most of them for the usual handful of programs and materials
+    static void radixSort(std::vector<Item> &items, std::vector<Item> &scratch);
+
+private:
+    struct Material {
+        uint32_t program;
+        std::vector<GLuint> textures;
+    };
+
+    struct Program {
+        ShaderProgram *program;
+        ShaderProgram::UniformHandle m;
+    };
+
+    struct Draw {
+        const Mesh *mesh;
+        MaterialId material;
+        glm::mat4 model;
+    };
+
+    std::vector<Program> programs_;
+    std::vector<Material> materials_;
+
+    glm::mat4 view_;
+    float far_plane_ = 100.0f;
+
+    std::vector<Draw> draws_;
+    std::vector<Item> items_;
+    std::vector<Item> scratch_;
+};
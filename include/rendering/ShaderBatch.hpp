@@ -0,0 +1,42 @@
+#pragma once
+
+#include <rendering/ShaderProgram.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+
+/// Builds many shader programs at once. All compiles and links are submitted before any
+/// status is queried, so drivers with parallel shader compile overlap the work instead of
+/// serializing one synchronous compile per stage per program.
+class ShaderBatch {
+public:
+    /// Asks the driver for as many compiler threads as it likes when parallel compile is supported
+    ShaderBatch();
+
+    /// Submit a program, it is usable once finish() has returned. The defines select the variant as for
+    /// ShaderProgram
+    std::shared_ptr<ShaderProgram> add(std::string vertex_shader_filename = "",
+                                       std::string tessellation_control_shader_filename = "",
+                                       std::string tessellation_eval_shader_filename = "",
+                                       std::string geometry_shader_filename = "",
+                                       std::string fragment_shader_filename = "",
+                                       const ShaderDefines &defines = ShaderDefines());
+
+    /// Wait for every submitted program, returns the number of programs that failed to build
+    int finish();
+
+    /// Print per-program compile and link wall time of the last finish()
+    void printTimings(std::ostream &os = std::cout) const;
+
+private:
+    struct Entry {
+        std::string name;
+        std::shared_ptr<ShaderProgram> program;
+        bool done;
+        bool success;
+    };
+
+    std::vector<Entry> entries_;
+};
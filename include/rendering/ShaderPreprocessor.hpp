@@ -0,0 +1,27 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/// Preprocessor defines injected into a shader, e.g. {"USE_NORMAL_MAP", "1"}. Ordered so equal sets hash equally
+typedef std::map<std::string, std::string> ShaderDefines;
+
+/// Resolves #include "file" against the shader include directory and injects #defines after #version.
+/// Each file is included at most once per stage, and #line directives keep compiler errors pointing at
+/// the right file: the source string number is the order in which the stage read the file (0 = the stage).
+class ShaderPreprocessor {
+public:
+    /// Directory that #include paths are resolved against
+    static void setIncludeDirectory(const std::string &directory);
+
+    /// Preprocess a stage. Every file read (the stage itself first) is appended to dependencies
+    static std::string process(const std::string &filename, const ShaderDefines &defines,
+                               std::vector<std::string> &dependencies);
+
+private:
+    static std::string include_directory_;
+
+    static void expand(size_t source_index, std::vector<std::string> &files, std::string &out);
+};
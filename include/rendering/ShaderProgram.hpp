@@ -4,35 +4,108 @@
 
 #include <GLFW/glfw3.h>
 
+#include <glm/glm.hpp>
+
+#include <common/FileWatcher.hpp>
+#include <rendering/ShaderPreprocessor.hpp>
+#include <rendering/GLState.hpp>
+
 #include <string>
 #include <vector>
+#include <unordered_map>
 #include <iostream>
+#include <chrono>
 
 /// Adapted from http://stackoverflow.com/questions/2795044/easy-framework-for-opengl-shaders-in-c-c
 
 class ShaderProgram {
 public:
-    /// Constructs a GLSL shader program with V/TC/TE/G/F-shaders located in the specified files
+    /// Handle to an active uniform, -1 if the uniform is not active in the program
+    typedef GLint UniformHandle;
+
+    /// Constructs a GLSL shader program with V/TC/TE/G/F-shaders located in the specified files.
+    /// Sources go through ShaderPreprocessor, so #include and the given defines are resolved first
     ShaderProgram(std::string vertex_shader_filename = "",
                   std::string tessellation_control_shader_filename = "",
                   std::string tessellation_eval_shader_filename = "",
                   std::string geometry_shader_filename = "",
-                  std::string fragment_shader_filename = "");
+                  std::string fragment_shader_filename = "",
+                  const ShaderDefines &defines = ShaderDefines());
+
+    /// Tag selecting the deferred constructor, see ShaderBatch
+    struct Deferred {};
+
+    /// Submits the compile and link of the program without waiting on the driver, call finish() before use
+    ShaderProgram(Deferred,
+                  std::string vertex_shader_filename,
+                  std::string tessellation_control_shader_filename,
+                  std::string tessellation_eval_shader_filename,
+                  std::string geometry_shader_filename,
+                  std::string fragment_shader_filename,
+                  const ShaderDefines &defines = ShaderDefines());
+
+    /// True once the driver has finished compiling and linking. Always true without parallel shader compile
+    bool isReady();
+
+    /// Wait for the compile and link, check their status and reflect the uniforms. Returns false on failure
+    bool finish();
+
+    /// Wall time from submit until all stages compiled and until the program linked, valid after finish()
+    double compileMilliseconds() const;
+    double linkMilliseconds() const;
+
+    /// Register the source files of every stage, includes too, with a watcher
+    void watch(FileWatcher &watcher);
+
+    /// True if the program is built from the given file, either a stage or an included file
+    bool dependsOn(const std::string &filename) const;
+
+    /// Rebuild from the source files. The program handle is only swapped after a successful link,
+    /// on failure the old program stays active and the error is available from log()
+    bool reload();
+
+    /// Compile and link log of the last failed build, empty after a successful one
+    inline const std::string &log() const {
+        return log_;
+    }
+
+    /// True if the driver compiles in the background (ARB/KHR_parallel_shader_compile, same tokens)
+    static bool parallelCompileSupported();
+
+    /// Attach every uniform block with this name to the binding point, in programs built or reloaded
+    /// afterwards. Blocks shared by all programs, like the per-frame camera, are then bound once per frame
+    /// with glBindBufferRange instead of being set in each program
+    static void bindUniformBlock(const std::string &block_name, GLuint binding);
 
     /// Get the GLuint corresponding to the OpenGL shader program
     inline operator GLuint() {
         return prog;
     }
 
-    /// Activate the shader program
+    /// Activate the shader program, skipped if it is already active
     inline void operator()() {
-        glUseProgram(prog);
+        GLState::useProgram(prog);
     }
 
     static const std::string getShaderType(GLuint type);
 
-    GLint MV_Loc, P_Loc, lDir_Loc, camPos_Loc = -1;
-    GLint tmpTex = -1;
+    /// Get the handle of an active uniform, resolve once and reuse the handle in the render loop
+    UniformHandle getUniformHandle(const std::string &name) const;
+
+    /// Upload a uniform value to the bound program, skipped if the value equals the last upload
+    void set(UniformHandle handle, GLint value);
+    void set(UniformHandle handle, GLfloat value);
+    void set(UniformHandle handle, const glm::vec2 &value);
+    void set(UniformHandle handle, const glm::vec3 &value);
+    void set(UniformHandle handle, const glm::vec4 &value);
+    void set(UniformHandle handle, const glm::mat3 &value);
+    void set(UniformHandle handle, const glm::mat4 &value);
+
+    /// Convenience setter by name, prefer the handle version in hot loops
+    template<typename T>
+    inline void set(const std::string &name, const T &value) {
+        set(getUniformHandle(name), value);
+    }
 
     ~ShaderProgram();
 
@@ -42,8 +115,50 @@ protected:
     void ConfigureShaderProgram();
 
 private:
+    typedef std::chrono::high_resolution_clock Clock;
+
+    /// Reflected active uniform with a shadow copy of its last uploaded value
+    struct Uniform {
+        std::string name;
+        GLint location;
+        GLenum type;
+        GLint size;
+        bool uploaded;
+        GLfloat value[16];
+    };
+
     std::vector<GLuint> shader_programs_;
+    std::vector<GLuint> shader_types_;
+    std::vector<std::string> stage_filenames_;
+    std::vector<std::string> dependencies_;
+    ShaderDefines defines_;
+    FileWatcher *watcher_ = nullptr;
     GLuint prog;
+    std::string log_;
+
+    std::string cache_key_;
+    bool from_cache_ = false;
+    bool finished_ = false;
+    bool compiled_ = false;
+    bool linked_ = false;
+    Clock::time_point submit_time_, compile_done_time_, link_done_time_;
+
+    std::vector<Uniform> uniforms_;
+    std::unordered_map<std::string, UniformHandle> uniform_handles_;
+
+    static std::unordered_map<std::string, GLuint> block_bindings_;
 
     GLuint compile(GLuint type, GLchar const *source);
-};
\ No newline at end of file
+
+    bool CheckCompileStatus(GLuint shader, GLuint type);
+
+    bool CheckLinkStatus();
+
+    void SubmitProgram(const std::vector<GLuint> &types, const std::vector<std::string> &sources);
+
+    void QueryUniforms();
+
+    void BindUniformBlocks();
+
+    bool UpdateUniformCache(UniformHandle handle, const void *value, size_t bytes);
+};
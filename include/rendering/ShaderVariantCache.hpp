@@ -0,0 +1,47 @@
+#pragma once
+
+#include <rendering/ShaderProgram.hpp>
+#include <rendering/ShaderPreprocessor.hpp>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+/// Hands out shader program permutations, compiling each (stage files, define set) combination
+/// at most once per process. Programs stay alive as long as the cache does, and keep their identity
+/// across hot reloads: a reloaded variant is still the one returned for its files and defines.
+class ShaderVariantCache {
+public:
+    /// Get the program for the given stages and defines, compiling it on the first request. A lookup
+    /// touches no files. Returns an empty pointer if the first build fails, the log is printed and the
+    /// next request tries again
+    std::shared_ptr<ShaderProgram> get(const std::string &vertex_shader_filename,
+                                       const std::string &fragment_shader_filename,
+                                       const ShaderDefines &defines = ShaderDefines(),
+                                       const std::string &geometry_shader_filename = "");
+
+    /// Number of distinct permutations compiled so far
+    inline size_t size() const {
+        return programs_.size();
+    }
+
+    /// Register every cached program with a watcher for hot reload
+    void watch(FileWatcher &watcher);
+
+    /// Reload the programs that depend on any of the changed files
+    void reload(const std::vector<std::string> &changed_files);
+
+private:
+    struct Variant {
+        std::string vertex_shader_filename;
+        std::string fragment_shader_filename;
+        std::string geometry_shader_filename;
+        ShaderDefines defines;
+        std::shared_ptr<ShaderProgram> program;
+    };
+
+    std::unordered_map<std::string, Variant> programs_;
+
+    static std::string makeKey(const std::string &vertex_shader_filename, const std::string &fragment_shader_filename,
+                            const ShaderDefines &defines, const std::string &geometry_shader_filename);
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <vector>
+
+/// Ring of per-frame regions in one buffer for data written every frame: transforms, particles, uniform
+/// blocks. With ARB_buffer_storage (GL 4.4) the buffer is persistently mapped and a slice is written in
+/// place; on GL 3.3 slices are written to client memory and copied in by flush() through an
+/// unsynchronized map. A fence per region guards reuse, so the GPU reading frame N never stalls the
+/// CPU writing frame N+1. Should the GPU fall further behind than the ring, the 3.3 path orphans the
+/// buffer instead of waiting.
+class StreamBuffer {
+public:
+    /// Where to write and what to bind, data is NULL if the frame's region was full
+    struct Slice {
+        void *data;
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    /// frame_bytes is the most one frame can allocate, the buffer holds frames of them
+    explicit StreamBuffer(size_t frame_bytes, unsigned int frames = 3);
+
+    ~StreamBuffer();
+
+    StreamBuffer(const StreamBuffer &) = delete;
+    StreamBuffer &operator=(const StreamBuffer &) = delete;
+
+    /// Move on to the next region, waiting only if the GPU still reads it
+    void beginFrame();
+
+    /// Slice of the current region starting at a multiple of alignment (a power of two, at most 256),
+    /// e.g. GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT for uniform blocks
+    Slice allocate(size_t bytes, size_t alignment = 16);
+
+    /// Make slices written so far visible to GL, call before the draws that read them
+    void flush();
+
+    /// Flush and fence the region, call after the last draw that reads this frame's slices
+    void endFrame();
+
+    inline GLuint buffer() const {
+        return buffer_;
+    }
+
+    /// True if the buffer is persistently mapped
+    inline bool persistent() const {
+        return persistent_;
+    }
+
+    /// Frames that found their region still in use, waited for on 4.4 and orphaned on 3.3
+    inline size_t stalls() const {
+        return stalls_;
+    }
+
+private:
+    GLuint buffer_ = 0;
+    size_t frame_bytes_;
+    unsigned int frames_;
+    bool persistent_ = false;
+    unsigned char *mapped_ = NULL;
+    std::vector<unsigned char> staging_;
+    std::vector<GLsync> fences_;
+
+    unsigned int frame_;
+    size_t head_ = 0;
+    size_t flushed_ = 0;
+    size_t stalls_ = 0;
+};
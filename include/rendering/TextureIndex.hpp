@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/// Size and channel count of every image below a directory, read from the file headers alone on a
+/// pool of threads, for planning atlases and texture memory before anything is decoded.
+class TextureIndex {
+public:
+    struct Entry {
+        std::string path;
+        int width;
+        int height;
+        int channels; ///< As SOIL_load_image reports them with SOIL_LOAD_AUTO, for DDS as the header declares them
+    };
+
+    /// Index every jpg/png/bmp/tga/psd/hdr/dds file below directory, 0 threads uses one per CPU.
+    /// Files whose header can't be read are left out
+    explicit TextureIndex(const std::string &directory, unsigned int threads = 0);
+
+    /// Sorted by path
+    const std::vector<Entry> &entries() const;
+
+    /// The entry for a path as listed (directory + '/' + relative path), NULL if it isn't indexed
+    const Entry *find(const std::string &path) const;
+
+    /// Bytes the indexed images take decoded at their own channel count, without mip maps. An estimate for
+    /// DDS files, whose loaded channel count can differ from the header's by the alpha channel
+    size_t decodedBytes() const;
+
+private:
+    std::vector<Entry> entries_;
+};
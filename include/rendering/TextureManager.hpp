@@ -6,13 +6,111 @@
 
 #include <GL/glew.h>
 
-GLuint makeBO(GLenum type, void* data, GLsizei size, int accessFlags);
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+
+GLuint makeBO(GLenum type, void* data, GLsizei size, GLenum accessFlags);
+
+int mipLevelCount(int w, int h);
+
+void allocateTexture2D(GLsizei levels, GLint internalFormat, GLsizei w, GLsizei h, GLenum format, GLenum type);
 
 GLuint makeTextureBuffer(int w, int h, GLenum format, GLint internalFormat);
 
 GLuint loadTexture(const char *filename);
 
+GLuint loadCompressedTexture(const char *filename);
+
 char* loadFile(char* name);
 GLuint genFloatTexture(float *data, int width, int height);
+GLuint genCompressedFloatTexture(const float *data, int width, int height);
+
+float* loadPGM(const char* fileName, int w, int h);
+
+class TextureManager;
+
+/// Reference counted handle to a texture owned by a TextureManager, which must outlive it.
+/// The texture stays resident while any handle to it exists.
+class TextureHandle {
+public:
+    TextureHandle();
+
+    TextureHandle(const TextureHandle &other);
+
+    TextureHandle(TextureHandle &&other);
+
+    TextureHandle &operator=(TextureHandle other);
+
+    ~TextureHandle();
+
+    /// The GL texture, 0 for an empty handle or a file that failed to load
+    GLuint id() const;
+
+    inline operator GLuint() const {
+        return id();
+    }
+
+private:
+    friend class TextureManager;
+
+    TextureHandle(TextureManager *manager, size_t slot);
+
+    TextureManager *manager_;
+    size_t slot_;
+};
+
+/// Path-keyed texture registry. Loading the same file twice gives the same GPU texture, and textures
+/// without handles are kept around for reuse until the GPU memory budget forces them out, least
+/// recently released first.
+class TextureManager {
+public:
+    explicit TextureManager(size_t budget_bytes = 512 << 20);
+
+    ~TextureManager();
+
+    TextureManager(const TextureManager &) = delete;
+    TextureManager &operator=(const TextureManager &) = delete;
+
+    /// Texture for a file, loaded through SOIL on first use. channels is one of SOIL_LOAD_AUTO/L/LA/RGB/RGBA.
+    /// If the load fails the handle is empty (id 0) and nothing is cached, the next call loads again
+    TextureHandle acquire(const std::string &filename, int channels = 0);
+
+    /// Change the budget, evicting unreferenced textures if the new one is exceeded
+    void setBudget(size_t budget_bytes);
+
+    /// Estimated GPU memory of all resident textures, mip chains included
+    inline size_t residentBytes() const {
+        return resident_bytes_;
+    }
+
+    /// Number of resident textures, referenced or not
+    inline size_t size() const {
+        return slots_.size();
+    }
+
+private:
+    friend class TextureHandle;
+
+    struct Texture {
+        std::string key;
+        GLuint id;
+        size_t bytes;
+        int references;
+        std::list<size_t>::iterator lru;
+    };
+
+    std::vector<Texture> textures_;
+    std::unordered_map<std::string, size_t> slots_;
+    std::vector<size_t> free_slots_;
+    std::list<size_t> lru_;
+    size_t budget_bytes_;
+    size_t resident_bytes_;
+
+    void addReference(size_t slot);
+
+    void release(size_t slot);
 
-float* loadPGM(const char* fileName, int w, int h);
\ No newline at end of file
+    void evict();
+};
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+
+/// Streams textures from disk: images are decoded on a pool of worker threads and uploaded
+/// on the GL thread through a pixel buffer ring, a limited amount of work per frame.
+/// Every requested texture is usable right away, it shows a placeholder until its upload is done.
+class TextureStreamer {
+public:
+    typedef size_t TextureId;
+
+    /// Start the decode workers, 0 threads picks one per core (leaving one for the GL thread). Switches
+    /// the SOIL/stb decoders to single-threaded for the whole process, parallelism is across images here
+    explicit TextureStreamer(unsigned int threads = 0, size_t staging_bytes = 64 << 20);
+
+    ~TextureStreamer();
+
+    TextureStreamer(const TextureStreamer &) = delete;
+    TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+    /// Queue a file for decoding, channels is one of SOIL_LOAD_AUTO/L/LA/RGB/RGBA
+    TextureId request(const std::string &filename, int channels = 0);
+
+    /// Upload decoded images until the time budget is spent (at least one per call). GL thread only
+    void update(double budget_ms);
+
+    /// Block until every requested texture is resident or failed, e.g. behind a loading screen
+    void finish();
+
+    /// The texture to bind: the placeholder until the upload completed
+    GLuint texture(TextureId id) const;
+
+    bool isResident(TextureId id) const;
+
+    /// Number of requested textures that are neither resident nor failed
+    size_t pending() const;
+
+private:
+    struct Job {
+        TextureId id;
+        std::string filename;
+        int channels;
+    };
+
+    struct Decoded {
+        TextureId id;
+        int width;
+        int height;
+        int channels;
+        unsigned char *pixels;
+        std::string error; // SOIL's result on the decoding thread, if pixels is NULL
+    };
+
+    struct Entry {
+        std::string filename;
+        GLuint texture;
+        bool resident;
+        bool failed;
+    };
+
+    struct InFlight {
+        GLsync fence;
+        size_t begin;
+    };
+
+    // Shared with the workers
+    std::deque<Job> jobs_;
+    std::deque<Decoded> decoded_;
+    std::mutex mutex_;
+    std::condition_variable jobs_available_;
+    std::vector<std::thread> workers_;
+    std::atomic<bool> running_;
+
+    // GL thread only
+    std::vector<Entry> entries_;
+    std::deque<Decoded> uploads_;
+    std::deque<InFlight> in_flight_;
+    GLuint placeholder_;
+    GLuint staging_buffer_;
+    unsigned char *staging_ptr_;
+    size_t staging_size_;
+    size_t staging_head_;
+    bool persistent_;
+
+    void work();
+
+    bool allocateStaging(size_t bytes, size_t &offset);
+
+    void retireStaging(bool wait);
+
+    void upload(const Decoded &image);
+};
@@ -13,17 +13,28 @@
 // GLFW, window handler
 #include <GLFW/glfw3.h>
 
+#include <rendering/GLCapabilities.hpp>
+#include <rendering/GLState.hpp>
+#include <rendering/Mesh.hpp>
+#include <rendering/InstanceBuffer.hpp>
+#include <rendering/StreamBuffer.hpp>
+#include <rendering/FrameUniforms.hpp>
+#include <rendering/MeshBatch.hpp>
+#include <rendering/RenderQueue.hpp>
 #include <rendering/ShaderProgram.hpp>
+#include <rendering/ProgramBinaryCache.hpp>
 #include <rendering/TextureManager.hpp>
+#include <rendering/TextureStreamer.hpp>
 #include <SOIL.h>
 #include <math/randomized.hpp>
 #include <common/Navigation.hpp>
+#include <common/FileWatcher.hpp>
 #include <sstream>
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 
-void setWindowFPS(GLFWwindow *window, float fps);
+void setWindowFPS(GLFWwindow *window, float fps, float issued_per_frame, float elided_per_frame);
 
 std::chrono::duration<double> second_accumulator;
 unsigned int frames_last_second;
@@ -82,11 +93,12 @@ int main(void)
     int width, height;
 
     /**************** OpenGL functions ******************/
-    GLint nrAttributes;
-    glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &nrAttributes);
-    std::cout << "Maximum nr of vertex attributes supported: " << nrAttributes << std::endl;
+    // Extensions and limits are read once, SOIL answers its capability checks from them too
+    GLCapabilities::init();
+    std::cout << GLCapabilities::extensionCount() << " extensions, maximum nr of vertex attributes supported: "
+              << GLCapabilities::limits().maxVertexAttribs << std::endl;
 
-    glEnable(GL_DEPTH_TEST);
+    GLState::enable(GL_DEPTH_TEST);
     //glDepthFunc(GL_LESS);
     //glEnable(GL_CULL_FACE);
     //glCullFace(GL_BACK);
@@ -147,91 +159,80 @@ int main(void)
             -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
             -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
     };
-    GLuint indices[] = {
-            0, 1, 3,    // First triangle
-            1, 2, 3     // Second triangle
-    };
-
-
-    /****************** EBOs ****************************/
-    GLuint temp_ebo;
-    glGenBuffers(1, &temp_ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, temp_ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
+    GLfloat pyramidVertices[] = { // Square pyramid
+            -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+            0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
+            0.5f, -0.5f,  0.5f,  1.0f, 1.0f,
+            0.5f, -0.5f,  0.5f,  1.0f, 1.0f,
+            -0.5f, -0.5f,  0.5f,  0.0f, 1.0f,
+            -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
 
-    /****************** VBOs ****************************/
-    GLuint temp_vbo;
-    glGenBuffers(1, &temp_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, temp_vbo); //Can only bind one object to each buffer type
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
-    // How much will it move: not = GL_STATIC_DRAW, a lot = GL_DYNAMIC_DRAW, every render = GL_STREAM_DRAW
+            -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+            0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+            0.0f,  0.5f,  0.0f,  0.5f, 1.0f,
 
+            0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+            0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
+            0.0f,  0.5f,  0.0f,  0.5f, 1.0f,
 
-    /****************** VAOs ****************************/
-    GLuint temp_vao;
-    glGenVertexArrays(1, &temp_vao);
-    glBindVertexArray(temp_vao);
-    // Bind correct VBO and specify location (0)
-    glBindBuffer(GL_ARRAY_BUFFER, temp_vbo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, temp_ebo);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)0); //Positions
-    //glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat))); // Colors
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat))); //Texture Coords
+            0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+            -0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
+            0.0f,  0.5f,  0.0f,  0.5f, 1.0f,
 
-    // Enable all VAOs
-    glEnableVertexAttribArray(0);
-    //glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(1);
+            -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+            -0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+            0.0f,  0.5f,  0.0f,  0.5f, 1.0f
+    };
 
-    // Unbind VAO
-    glBindVertexArray(0);
+    /****************** Meshes **************************/
+    // The 36 listed vertices weld to 16 unique ones, drawn with 16-bit indices
+    Mesh cube(vertices, sizeof(vertices) / (5 * sizeof(GLfloat)), {{0, 3},   // Positions
+                                                                  {1, 2}}); // Texture Coords
+    std::cout << "Cube: " << cube.vertexCount() << " vertices, " << cube.indexCount() << " indices\n";
+    Mesh pyramid(pyramidVertices, sizeof(pyramidVertices) / (5 * sizeof(GLfloat)), {{0, 3}, {1, 2}});
+
+    // A field of small cubes around the center one, all drawn with a single instanced call
+    const int nrInstances = 100000;
+    std::vector<glm::vec3> instancePositions = generate_uniform_vec3s(nrInstances, -50.0f, 50.0f, -50.0f, 50.0f,
+                                                                      -50.0f, 50.0f);
+    std::vector<glm::mat4> instanceTransforms(nrInstances);
+    for (int i = 0; i < nrInstances; ++i) {
+        instanceTransforms[i] = glm::scale(glm::translate(glm::mat4(1.0f), instancePositions[i]), glm::vec3(0.25f));
+    }
+    InstanceBuffer cubeField(cube);
+    cubeField.update(instanceTransforms);
+
+    // A swarm of pyramids orbiting the center, rewritten every frame into the frame stream
+    StreamBuffer frameStream(1 << 20);
+    std::cout << "Frame stream: " << (frameStream.persistent() ? "persistently mapped" : "unsynchronized copies")
+              << "\n";
+    const int nrSwarmObjects = 2000;
+    std::vector<glm::vec3> swarmOrbits = generate_uniform_vec3s(nrSwarmObjects, 5.0f, 15.0f, -2.0f, 2.0f, 0.0f,
+                                                                6.2831853f);
+    std::vector<glm::mat4> swarmTransforms(nrSwarmObjects);
+    InstanceBuffer swarm(pyramid);
+
+    // Cubes and pyramids in shared buffers, one multi draw per material. The scene is static so it is
+    // submitted once, a moving one would clear() and submit again every frame
+    MeshBatch batch({{0, 3}, {1, 2}});
+    MeshBatch::MeshId batchMeshes[] = {batch.add(vertices, sizeof(vertices) / (5 * sizeof(GLfloat))),
+                                       batch.add(pyramidVertices, sizeof(pyramidVertices) / (5 * sizeof(GLfloat)))};
+    const int nrBatchObjects = 4000;
+    std::vector<glm::vec3> batchPositions = generate_uniform_vec3s(nrBatchObjects, -20.0f, 20.0f, -20.0f, 20.0f,
+                                                                   -20.0f, 20.0f);
+    for (int i = 0; i < nrBatchObjects; ++i) {
+        batch.submit(static_cast<uint32_t>(i / 2 % 2), batchMeshes[i % 2],
+                     glm::scale(glm::translate(glm::mat4(1.0f), batchPositions[i]), glm::vec3(0.5f)));
+    }
+    std::cout << "Batch: " << batch.objectCount() << " objects in " << batch.drawCalls(0) + batch.drawCalls(1)
+              << " draw calls\n";
 
     /****************** Textures ************************/
 
-    // Load image from file
-    int tex_w, tex_h;
-    unsigned char* tex_image = SOIL_load_image("../textures/container.jpg", &tex_w, &tex_h, 0, SOIL_LOAD_RGB);
-
-    // Generate texture object
-    GLuint texture1;
-    glGenTextures(1, &texture1);
-    glBindTexture(GL_TEXTURE_2D, texture1);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // Bind texture from image
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, tex_w, tex_h, 0, GL_RGB, GL_UNSIGNED_BYTE, tex_image);
-    glGenerateMipmap(GL_TEXTURE_2D); // Automatically generate mipmaps (instead of changing par 2 above)
-
-    // Free image memory
-    SOIL_free_image_data(tex_image);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    /*** TEX2 ***/
-    // Load image from file
-    tex_image = SOIL_load_image("../textures/awesomeface.png", &tex_w, &tex_h, 0, SOIL_LOAD_RGB);
-
-    // Generate texture object
-    GLuint texture2;
-    glGenTextures(1, &texture2);
-    glBindTexture(GL_TEXTURE_2D, texture2);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // Bind texture from image
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, tex_w, tex_h, 0, GL_RGB, GL_UNSIGNED_BYTE, tex_image);
-    glGenerateMipmap(GL_TEXTURE_2D); // Automatically generate mipmaps (instead of changing par 2 above)
-
-    // Free image memory
-    SOIL_free_image_data(tex_image);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // Decode on worker threads, textures show a placeholder until they are uploaded
+    TextureStreamer textureStreamer;
+    TextureStreamer::TextureId texture1 = textureStreamer.request("../textures/container.jpg", SOIL_LOAD_RGB);
+    TextureStreamer::TextureId texture2 = textureStreamer.request("../textures/awesomeface.png", SOIL_LOAD_RGB);
 
 
     /****************** FBOs ****************************/
@@ -239,14 +240,43 @@ int main(void)
 
 
     /****************** Shaders *************************/
+    // Reuse linked program binaries between launches
+    ProgramBinaryCache::setDirectory("../shader_cache");
+
+    // Camera and light come from the Frame block, uploaded once per frame for all programs
+    FrameUniforms::registerBlock();
+
     // Declare shader and bind it
     ShaderProgram tempShader("../shaders/template.vert", "", "", "", "../shaders/template.frag");
-
-    tempShader.MV_Loc = glGetUniformLocation(tempShader, "MV");
-    tempShader.P_Loc = glGetUniformLocation(tempShader, "P");
+    ShaderProgram instancedShader("../shaders/instanced.vert", "", "", "", "../shaders/template.frag");
+
+    // Recompile when the shader sources are edited
+    FileWatcher shaderWatcher;
+    tempShader.watch(shaderWatcher);
+    instancedShader.watch(shaderWatcher);
+
+    // Resolve uniform handles once, outside the render loop
+    ShaderProgram::UniformHandle tex1Handle = tempShader.getUniformHandle("ourTexture1");
+    ShaderProgram::UniformHandle tex2Handle = tempShader.getUniformHandle("ourTexture2");
+    ShaderProgram::UniformHandle instancedTex1Handle = instancedShader.getUniformHandle("ourTexture1");
+    ShaderProgram::UniformHandle instancedTex2Handle = instancedShader.getUniformHandle("ourTexture2");
+
+    /****************** Render queue ********************/
+    // The center cube and a ring of cubes and pyramids around it, drawn in sort key order
+    RenderQueue renderQueue;
+    RenderQueue::MaterialId crateMaterial = renderQueue.addMaterial(tempShader, {0, 0});
+    RenderQueue::MaterialId faceMaterial = renderQueue.addMaterial(tempShader, {0, 0});
+    const int nrRingObjects = 64;
+    std::vector<glm::mat4> ringTransforms(nrRingObjects);
+    for (int i = 0; i < nrRingObjects; ++i) {
+        float angle = glm::radians(360.0f * i / nrRingObjects);
+        ringTransforms[i] = glm::scale(glm::translate(glm::mat4(1.0f), 3.0f * glm::vec3(cos(angle), 0.0f, sin(angle))),
+                                       glm::vec3(0.4f));
+    }
 
     /****************** Uniform variables ***************/
-    glm::mat4 MV, V, P;
+    FrameUniforms frameUniforms;
+    glm::mat4 V, P;
     glm::vec3 lDir;
     glm::mat4 M = glm::mat4(1.0f);
 
@@ -256,6 +286,7 @@ int main(void)
     std::chrono::high_resolution_clock::time_point tp_last = std::chrono::high_resolution_clock::now();
     second_accumulator = std::chrono::duration<double>(0);
     frames_last_second = 0;
+    std::chrono::duration<double> elapsed(0);
 
 
     /******************* RENDER LOOP *********************/
@@ -265,6 +296,7 @@ int main(void)
         std::chrono::high_resolution_clock::time_point tp_now = std::chrono::high_resolution_clock::now();
         std::chrono::high_resolution_clock::duration delta_time = tp_now - tp_last;
         tp_last = tp_now;
+        elapsed += delta_time;
 
         std::chrono::milliseconds dt_ms = std::chrono::duration_cast<std::chrono::milliseconds>(delta_time);
 
@@ -275,15 +307,29 @@ int main(void)
         //dt_s = std::min(dt_s, 1.0f / 60.0f);
         /*----------------------------------------------------------------------------------------*/
 
+        // Waits only if the GPU is still drawing from this region, three frames back
+        frameStream.beginFrame();
+
+        // Upload finished texture decodes, at most ~2 ms per frame
+        textureStreamer.update(2.0);
+
         // Check events
         glfwPollEvents();
+        for (const std::string &changed : shaderWatcher.takeChanges()) {
+            if (tempShader.dependsOn(changed)) {
+                tempShader.reload();
+            }
+            if (instancedShader.dependsOn(changed)) {
+                instancedShader.reload();
+            }
+        }
         rotator.poll(window);
         trans.poll(window);
         //printf("phi = %6.2f, theta = %6.2f\n", rotator.phi, rotator.theta);
 
         // Update window size
         glfwGetFramebufferSize(window, &width, &height);
-        glViewport(0, 0, width, height);
+        GLState::viewport(0, 0, width, height);
 
         // Update camera
         glm::vec3 cameraFront;
@@ -298,44 +344,73 @@ int main(void)
         cameraPos.y = 0.0f;
         V = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
 
-        MV = V*M;
         P = glm::perspective(glm::radians(fov), (float)width/(float)height, 0.1f, 100.0f);
 
         //Calculate light direction
         lDir = glm::vec3(1.0f, -1.0f, 1.0f);
 
+        frameUniforms.view = V;
+        frameUniforms.projection = P;
+        frameUniforms.camera_position = glm::vec4(cameraPos, 1.0f);
+        frameUniforms.light_direction = glm::vec4(glm::normalize(lDir), 0.0f);
+        frameUniforms.upload(frameStream);
+        frameStream.flush();
+
         // OpenGL settings
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        GLState::clearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); // GL_FILL or GL_LINE
+        GLState::polygonMode(GL_FILL); // GL_FILL or GL_LINE
 
         /********** Render stuff ***************/
         // Bind Framebuffer
 
-        // Bind shader
+        // Sampler units, set() skips them unless the program was rebuilt
         tempShader();
+        tempShader.set(tex1Handle, 0);
+        tempShader.set(tex2Handle, 1);
+
+        // Textures change from the placeholder once streamed in
+        renderQueue.setTextures(crateMaterial, {textureStreamer.texture(texture1), textureStreamer.texture(texture2)});
+        renderQueue.setTextures(faceMaterial, {textureStreamer.texture(texture2), textureStreamer.texture(texture1)});
+
+        renderQueue.begin(V, 100.0f);
+        renderQueue.submit(RenderQueue::PASS_OPAQUE, crateMaterial, cube, M);
+        for (int i = 0; i < nrRingObjects; ++i) {
+            renderQueue.submit(RenderQueue::PASS_OPAQUE, i % 2 ? faceMaterial : crateMaterial, i % 4 < 2 ? cube : pyramid,
+                               ringTransforms[i]);
+        }
+        renderQueue.execute();
+
+        // The cube field
+        GLState::bindTexture(0, GL_TEXTURE_2D, textureStreamer.texture(texture1));
+        GLState::bindTexture(1, GL_TEXTURE_2D, textureStreamer.texture(texture2));
+        instancedShader();
+        instancedShader.set(instancedTex1Handle, 0);
+        instancedShader.set(instancedTex2Handle, 1);
+        cubeField.draw();
+
+        // The swarm, x is the orbit radius, y the height and z the starting angle
+        for (int i = 0; i < nrSwarmObjects; ++i) {
+            const glm::vec3 &orbit = swarmOrbits[i];
+            float angle = orbit.z + static_cast<float>(elapsed.count()) * 2.0f / orbit.x;
+            swarmTransforms[i] = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(orbit.x * cos(angle), orbit.y,
+                                                                                      orbit.x * sin(angle))),
+                                            glm::vec3(0.3f));
+        }
+        swarm.update(frameStream, swarmTransforms);
+        frameStream.flush();
+        swarm.draw();
 
-        // Send Uniforms
-        glUniformMatrix4fv(tempShader.MV_Loc, 1, GL_FALSE, glm::value_ptr(MV));
-        glUniformMatrix4fv(tempShader.P_Loc, 1, GL_FALSE, glm::value_ptr(P));
-
-        // Bind textures
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture1);
-        glUniform1i(glGetUniformLocation(tempShader, "ourTexture1"), 0);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, texture2);
-        glUniform1i(glGetUniformLocation(tempShader, "ourTexture2"), 1);
-
-        // Bind VAO
-        glBindVertexArray(temp_vao);
+        // Batched objects, bucket 1 has the two textures swapped
+        batch.draw(0);
+        GLState::bindTexture(0, GL_TEXTURE_2D, textureStreamer.texture(texture2));
+        GLState::bindTexture(1, GL_TEXTURE_2D, textureStreamer.texture(texture1));
+        batch.draw(1);
 
-        // Draw elements
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        //glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        // Fence this frame's region, the last draw reading it was issued
+        frameStream.endFrame();
 
-        // Unbind VAO
-        glBindVertexArray(0);
+        // The VAO stays bound, the next frame's first draw binds its own and nothing else depends on it
 
         // Swap front and back buffers
         glfwSwapBuffers(window);
@@ -345,18 +420,15 @@ int main(void)
         second_accumulator += delta_time;
         if (second_accumulator.count() >= 1.0) {
             float newFPS = static_cast<float>( frames_last_second / second_accumulator.count());
-            setWindowFPS(window, newFPS);
+            setWindowFPS(window, newFPS, static_cast<float>(GLState::issued()) / frames_last_second,
+                         static_cast<float>(GLState::elided()) / frames_last_second);
+            GLState::resetCounters();
             frames_last_second = 0;
             second_accumulator = std::chrono::duration<double>(0);
         }
         /*--------------------------------------------------------------------------------*/
     }
 
-    // Properly de-allocate all resources once they've outlived their purpose
-    glDeleteVertexArrays(1, &temp_vao);
-    glDeleteBuffers(1, &temp_vbo);
-    glDeleteBuffers(1, &temp_ebo);
-
     glfwDestroyWindow(window);
     glfwTerminate();
     exit(EXIT_SUCCESS);
@@ -382,9 +454,10 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
 
 }
 
-void setWindowFPS(GLFWwindow *window, float fps) {
+void setWindowFPS(GLFWwindow *window, float fps, float issued_per_frame, float elided_per_frame) {
     std::stringstream ss;
-    ss << "FPS: " << fps;
+    ss << "FPS: " << fps << ", GL state calls per frame: " << issued_per_frame << " issued, " << elided_per_frame
+       << " elided";
 
     glfwSetWindowTitle(window, ss.str().c_str());
 }
\ No newline at end of file
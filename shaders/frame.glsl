@@ -0,0 +1,8 @@
+// Per-frame camera and lighting, shared by all programs. Mirrors FrameUniforms.hpp
+layout (std140) uniform Frame
+{
+    mat4 V;
+    mat4 P;
+    vec4 cameraPosition;
+    vec4 lightDirection;
+};
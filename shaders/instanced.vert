@@ -0,0 +1,17 @@
+#version 330 core
+
+#include "frame.glsl"
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec2 texCoord;
+// Per instance, takes locations 2-5
+layout (location = 2) in mat4 model;
+
+out vec2 vTexCoord;
+
+void main()
+{
+    vTexCoord = vec2(texCoord.x, 1.0f - texCoord.y);
+
+    gl_Position = P * V * model * vec4(position, 1.0f);
+}
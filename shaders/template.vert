@@ -1,5 +1,7 @@
 #version 330 core
 
+#include "frame.glsl"
+
 layout (location = 0) in vec3 position;
 //layout (location = 1) in vec3 color;
 layout (location = 1) in vec2 texCoord;
@@ -7,8 +9,7 @@ layout (location = 1) in vec2 texCoord;
 //out vec3 vColor;
 out vec2 vTexCoord;
 
-uniform mat4 MV;
-uniform mat4 P;
+uniform mat4 M;
 
 void main()
 {
@@ -16,7 +17,7 @@ void main()
     //vColor = color;
     vTexCoord = vec2(texCoord.x, 1.0f - texCoord.y);
 
-    gl_Position = P * MV * vec4(position, 1.0f);
+    gl_Position = P * V * M * vec4(position, 1.0f);
 
 }
 
@@ -2,20 +2,92 @@
 
 #include <iostream>
 #include <fstream>
+#include <cstdlib>
+#include <cstring>
 
-const std::string FileReader::ReadFromFile(std::string fileName) {
-    std::ifstream ifs(fileName.c_str());
-    std::string out;
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string &fileName) : data_(NULL), size_(0), open_(false), mapped_(false) {
+#ifndef _WIN32
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Could not open file " << fileName << std::endl;
+        return;
+    }
 
-    if (ifs.is_open()) {
-        std::string s;
-        while (std::getline(ifs, s)) {
-            out += s + "\n";
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        open_ = true;
+        size_ = static_cast<size_t>(st.st_size);
+
+        // Empty files cannot be mapped, they are simply open with size 0
+        if (size_ > 0) {
+            void *ptr = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED) {
+                madvise(ptr, size_, MADV_SEQUENTIAL);
+                data_ = static_cast<const char *>(ptr);
+                mapped_ = true;
+            } else {
+                open_ = false;
+                size_ = 0;
+            }
         }
-    } else {
-        std::cerr << "Could not open file" << std::endl;
     }
+    close(fd);
+
+    if (open_ || size_ > 0) {
+        return;
+    }
+#endif
+
+    // Fallback, one sized read
+    std::ifstream ifs(fileName.c_str(), std::ios::binary | std::ios::ate);
+    if (!ifs.is_open()) {
+        std::cerr << "Could not open file " << fileName << std::endl;
+        return;
+    }
+
+    buffer_.resize(static_cast<size_t>(ifs.tellg()));
+    ifs.seekg(0, std::ios::beg);
+    ifs.read(buffer_.data(), buffer_.size());
+
+    open_ = true;
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+}
 
-    ifs.close();
-    return out;
-}
\ No newline at end of file
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (mapped_) {
+        munmap(const_cast<char *>(data_), size_);
+    }
+#endif
+}
+
+const std::string FileReader::ReadFromFile(std::string fileName) {
+    MappedFile file(fileName);
+    return std::string(file.data() ? file.data() : "", file.size());
+}
+
+char *FileReader::ReadBytes(const std::string &fileName, size_t *size) {
+    MappedFile file(fileName);
+    if (!file.isOpen()) {
+        return NULL;
+    }
+
+    char *buffer = static_cast<char *>(malloc(file.size() + 1));
+    if (file.size() > 0) {
+        memcpy(buffer, file.data(), file.size());
+    }
+    buffer[file.size()] = '\0';
+
+    if (size) {
+        *size = file.size();
+    }
+    return buffer;
+}
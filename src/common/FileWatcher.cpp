@@ -0,0 +1,122 @@
+#include <common/FileWatcher.hpp>
+
+#include <iostream>
+#include <chrono>
+
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+FileWatcher::FileWatcher() : running_(true) {
+#ifdef __linux__
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_ < 0) {
+        std::cerr << "Could not initialize inotify, file watching disabled" << std::endl;
+        running_ = false;
+        return;
+    }
+#endif
+    thread_ = std::thread(&FileWatcher::run, this);
+}
+
+FileWatcher::~FileWatcher() {
+    running_ = false;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+#ifdef __linux__
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+#endif
+}
+
+void FileWatcher::watch(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!files_.insert(path).second) {
+        return;
+    }
+
+#ifdef __linux__
+    if (fd_ < 0) {
+        return;
+    }
+
+    // Keep the directory part as written so reported paths match the registered ones
+    size_t slash = path.find_last_of('/');
+    std::string prefix = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    std::string directory = prefix.empty() ? "." : prefix;
+
+    // inotify returns the existing descriptor if the directory is already watched
+    int wd = inotify_add_watch(fd_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (wd < 0) {
+        std::cerr << "Could not watch directory " << directory << std::endl;
+        return;
+    }
+    directories_[wd].insert(prefix);
+#else
+    struct stat st;
+    mtimes_[path] = stat(path.c_str(), &st) == 0 ? static_cast<long long>(st.st_mtime) : 0;
+#endif
+}
+
+std::vector<std::string> FileWatcher::takeChanges() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> changes(changes_.begin(), changes_.end());
+    changes_.clear();
+    return changes;
+}
+
+void FileWatcher::run() {
+#ifdef __linux__
+    alignas(struct inotify_event) char buffer[4096];
+
+    while (running_) {
+        // Wake up regularly to notice shutdown
+        struct pollfd pfd = {fd_, POLLIN, 0};
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+
+        ssize_t length = read(fd_, buffer, sizeof(buffer));
+        if (length <= 0) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (char *ptr = buffer; ptr < buffer + length;) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            auto prefixes = directories_.find(event->wd);
+            if (event->len == 0 || prefixes == directories_.end()) {
+                continue;
+            }
+
+            for (const std::string &prefix : prefixes->second) {
+                std::string path = prefix + event->name;
+                if (files_.count(path)) {
+                    changes_.insert(path);
+                }
+            }
+        }
+    }
+#else
+    while (running_) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto &entry : mtimes_) {
+            struct stat st;
+            if (stat(entry.first.c_str(), &st) == 0 && static_cast<long long>(st.st_mtime) != entry.second) {
+                entry.second = static_cast<long long>(st.st_mtime);
+                changes_.insert(entry.first);
+            }
+        }
+    }
+#endif
+}
@@ -0,0 +1,25 @@
+#include <rendering/FrameUniforms.hpp>
+#include <rendering/GLCapabilities.hpp>
+#include <rendering/GLState.hpp>
+#include <rendering/ShaderProgram.hpp>
+
+#include <iostream>
+#include <cstring>
+
+void FrameUniforms::registerBlock() {
+    ShaderProgram::bindUniformBlock("Frame", BINDING);
+}
+
+bool FrameUniforms::upload(StreamBuffer &stream) const {
+    // Bound ranges have to start at a multiple of the implementation's alignment, 256 at most
+    size_t alignment = static_cast<size_t>(GLCapabilities::integer(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT));
+    StreamBuffer::Slice slice = stream.allocate(sizeof(FrameUniforms), alignment > 0 ? alignment : 256);
+    if (!slice.data) {
+        std::cerr << "Frame stream is full, the frame uniforms were not updated\n";
+        return false;
+    }
+
+    memcpy(slice.data, this, sizeof(FrameUniforms));
+    GLState::bindBufferRange(GL_UNIFORM_BUFFER, BINDING, slice.buffer, slice.offset, slice.size);
+    return true;
+}
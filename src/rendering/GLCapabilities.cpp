@@ -0,0 +1,170 @@
+#include <rendering/GLCapabilities.hpp>
+
+#include <SOIL.h>
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+    /// Core version an extension was promoted into, for drivers that stop listing it once it is core
+    struct Promotion {
+        const char *extension;
+        int major;
+        int minor;
+    };
+
+    const Promotion PROMOTIONS[] = {
+            {"GL_ARB_texture_cube_map",          1, 3},
+            {"GL_EXT_texture_cube_map",          1, 3},
+            {"GL_ARB_texture_compression",       1, 3},
+            {"GL_ARB_texture_non_power_of_two",  2, 0},
+            {"GL_ARB_vertex_array_object",       3, 0},
+            {"GL_ARB_map_buffer_range",          3, 0},
+            {"GL_ARB_texture_rg",                3, 0},
+            {"GL_ARB_texture_compression_rgtc",  3, 0},
+            {"GL_ARB_framebuffer_object",        3, 0},
+            {"GL_ARB_texture_rectangle",         3, 1},
+            {"GL_EXT_texture_rectangle",         3, 1},
+            {"GL_NV_texture_rectangle",          3, 1},
+            {"GL_ARB_uniform_buffer_object",     3, 1},
+            {"GL_ARB_draw_instanced",            3, 1},
+            {"GL_ARB_draw_elements_base_vertex", 3, 2},
+            {"GL_ARB_sync",                      3, 2},
+            {"GL_ARB_instanced_arrays",          3, 3},
+            {"GL_ARB_draw_indirect",             4, 0},
+            {"GL_ARB_tessellation_shader",       4, 0},
+            {"GL_ARB_get_program_binary",        4, 1},
+            {"GL_ARB_base_instance",             4, 2},
+            {"GL_ARB_texture_storage",           4, 2},
+            {"GL_ARB_multi_draw_indirect",       4, 3},
+            {"GL_ARB_buffer_storage",            4, 4},
+    };
+
+    GLint readInteger(GLenum pname) {
+        GLint value = 0;
+        glGetIntegerv(pname, &value);
+        return value;
+    }
+
+    // SOIL is C, its queries are plain functions
+    int soilHasExtension(const char *name) {
+        return GLCapabilities::supports(name) ? 1 : 0;
+    }
+
+    int soilGetInteger(unsigned int pname) {
+        return GLCapabilities::integer(pname);
+    }
+}
+
+bool GLCapabilities::initialized_ = false;
+int GLCapabilities::major_ = 0;
+int GLCapabilities::minor_ = 0;
+GLCapabilities::Limits GLCapabilities::limits_;
+std::unordered_set<std::string> GLCapabilities::extensions_;
+std::unordered_map<GLenum, GLint> GLCapabilities::integers_;
+
+void GLCapabilities::init() {
+    initialized_ = true;
+    extensions_.clear();
+    integers_.clear();
+
+    // "major.minor[.release] vendor info", the same layout on every version
+    major_ = minor_ = 0;
+    const GLubyte *version_string = glGetString(GL_VERSION);
+    if (version_string == NULL ||
+        std::sscanf(reinterpret_cast<const char *>(version_string), "%d.%d", &major_, &minor_) != 2) {
+        std::cerr << "Could not read the GL version, is a context current?" << std::endl;
+    }
+
+    if (major_ >= 3) {
+        GLint count = readInteger(GL_NUM_EXTENSIONS);
+        extensions_.reserve(static_cast<size_t>(count));
+        for (GLint i = 0; i < count; ++i) {
+            const GLubyte *name = glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i));
+            if (name != NULL) {
+                extensions_.insert(reinterpret_cast<const char *>(name));
+            }
+        }
+    } else {
+        const char *list = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+        while (list != NULL && *list != '\0') {
+            const char *end = std::strchr(list, ' ');
+            size_t length = end ? static_cast<size_t>(end - list) : std::strlen(list);
+            if (length > 0) {
+                extensions_.insert(std::string(list, length));
+            }
+            list = end ? end + 1 : NULL;
+        }
+    }
+
+    // Limits of features the context lacks stay 0 rather than raising GL_INVALID_ENUM
+    limits_.maxTextureSize = integer(GL_MAX_TEXTURE_SIZE);
+    limits_.maxCubeMapTextureSize = supports("GL_ARB_texture_cube_map") ? integer(GL_MAX_CUBE_MAP_TEXTURE_SIZE) : 0;
+    limits_.maxRectangleTextureSize =
+            supports("GL_ARB_texture_rectangle") ? integer(GL_MAX_RECTANGLE_TEXTURE_SIZE) : 0;
+    limits_.maxTextureImageUnits = integer(GL_MAX_TEXTURE_IMAGE_UNITS);
+    limits_.maxCombinedTextureImageUnits = integer(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS);
+    limits_.maxVertexAttribs = integer(GL_MAX_VERTEX_ATTRIBS);
+    limits_.maxUniformBufferBindings =
+            supports("GL_ARB_uniform_buffer_object") ? integer(GL_MAX_UNIFORM_BUFFER_BINDINGS) : 0;
+    limits_.maxUniformBlockSize = supports("GL_ARB_uniform_buffer_object") ? integer(GL_MAX_UNIFORM_BLOCK_SIZE) : 0;
+    limits_.maxElementsVertices = integer(GL_MAX_ELEMENTS_VERTICES);
+    limits_.maxElementsIndices = integer(GL_MAX_ELEMENTS_INDICES);
+    limits_.maxSamples = supports("GL_ARB_framebuffer_object") ? integer(GL_MAX_SAMPLES) : 0;
+
+    SOIL_set_capability_queries(soilHasExtension, soilGetInteger);
+}
+
+bool GLCapabilities::hasExtension(const std::string &name) {
+    if (!initialized_) {
+        init();
+    }
+    return extensions_.count(name) != 0;
+}
+
+bool GLCapabilities::supports(const std::string &extension) {
+    if (hasExtension(extension)) {
+        return true;
+    }
+    for (const Promotion &promotion : PROMOTIONS) {
+        if (extension == promotion.extension) {
+            return version(promotion.major, promotion.minor);
+        }
+    }
+    return false;
+}
+
+bool GLCapabilities::version(int major, int minor) {
+    if (!initialized_) {
+        init();
+    }
+    return major_ > major || (major_ == major && minor_ >= minor);
+}
+
+const GLCapabilities::Limits &GLCapabilities::limits() {
+    if (!initialized_) {
+        init();
+    }
+    return limits_;
+}
+
+GLint GLCapabilities::integer(GLenum pname) {
+    if (!initialized_) {
+        init();
+    }
+    std::unordered_map<GLenum, GLint>::const_iterator it = integers_.find(pname);
+    if (it != integers_.end()) {
+        return it->second;
+    }
+    GLint value = readInteger(pname);
+    integers_[pname] = value;
+    return value;
+}
+
+size_t GLCapabilities::extensionCount() {
+    if (!initialized_) {
+        init();
+    }
+    return extensions_.size();
+}
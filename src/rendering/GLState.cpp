@@ -0,0 +1,284 @@
+#include <rendering/GLState.hpp>
+
+namespace {
+    const GLuint UNKNOWN = 0xFFFFFFFFu;
+    const GLuint MAX_TEXTURE_UNITS = 32;
+
+    const GLenum TEXTURE_TARGETS[] = {GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_3D, GL_TEXTURE_2D_ARRAY,
+                                      GL_TEXTURE_RECTANGLE, GL_TEXTURE_BUFFER, GL_TEXTURE_1D,
+                                      GL_TEXTURE_2D_MULTISAMPLE};
+    const size_t TEXTURE_TARGET_COUNT = sizeof(TEXTURE_TARGETS) / sizeof(TEXTURE_TARGETS[0]);
+
+    const GLenum BUFFER_TARGETS[] = {GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_PIXEL_PACK_BUFFER,
+                                     GL_PIXEL_UNPACK_BUFFER, GL_UNIFORM_BUFFER, GL_DRAW_INDIRECT_BUFFER,
+                                     GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GL_TEXTURE_BUFFER,
+                                     GL_TRANSFORM_FEEDBACK_BUFFER};
+    const size_t BUFFER_TARGET_COUNT = sizeof(BUFFER_TARGETS) / sizeof(BUFFER_TARGETS[0]);
+
+    const GLenum CAPABILITIES[] = {GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_SCISSOR_TEST, GL_STENCIL_TEST,
+                                   GL_POLYGON_OFFSET_FILL, GL_MULTISAMPLE, GL_FRAMEBUFFER_SRGB,
+                                   GL_PRIMITIVE_RESTART, GL_PROGRAM_POINT_SIZE};
+    const size_t CAPABILITY_COUNT = sizeof(CAPABILITIES) / sizeof(CAPABILITIES[0]);
+
+    struct Shadow {
+        GLuint program;
+        GLuint vao;
+        GLuint active_unit;
+        GLuint textures[MAX_TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+        GLuint buffers[BUFFER_TARGET_COUNT];
+        signed char enabled[CAPABILITY_COUNT]; // -1 unknown
+        bool clear_color_known;
+        GLfloat clear_color[4];
+        GLenum polygon_mode;
+        bool viewport_known;
+        GLint viewport[4];
+    };
+
+    Shadow shadow;
+    bool shadow_initialized = false;
+    size_t issued_calls = 0;
+    size_t elided_calls = 0;
+
+    Shadow &state() {
+        if (!shadow_initialized) {
+            GLState::invalidate();
+        }
+        return shadow;
+    }
+
+    // Index into the tables above, -1 for targets that are not shadowed and always issued
+    template<size_t N>
+    int indexOf(const GLenum (&table)[N], GLenum value) {
+        for (size_t i = 0; i < N; ++i) {
+            if (table[i] == value) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    // True if the call has to reach GL, counting it either way
+    bool change(GLuint &shadowed, GLuint value) {
+        if (shadowed == value) {
+            ++elided_calls;
+            return false;
+        }
+        shadowed = value;
+        ++issued_calls;
+        return true;
+    }
+
+    void setCapability(GLenum capability, bool enable) {
+        int index = indexOf(CAPABILITIES, capability);
+        if (index >= 0) {
+            signed char value = enable ? 1 : 0;
+            if (state().enabled[index] == value) {
+                ++elided_calls;
+                return;
+            }
+            state().enabled[index] = value;
+        }
+        ++issued_calls;
+        if (enable) {
+            glEnable(capability);
+        } else {
+            glDisable(capability);
+        }
+    }
+}
+
+void GLState::useProgram(GLuint program) {
+    if (change(state().program, program)) {
+        glUseProgram(program);
+    }
+}
+
+void GLState::bindVertexArray(GLuint vao) {
+    if (change(state().vao, vao)) {
+        glBindVertexArray(vao);
+        shadow.buffers[indexOf(BUFFER_TARGETS, GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+    }
+}
+
+void GLState::activeTexture(GLenum unit) {
+    if (change(state().active_unit, unit - GL_TEXTURE0)) {
+        glActiveTexture(unit);
+    }
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture) {
+    Shadow &s = state();
+    int index = indexOf(TEXTURE_TARGETS, target);
+    if (index < 0 || s.active_unit >= MAX_TEXTURE_UNITS) {
+        ++issued_calls;
+        glBindTexture(target, texture);
+        return;
+    }
+    if (change(s.textures[s.active_unit][index], texture)) {
+        glBindTexture(target, texture);
+    }
+}
+
+void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    int index = indexOf(TEXTURE_TARGETS, target);
+    if (index >= 0 && unit < MAX_TEXTURE_UNITS && state().textures[unit][index] == texture) {
+        ++elided_calls;
+        return;
+    }
+    activeTexture(GL_TEXTURE0 + unit);
+    bindTexture(target, texture);
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer) {
+    int index = indexOf(BUFFER_TARGETS, target);
+    if (index < 0) {
+        ++issued_calls;
+        glBindBuffer(target, buffer);
+        return;
+    }
+    if (change(state().buffers[index], buffer)) {
+        glBindBuffer(target, buffer);
+    }
+}
+
+void GLState::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    int generic = indexOf(BUFFER_TARGETS, target);
+    if (generic >= 0) {
+        state().buffers[generic] = buffer;
+    }
+    ++issued_calls;
+    glBindBufferRange(target, index, buffer, offset, size);
+}
+
+void GLState::enable(GLenum capability) {
+    setCapability(capability, true);
+}
+
+void GLState::disable(GLenum capability) {
+    setCapability(capability, false);
+}
+
+void GLState::clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {
+    Shadow &s = state();
+    if (s.clear_color_known && s.clear_color[0] == red && s.clear_color[1] == green && s.clear_color[2] == blue &&
+        s.clear_color[3] == alpha) {
+        ++elided_calls;
+        return;
+    }
+    s.clear_color_known = true;
+    s.clear_color[0] = red;
+    s.clear_color[1] = green;
+    s.clear_color[2] = blue;
+    s.clear_color[3] = alpha;
+    ++issued_calls;
+    glClearColor(red, green, blue, alpha);
+}
+
+void GLState::polygonMode(GLenum mode) {
+    if (change(state().polygon_mode, mode)) {
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+    }
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    Shadow &s = state();
+    if (s.viewport_known && s.viewport[0] == x && s.viewport[1] == y && s.viewport[2] == width &&
+        s.viewport[3] == height) {
+        ++elided_calls;
+        return;
+    }
+    s.viewport_known = true;
+    s.viewport[0] = x;
+    s.viewport[1] = y;
+    s.viewport[2] = width;
+    s.viewport[3] = height;
+    ++issued_calls;
+    glViewport(x, y, width, height);
+}
+
+// Deleting a bound object reverts the binding to 0, except for the program which stays in use
+// until another is bound; its name may be reused afterwards so it becomes unknown
+
+void GLState::deleteProgram(GLuint program) {
+    if (state().program == program) {
+        shadow.program = UNKNOWN;
+    }
+    glDeleteProgram(program);
+}
+
+void GLState::deleteVertexArrays(GLsizei count, const GLuint *vaos) {
+    Shadow &s = state();
+    for (GLsizei i = 0; i < count; ++i) {
+        if (vaos[i] != 0 && s.vao == vaos[i]) {
+            s.vao = 0;
+            s.buffers[indexOf(BUFFER_TARGETS, GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+        }
+    }
+    glDeleteVertexArrays(count, vaos);
+}
+
+void GLState::deleteTextures(GLsizei count, const GLuint *textures) {
+    Shadow &s = state();
+    for (GLsizei i = 0; i < count; ++i) {
+        if (textures[i] == 0) {
+            continue;
+        }
+        for (GLuint unit = 0; unit < MAX_TEXTURE_UNITS; ++unit) {
+            for (size_t target = 0; target < TEXTURE_TARGET_COUNT; ++target) {
+                if (s.textures[unit][target] == textures[i]) {
+                    s.textures[unit][target] = 0;
+                }
+            }
+        }
+    }
+    glDeleteTextures(count, textures);
+}
+
+void GLState::deleteBuffers(GLsizei count, const GLuint *buffers) {
+    Shadow &s = state();
+    for (GLsizei i = 0; i < count; ++i) {
+        if (buffers[i] == 0) {
+            continue;
+        }
+        for (size_t target = 0; target < BUFFER_TARGET_COUNT; ++target) {
+            if (s.buffers[target] == buffers[i]) {
+                s.buffers[target] = 0;
+            }
+        }
+    }
+    glDeleteBuffers(count, buffers);
+}
+
+void GLState::invalidate() {
+    shadow_initialized = true;
+    shadow.program = UNKNOWN;
+    shadow.vao = UNKNOWN;
+    shadow.active_unit = UNKNOWN;
+    for (GLuint unit = 0; unit < MAX_TEXTURE_UNITS; ++unit) {
+        for (size_t target = 0; target < TEXTURE_TARGET_COUNT; ++target) {
+            shadow.textures[unit][target] = UNKNOWN;
+        }
+    }
+    for (size_t target = 0; target < BUFFER_TARGET_COUNT; ++target) {
+        shadow.buffers[target] = UNKNOWN;
+    }
+    for (size_t i = 0; i < CAPABILITY_COUNT; ++i) {
+        shadow.enabled[i] = -1;
+    }
+    shadow.clear_color_known = false;
+    shadow.polygon_mode = UNKNOWN;
+    shadow.viewport_known = false;
+}
+
+size_t GLState::issued() {
+    return issued_calls;
+}
+
+size_t GLState::elided() {
+    return elided_calls;
+}
+
+void GLState::resetCounters() {
+    issued_calls = 0;
+    elided_calls = 0;
+}
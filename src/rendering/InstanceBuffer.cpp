@@ -0,0 +1,72 @@
+#include <rendering/InstanceBuffer.hpp>
+#include <rendering/GLState.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+InstanceBuffer::InstanceBuffer(const Mesh &mesh, GLuint location) : mesh_(mesh), location_(location) {
+    glGenBuffers(1, &buffer_);
+
+    GLState::bindVertexArray(mesh_.vao());
+    for (GLuint column = 0; column < 4; ++column) {
+        glEnableVertexAttribArray(location_ + column);
+        glVertexAttribDivisor(location_ + column, 1);
+    }
+    attach(buffer_, 0);
+    GLState::bindVertexArray(0);
+}
+
+InstanceBuffer::~InstanceBuffer() {
+    GLState::deleteBuffers(1, &buffer_);
+}
+
+void InstanceBuffer::update(const glm::mat4 *transforms, size_t count) {
+    GLState::bindBuffer(GL_ARRAY_BUFFER, buffer_);
+
+    // Grow geometrically, otherwise orphan the old storage at the same size
+    if (count > capacity_) {
+        capacity_ = std::max(count, capacity_ * 2);
+    }
+    glBufferData(GL_ARRAY_BUFFER, capacity_ * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), transforms);
+    count_ = count;
+
+    if (source_ != buffer_ || source_offset_ != 0) {
+        GLState::bindVertexArray(mesh_.vao());
+        attach(buffer_, 0);
+    }
+}
+
+void InstanceBuffer::update(StreamBuffer &stream, const glm::mat4 *transforms, size_t count) {
+    StreamBuffer::Slice slice = stream.allocate(count * sizeof(glm::mat4), sizeof(glm::vec4));
+    if (!slice.data) {
+        update(transforms, count);
+        return;
+    }
+    memcpy(slice.data, transforms, count * sizeof(glm::mat4));
+    count_ = count;
+
+    // The slice moves every frame, so the pointers follow it
+    GLState::bindVertexArray(mesh_.vao());
+    attach(slice.buffer, slice.offset);
+}
+
+void InstanceBuffer::attach(GLuint buffer, GLintptr offset) {
+    GLState::bindBuffer(GL_ARRAY_BUFFER, buffer);
+
+    // A mat4 attribute is four vec4 columns, each in its own location
+    for (GLuint column = 0; column < 4; ++column) {
+        glVertexAttribPointer(location_ + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                              reinterpret_cast<GLvoid *>(offset + column * sizeof(glm::vec4)));
+    }
+    source_ = buffer;
+    source_offset_ = offset;
+}
+
+void InstanceBuffer::draw() const {
+    if (count_ == 0) {
+        return;
+    }
+    GLState::bindVertexArray(mesh_.vao());
+    glDrawElementsInstanced(GL_TRIANGLES, mesh_.indexCount(), mesh_.indexType(), 0, static_cast<GLsizei>(count_));
+}
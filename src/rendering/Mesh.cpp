@@ -0,0 +1,290 @@
+#include <rendering/Mesh.hpp>
+#include <common/hash_utils.hpp>
+#include <rendering/GLState.hpp>
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    // Forsyth's tuning: the last triangle's vertices score flat, older entries decay, and vertices
+    // with few triangles left get a boost so that islands are finished instead of left behind
+    const int CACHE_SIZE = 32;
+    const float LAST_TRIANGLE_SCORE = 0.75f;
+    const float CACHE_DECAY_POWER = 1.5f;
+    const float VALENCE_BOOST_SCALE = 2.0f;
+    const float VALENCE_BOOST_POWER = 0.5f;
+
+    float vertexScore(int cache_position, uint32_t remaining) {
+        if (remaining == 0) {
+            return -1.0f;
+        }
+        float score = 0.0f;
+        if (cache_position >= 0) {
+            if (cache_position < 3) {
+                score = LAST_TRIANGLE_SCORE;
+            } else {
+                float scaler = 1.0f / (CACHE_SIZE - 3);
+                score = std::pow(1.0f - (cache_position - 3) * scaler, CACHE_DECAY_POWER);
+            }
+        }
+        return score + VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remaining), -VALENCE_BOOST_POWER);
+    }
+}
+
+Mesh::Mesh(const GLfloat *vertices, size_t vertex_count, const std::vector<Attribute> &layout) {
+    size_t stride = 0;
+    for (const Attribute &attribute : layout) {
+        stride += attribute.components;
+    }
+
+    std::vector<GLfloat> welded;
+    std::vector<uint32_t> indices;
+    weld(vertices, vertex_count, stride, NULL, vertex_count, welded, indices);
+    build(welded, indices, layout);
+}
+
+Mesh::Mesh(const std::vector<GLfloat> &vertices, const std::vector<uint32_t> &indices,
+           const std::vector<Attribute> &layout) {
+    size_t stride = 0;
+    for (const Attribute &attribute : layout) {
+        stride += attribute.components;
+    }
+
+    std::vector<GLfloat> welded;
+    std::vector<uint32_t> welded_indices;
+    weld(vertices.data(), vertices.size() / stride, stride, indices.data(), indices.size(), welded, welded_indices);
+    build(welded, welded_indices, layout);
+}
+
+Mesh::~Mesh() {
+    GLState::deleteVertexArrays(1, &vao_);
+    GLState::deleteBuffers(1, &vbo_);
+    GLState::deleteBuffers(1, &ebo_);
+}
+
+void Mesh::build(std::vector<GLfloat> &vertices, std::vector<uint32_t> &indices,
+                 const std::vector<Attribute> &layout) {
+    size_t stride = 0;
+    for (const Attribute &attribute : layout) {
+        stride += attribute.components;
+    }
+
+    if (indices.size() % 3 != 0) {
+        std::cerr << "Mesh index count " << indices.size() << " is not a multiple of 3, dropping the rest\n";
+        indices.resize(indices.size() - indices.size() % 3);
+    }
+
+    optimizeVertexCache(indices, vertices.size() / stride);
+    optimizeVertexFetch(vertices, stride, indices);
+    vertex_count_ = vertices.size() / stride;
+    index_count_ = static_cast<GLsizei>(indices.size());
+
+    glGenVertexArrays(1, &vao_);
+    GLState::bindVertexArray(vao_);
+
+    glGenBuffers(1, &vbo_);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, vbo_);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+
+    // Half the index memory and bandwidth whenever every index fits in 16 bits
+    glGenBuffers(1, &ebo_);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
+    if (vertex_count_ <= 65536) {
+        std::vector<uint16_t> short_indices(indices.begin(), indices.end());
+        index_type_ = GL_UNSIGNED_SHORT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, short_indices.size() * sizeof(uint16_t), short_indices.data(),
+                     GL_STATIC_DRAW);
+    } else {
+        index_type_ = GL_UNSIGNED_INT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+    }
+
+    size_t offset = 0;
+    for (const Attribute &attribute : layout) {
+        glVertexAttribPointer(attribute.location, attribute.components, GL_FLOAT, GL_FALSE,
+                              static_cast<GLsizei>(stride * sizeof(GLfloat)),
+                              reinterpret_cast<GLvoid *>(offset * sizeof(GLfloat)));
+        glEnableVertexAttribArray(attribute.location);
+        offset += attribute.components;
+    }
+
+    // The element buffer binding is VAO state, so only the VAO is unbound
+    GLState::bindVertexArray(0);
+}
+
+void Mesh::draw() const {
+    GLState::bindVertexArray(vao_);
+    glDrawElements(GL_TRIANGLES, index_count_, index_type_, 0);
+}
+
+void Mesh::weld(const GLfloat *input, size_t input_count, size_t stride, const uint32_t *input_indices,
+                size_t index_count, std::vector<GLfloat> &vertices, std::vector<uint32_t> &indices) {
+    const size_t vertex_bytes = stride * sizeof(GLfloat);
+
+    // Open addressing on the vertex bytes, the table holds indices into the welded vertices
+    size_t table_size = 16;
+    while (table_size < input_count * 2) {
+        table_size *= 2;
+    }
+    const uint32_t EMPTY = 0xFFFFFFFFu;
+    std::vector<uint32_t> table(table_size, EMPTY);
+    std::vector<uint32_t> remap(input_count, EMPTY);
+
+    vertices.clear();
+    vertices.reserve(input_count * stride);
+    for (size_t i = 0; i < input_count; ++i) {
+        const GLfloat *vertex = input + i * stride;
+        size_t slot = static_cast<size_t>(fnv1a_64(vertex, vertex_bytes)) & (table_size - 1);
+        while (table[slot] != EMPTY &&
+               std::memcmp(&vertices[table[slot] * stride], vertex, vertex_bytes) != 0) {
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (table[slot] == EMPTY) {
+            table[slot] = static_cast<uint32_t>(vertices.size() / stride);
+            vertices.insert(vertices.end(), vertex, vertex + stride);
+        }
+        remap[i] = table[slot];
+    }
+
+    indices.resize(index_count);
+    for (size_t i = 0; i < index_count; ++i) {
+        indices[i] = remap[input_indices ? input_indices[i] : i];
+    }
+}
+
+void Mesh::optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertex_count) {
+    const size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    // Triangles using each vertex, packed per vertex; the first remaining[v] entries are not yet emitted
+    std::vector<uint32_t> remaining(vertex_count, 0);
+    for (uint32_t index : indices) {
+        ++remaining[index];
+    }
+    std::vector<uint32_t> offsets(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; ++v) {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i) {
+            adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    std::vector<float> vertex_score(vertex_count);
+    for (size_t v = 0; v < vertex_count; ++v) {
+        vertex_score[v] = vertexScore(-1, remaining[v]);
+    }
+    std::vector<char> emitted(triangle_count, 0);
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    std::vector<uint32_t> cache, next_cache;
+    cache.reserve(CACHE_SIZE + 3);
+    next_cache.reserve(CACHE_SIZE + 3);
+
+    // Without a candidate in the cache, continue with the next triangle in input order rather than
+    // searching all of them, which keeps the whole pass linear
+    size_t cursor = 0;
+    int64_t best = -1;
+    for (size_t count = 0; count < triangle_count; ++count) {
+        if (best < 0) {
+            while (emitted[cursor]) {
+                ++cursor;
+            }
+            best = static_cast<int64_t>(cursor);
+        }
+
+        const uint32_t *triangle = &indices[3 * best];
+        output.insert(output.end(), triangle, triangle + 3);
+        emitted[best] = 1;
+
+        // The emitted triangle's vertices move to the front of the LRU cache
+        next_cache.clear();
+        for (int i = 0; i < 3; ++i) {
+            uint32_t v = triangle[i];
+            uint32_t *begin = &adjacency[offsets[v]];
+            uint32_t *end = begin + remaining[v];
+            *std::find(begin, end, static_cast<uint32_t>(best)) = *(end - 1);
+            --remaining[v];
+
+            // Degenerate triangles list a vertex twice
+            if (std::find(next_cache.begin(), next_cache.end(), v) == next_cache.end()) {
+                next_cache.push_back(v);
+            }
+        }
+        for (uint32_t v : cache) {
+            if (std::find(next_cache.begin(), next_cache.end(), v) == next_cache.end()) {
+                next_cache.push_back(v);
+            }
+        }
+
+        // Rescore the vertices first, triangles can share several of them. Evicted vertices are
+        // rescored too but only triangles with a vertex still cached are candidates
+        for (size_t i = 0; i < next_cache.size(); ++i) {
+            uint32_t v = next_cache[i];
+            vertex_score[v] = vertexScore(i < CACHE_SIZE ? static_cast<int>(i) : -1, remaining[v]);
+        }
+
+        best = -1;
+        float best_score = -1.0f;
+        if (next_cache.size() > CACHE_SIZE) {
+            next_cache.resize(CACHE_SIZE);
+        }
+        for (uint32_t v : next_cache) {
+            for (uint32_t j = 0; j < remaining[v]; ++j) {
+                uint32_t t = adjacency[offsets[v] + j];
+                float score = vertex_score[indices[3 * t]] + vertex_score[indices[3 * t + 1]] +
+                              vertex_score[indices[3 * t + 2]];
+                if (score > best_score) {
+                    best_score = score;
+                    best = t;
+                }
+            }
+        }
+        cache.swap(next_cache);
+    }
+
+    indices.swap(output);
+}
+
+void Mesh::optimizeVertexFetch(std::vector<GLfloat> &vertices, size_t stride, std::vector<uint32_t> &indices) {
+    const uint32_t UNUSED = 0xFFFFFFFFu;
+    std::vector<uint32_t> remap(vertices.size() / stride, UNUSED);
+    std::vector<GLfloat> reordered;
+    reordered.reserve(vertices.size());
+
+    for (uint32_t &index : indices) {
+        if (remap[index] == UNUSED) {
+            remap[index] = static_cast<uint32_t>(reordered.size() / stride);
+            reordered.insert(reordered.end(), vertices.begin() + index * stride,
+                             vertices.begin() + (index + 1) * stride);
+        }
+        index = remap[index];
+    }
+
+    vertices.swap(reordered);
+}
+
+float Mesh::averageCacheMissRatio(const std::vector<uint32_t> &indices, size_t vertex_count, size_t cache_size) {
+    if (indices.size() < 3) {
+        return 0.0f;
+    }
+
+    // FIFO like most hardware: a hit does not refresh the entry
+    std::vector<size_t> inserted(vertex_count, 0);
+    size_t misses = 0;
+    for (uint32_t index : indices) {
+        if (inserted[index] == 0 || misses - inserted[index] >= cache_size) {
+            ++misses;
+            inserted[index] = misses;
+        }
+    }
+    return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+}
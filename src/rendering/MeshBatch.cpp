@@ -0,0 +1,243 @@
+#include <rendering/MeshBatch.hpp>
+#include <rendering/GLCapabilities.hpp>
+#include <rendering/GLState.hpp>
+
+#include <iostream>
+#include <algorithm>
+#include <utility>
+
+MeshBatch::MeshBatch(const std::vector<Mesh::Attribute> &layout, GLuint transform_location)
+        : layout_(layout), stride_(0), transform_location_(transform_location),
+          indirect_(multiDrawIndirectSupported()) {
+    for (const Mesh::Attribute &attribute : layout_) {
+        stride_ += attribute.components;
+    }
+
+    glGenVertexArrays(1, &vao_);
+    glGenBuffers(1, &vertex_buffer_);
+    glGenBuffers(1, &index_buffer_);
+    glGenBuffers(1, &transform_buffer_);
+    glGenBuffers(1, &indirect_buffer_);
+
+    // Attribute pointers refer to the buffer objects, so their storage can be respecified later
+    GLState::bindVertexArray(vao_);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+
+    GLState::bindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+    size_t offset = 0;
+    for (const Mesh::Attribute &attribute : layout_) {
+        glVertexAttribPointer(attribute.location, attribute.components, GL_FLOAT, GL_FALSE,
+                              static_cast<GLsizei>(stride_ * sizeof(GLfloat)),
+                              reinterpret_cast<GLvoid *>(offset * sizeof(GLfloat)));
+        glEnableVertexAttribArray(attribute.location);
+        offset += attribute.components;
+    }
+
+    GLState::bindBuffer(GL_ARRAY_BUFFER, transform_buffer_);
+    for (GLuint column = 0; column < 4; ++column) {
+        glVertexAttribPointer(transform_location_ + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                              reinterpret_cast<GLvoid *>(column * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(transform_location_ + column);
+        glVertexAttribDivisor(transform_location_ + column, 1);
+    }
+
+    GLState::bindVertexArray(0);
+
+    if (!indirect_) {
+        std::cout << "Multi draw indirect not supported, batches draw one call per mesh\n";
+    }
+}
+
+MeshBatch::~MeshBatch() {
+    GLState::deleteVertexArrays(1, &vao_);
+    GLState::deleteBuffers(1, &vertex_buffer_);
+    GLState::deleteBuffers(1, &index_buffer_);
+    GLState::deleteBuffers(1, &transform_buffer_);
+    GLState::deleteBuffers(1, &indirect_buffer_);
+}
+
+bool MeshBatch::multiDrawIndirectSupported() {
+    return GLCapabilities::supports("GL_ARB_multi_draw_indirect") && GLCapabilities::supports("GL_ARB_base_instance");
+}
+
+MeshBatch::MeshId MeshBatch::add(const GLfloat *vertices, size_t vertex_count) {
+    std::vector<GLfloat> welded;
+    std::vector<uint32_t> indices;
+    Mesh::weld(vertices, vertex_count, stride_, NULL, vertex_count, welded, indices);
+    return addWelded(welded, indices);
+}
+
+MeshBatch::MeshId MeshBatch::add(const std::vector<GLfloat> &vertices, const std::vector<uint32_t> &indices) {
+    std::vector<GLfloat> welded;
+    std::vector<uint32_t> welded_indices;
+    Mesh::weld(vertices.data(), vertices.size() / stride_, stride_, indices.data(), indices.size(), welded,
+               welded_indices);
+    return addWelded(welded, welded_indices);
+}
+
+MeshBatch::MeshId MeshBatch::addWelded(std::vector<GLfloat> &vertices, std::vector<uint32_t> &indices) {
+    if (indices.size() % 3 != 0) {
+        std::cerr << "Mesh index count " << indices.size() << " is not a multiple of 3, dropping the rest\n";
+        indices.resize(indices.size() - indices.size() % 3);
+    }
+    Mesh::optimizeVertexCache(indices, vertices.size() / stride_);
+    Mesh::optimizeVertexFetch(vertices, stride_, indices);
+
+    // Indices stay local to the mesh, the command's base vertex offsets them into the shared buffer
+    Range range;
+    range.firstIndex = static_cast<GLuint>(indices_.size());
+    range.indexCount = static_cast<GLuint>(indices.size());
+    range.baseVertex = static_cast<GLint>(vertices_.size() / stride_);
+    ranges_.push_back(range);
+
+    vertices_.insert(vertices_.end(), vertices.begin(), vertices.end());
+    indices_.insert(indices_.end(), indices.begin(), indices.end());
+    largest_mesh_ = std::max(largest_mesh_, vertices.size() / stride_);
+    geometry_dirty_ = true;
+
+    return static_cast<MeshId>(ranges_.size() - 1);
+}
+
+void MeshBatch::uploadGeometry() {
+    GLState::bindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+    glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(GLfloat), vertices_.data(), GL_STATIC_DRAW);
+
+    // Local indices fit in 16 bits unless a single mesh is larger, however large the batch is
+    GLState::bindVertexArray(vao_);
+    if (largest_mesh_ <= 65536) {
+        std::vector<uint16_t> short_indices(indices_.begin(), indices_.end());
+        index_type_ = GL_UNSIGNED_SHORT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, short_indices.size() * sizeof(uint16_t), short_indices.data(),
+                     GL_STATIC_DRAW);
+    } else {
+        index_type_ = GL_UNSIGNED_INT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_.size() * sizeof(uint32_t), indices_.data(), GL_STATIC_DRAW);
+    }
+    GLState::bindVertexArray(0);
+
+    geometry_dirty_ = false;
+}
+
+void MeshBatch::clear() {
+    submissions_.clear();
+    commands_dirty_ = true;
+}
+
+void MeshBatch::submit(uint32_t bucket, MeshId mesh, const glm::mat4 &transform) {
+    if (mesh >= ranges_.size()) {
+        std::cerr << "Submitted unknown mesh " << mesh << " to a batch\n";
+        return;
+    }
+    Submission submission;
+    submission.key = (static_cast<uint64_t>(bucket) << 32) | mesh;
+    submission.transform = transform;
+    submissions_.push_back(submission);
+    commands_dirty_ = true;
+}
+
+void MeshBatch::buildCommands() {
+    // Sort keys only, the matrices are gathered once in the final order
+    std::vector<std::pair<uint64_t, uint32_t> > order(submissions_.size());
+    for (size_t i = 0; i < submissions_.size(); ++i) {
+        order[i] = std::make_pair(submissions_[i].key, static_cast<uint32_t>(i));
+    }
+    std::sort(order.begin(), order.end());
+
+    std::vector<glm::mat4> transforms(order.size());
+    commands_.clear();
+    buckets_.clear();
+    for (size_t i = 0; i < order.size(); ++i) {
+        transforms[i] = submissions_[order[i].second].transform;
+
+        uint64_t key = order[i].first;
+        if (i > 0 && key == order[i - 1].first) {
+            ++commands_.back().instanceCount;
+            continue;
+        }
+
+        uint32_t bucket = static_cast<uint32_t>(key >> 32);
+        const Range &range = ranges_[static_cast<uint32_t>(key)];
+        DrawElementsIndirectCommand command;
+        command.count = range.indexCount;
+        command.instanceCount = 1;
+        command.firstIndex = range.firstIndex;
+        command.baseVertex = range.baseVertex;
+        command.baseInstance = static_cast<GLuint>(i);
+
+        if (bucket >= buckets_.size()) {
+            Bucket empty = {commands_.size(), 0};
+            buckets_.resize(bucket + 1, empty);
+        }
+        if (buckets_[bucket].commandCount == 0) {
+            buckets_[bucket].firstCommand = commands_.size();
+        }
+        ++buckets_[bucket].commandCount;
+        commands_.push_back(command);
+    }
+
+    // Orphan both buffers, draws of the previous frame may still read them
+    GLState::bindBuffer(GL_ARRAY_BUFFER, transform_buffer_);
+    transform_capacity_ = std::max(transforms.size(), transform_capacity_);
+    glBufferData(GL_ARRAY_BUFFER, transform_capacity_ * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, transforms.size() * sizeof(glm::mat4), transforms.data());
+
+    if (indirect_) {
+        GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer_);
+        indirect_capacity_ = std::max(commands_.size(), indirect_capacity_);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, indirect_capacity_ * sizeof(DrawElementsIndirectCommand), NULL,
+                     GL_STREAM_DRAW);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands_.size() * sizeof(DrawElementsIndirectCommand),
+                        commands_.data());
+    }
+
+    commands_dirty_ = false;
+}
+
+void MeshBatch::draw(uint32_t bucket) {
+    if (geometry_dirty_) {
+        uploadGeometry();
+    }
+    if (commands_dirty_) {
+        buildCommands();
+    }
+    if (bucket >= buckets_.size() || buckets_[bucket].commandCount == 0) {
+        return;
+    }
+
+    const Bucket &range = buckets_[bucket];
+    const size_t index_size = index_type_ == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+    GLState::bindVertexArray(vao_);
+
+    if (indirect_) {
+        GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer_);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, index_type_,
+                                    reinterpret_cast<GLvoid *>(range.firstCommand * sizeof(DrawElementsIndirectCommand)),
+                                    static_cast<GLsizei>(range.commandCount), 0);
+        return;
+    }
+
+    // GL 3.3 has no base instance, so the transform attribute is pointed at each command's first matrix
+    GLState::bindBuffer(GL_ARRAY_BUFFER, transform_buffer_);
+    for (size_t i = range.firstCommand; i < range.firstCommand + range.commandCount; ++i) {
+        const DrawElementsIndirectCommand &command = commands_[i];
+        for (GLuint column = 0; column < 4; ++column) {
+            glVertexAttribPointer(transform_location_ + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                  reinterpret_cast<GLvoid *>(command.baseInstance * sizeof(glm::mat4) +
+                                                             column * sizeof(glm::vec4)));
+        }
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, index_type_,
+                                          reinterpret_cast<GLvoid *>(command.firstIndex * index_size),
+                                          command.instanceCount, command.baseVertex);
+    }
+}
+
+size_t MeshBatch::drawCalls(uint32_t bucket) {
+    if (commands_dirty_) {
+        buildCommands();
+    }
+    if (bucket >= buckets_.size()) {
+        return 0;
+    }
+    size_t commands = buckets_[bucket].commandCount;
+    return indirect_ ? std::min<size_t>(commands, 1) : commands;
+}
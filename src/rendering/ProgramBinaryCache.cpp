@@ -0,0 +1,140 @@
+#include <rendering/ProgramBinaryCache.hpp>
+#include <rendering/GLCapabilities.hpp>
+#include <common/hash_utils.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+    const char BINARY_MAGIC[4] = {'G', 'L', 'P', 'B'};
+
+    std::string glString(GLenum name) {
+        const GLubyte *string = glGetString(name);
+        return string ? std::string(reinterpret_cast<const char *>(string)) : std::string();
+    }
+}
+
+std::string ProgramBinaryCache::directory_;
+bool ProgramBinaryCache::supported_ = false;
+
+void ProgramBinaryCache::setDirectory(const std::string &directory) {
+    directory_ = directory;
+
+#ifdef _WIN32
+    _mkdir(directory_.c_str());
+#else
+    mkdir(directory_.c_str(), 0755);
+#endif
+
+    GLint formats = 0;
+    if (GLCapabilities::supports("GL_ARB_get_program_binary")) {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    }
+    supported_ = formats > 0;
+
+    if (!supported_) {
+        std::cout << "Program binaries not supported by driver, shader cache disabled\n";
+    }
+}
+
+bool ProgramBinaryCache::isEnabled() {
+    return supported_ && !directory_.empty();
+}
+
+std::string ProgramBinaryCache::makeKey(const std::vector<GLuint> &stage_types, const std::vector<std::string> &sources) {
+    uint64_t hash = fnv1a_64(glString(GL_VENDOR));
+    hash = fnv1a_64(glString(GL_RENDERER), hash);
+    hash = fnv1a_64(glString(GL_VERSION), hash);
+
+    for (size_t i = 0; i < sources.size(); ++i) {
+        hash = fnv1a_64(&stage_types[i], sizeof(GLuint), hash);
+        hash = fnv1a_64(sources[i], hash);
+    }
+
+    return to_hex_string(hash);
+}
+
+std::string ProgramBinaryCache::pathForKey(const std::string &key) {
+    return directory_ + "/" + key + ".bin";
+}
+
+bool ProgramBinaryCache::load(const std::string &key, GLuint program) {
+    if (!isEnabled()) {
+        return false;
+    }
+
+    std::ifstream ifs(pathForKey(key).c_str(), std::ios::binary);
+    if (!ifs.is_open()) {
+        return false;
+    }
+
+    char magic[4];
+    uint32_t format = 0, length = 0;
+    ifs.read(magic, sizeof(magic));
+    ifs.read(reinterpret_cast<char *>(&format), sizeof(format));
+    ifs.read(reinterpret_cast<char *>(&length), sizeof(length));
+    if (!ifs || std::string(magic, 4) != std::string(BINARY_MAGIC, 4) || length == 0) {
+        return false;
+    }
+
+    std::vector<char> binary(length);
+    ifs.read(binary.data(), length);
+    if (!ifs) {
+        return false;
+    }
+
+    glProgramBinary(program, format, binary.data(), length);
+
+    // The driver may reject binaries from an older build of itself even when the strings match
+    GLint isLinked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &isLinked);
+    if (isLinked == GL_FALSE) {
+        std::cout << "Cached program binary " << key << " rejected by driver, recompiling\n";
+        return false;
+    }
+
+    return true;
+}
+
+void ProgramBinaryCache::store(const std::string &key, GLuint program) {
+    if (!isEnabled()) {
+        return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    // Write to a temporary file and rename so a crash never leaves a truncated binary behind
+    const std::string path = pathForKey(key);
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream ofs(tmp_path.c_str(), std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open()) {
+            std::cerr << "Could not write program binary " << tmp_path << std::endl;
+            return;
+        }
+
+        uint32_t format32 = format, length32 = static_cast<uint32_t>(length);
+        ofs.write(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+        ofs.write(reinterpret_cast<const char *>(&format32), sizeof(format32));
+        ofs.write(reinterpret_cast<const char *>(&length32), sizeof(length32));
+        ofs.write(binary.data(), length);
+    }
+    std::remove(path.c_str());
+    std::rename(tmp_path.c_str(), path.c_str());
+}
@@ -0,0 +1,149 @@
+#include <rendering/RenderQueue.hpp>
+#include <rendering/GLState.hpp>
+
+#include <iostream>
+#include <algorithm>
+
+RenderQueue::MaterialId RenderQueue::addMaterial(ShaderProgram &program, const std::vector<GLuint> &textures) {
+    uint32_t program_id = 0;
+    while (program_id < programs_.size() && programs_[program_id].program != &program) {
+        ++program_id;
+    }
+
+    // Ids beyond the key's fields would alias earlier ones and interleave their draws
+    if (materials_.size() == INVALID_MATERIAL) {
+        std::cerr << "Render queue is out of material ids\n";
+        return INVALID_MATERIAL;
+    }
+    if (program_id == programs_.size()) {
+        if (programs_.size() == (1u << 12)) {
+            std::cerr << "Render queue is out of program ids\n";
+            return INVALID_MATERIAL;
+        }
+        Program entry;
+        entry.program = &program;
+        entry.m = program.getUniformHandle("M");
+        programs_.push_back(entry);
+    }
+
+    Material material;
+    material.program = program_id;
+    material.textures = textures;
+    materials_.push_back(material);
+    return static_cast<MaterialId>(materials_.size() - 1);
+}
+
+void RenderQueue::setTextures(MaterialId material, const std::vector<GLuint> &textures) {
+    if (material >= materials_.size()) {
+        return;
+    }
+    materials_[material].textures = textures;
+}
+
+void RenderQueue::begin(const glm::mat4 &view, float far_plane) {
+    view_ = view;
+    far_plane_ = far_plane;
+    draws_.clear();
+    items_.clear();
+}
+
+void RenderQueue::submit(Pass pass, MaterialId material, const Mesh &mesh, const glm::mat4 &model) {
+    if (material >= materials_.size()) {
+        return;
+    }
+
+    // Depth of the object's origin, the camera looks down -z in view space
+    float view_z = view_[0][2] * model[3][0] + view_[1][2] * model[3][1] + view_[2][2] * model[3][2] + view_[3][2];
+    float depth = -view_z / far_plane_;
+
+    Item item;
+    item.key = makeKey(pass, materials_[material].program, material, depth);
+    item.index = static_cast<uint32_t>(draws_.size());
+    items_.push_back(item);
+
+    Draw draw;
+    draw.mesh = &mesh;
+    draw.material = material;
+    draw.model = model;
+    draws_.push_back(draw);
+}
+
+uint64_t RenderQueue::makeKey(Pass pass, uint32_t program, uint32_t material, float depth) {
+    const uint32_t DEPTH_MAX = (1u << 24) - 1;
+    depth = std::min(std::max(depth, 0.0f), 1.0f);
+    uint32_t quantized = static_cast<uint32_t>(depth * DEPTH_MAX);
+    if (pass == PASS_TRANSPARENT) {
+        quantized = DEPTH_MAX - quantized;
+    }
+
+    return (static_cast<uint64_t>(pass & 0xF) << 60) | (static_cast<uint64_t>(program & 0xFFF) << 48) |
+           (static_cast<uint64_t>(material & 0xFFFF) << 32) | (static_cast<uint64_t>(quantized) << 8);
+}
+
+void RenderQueue::radixSort(std::vector<Item> &items, std::vector<Item> &scratch) {
+    const size_t count = items.size();
+    if (count < 2) {
+        return;
+    }
+
+    // One read of the keys builds the histograms of all eight digits
+    size_t histograms[8][256] = {};
+    for (const Item &item : items) {
+        for (int digit = 0; digit < 8; ++digit) {
+            ++histograms[digit][(item.key >> (8 * digit)) & 0xFF];
+        }
+    }
+
+    scratch.resize(count);
+    Item *source = items.data();
+    Item *destination = scratch.data();
+    for (int digit = 0; digit < 8; ++digit) {
+        size_t *histogram = histograms[digit];
+        if (histogram[(source[0].key >> (8 * digit)) & 0xFF] == count) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (int bucket = 0; bucket < 256; ++bucket) {
+            size_t bucket_count = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucket_count;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            destination[histogram[(source[i].key >> (8 * digit)) & 0xFF]++] = source[i];
+        }
+        std::swap(source, destination);
+    }
+
+    if (source != items.data()) {
+        items.swap(scratch);
+    }
+}
+
+void RenderQueue::execute() {
+    radixSort(items_, scratch_);
+
+    uint32_t current_program = ~0u;
+    uint32_t current_material = ~0u;
+    const Program *program = NULL;
+    for (const Item &item : items_) {
+        const Draw &draw = draws_[item.index];
+
+        if (draw.material != current_material) {
+            current_material = draw.material;
+            const Material &material = materials_[current_material];
+
+            if (material.program != current_program) {
+                current_program = material.program;
+                program = &programs_[current_program];
+                (*program->program)();
+            }
+            for (size_t unit = 0; unit < material.textures.size(); ++unit) {
+                GLState::bindTexture(static_cast<GLuint>(unit), GL_TEXTURE_2D, material.textures[unit]);
+            }
+        }
+
+        program->program->set(program->m, draw.model);
+        draw.mesh->draw();
+    }
+}
@@ -0,0 +1,81 @@
+#include <rendering/ShaderBatch.hpp>
+
+#include <thread>
+#include <chrono>
+
+ShaderBatch::ShaderBatch() {
+    if (!ShaderProgram::parallelCompileSupported()) {
+        return;
+    }
+
+    // GLEW only loads the ARB entry point, a KHR-only driver exports the same function under its own name
+    PFNGLMAXSHADERCOMPILERTHREADSARBPROC maxShaderCompilerThreads = __glewMaxShaderCompilerThreadsARB;
+    if (!maxShaderCompilerThreads) {
+        maxShaderCompilerThreads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSARBPROC>(
+                glfwGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+    }
+    if (maxShaderCompilerThreads) {
+        // 0xFFFFFFFF lets the implementation pick the thread count
+        maxShaderCompilerThreads(0xFFFFFFFF);
+    }
+}
+
+std::shared_ptr<ShaderProgram> ShaderBatch::add(std::string vertex_shader_filename,
+                                                std::string tessellation_control_shader_filename,
+                                                std::string tessellation_eval_shader_filename,
+                                                std::string geometry_shader_filename,
+                                                std::string fragment_shader_filename,
+                                                const ShaderDefines &defines) {
+    Entry entry;
+    entry.name = vertex_shader_filename + " " + fragment_shader_filename;
+    entry.program = std::make_shared<ShaderProgram>(ShaderProgram::Deferred(), vertex_shader_filename,
+                                                    tessellation_control_shader_filename,
+                                                    tessellation_eval_shader_filename, geometry_shader_filename,
+                                                    fragment_shader_filename, defines);
+    entry.done = false;
+    entry.success = false;
+    entries_.push_back(entry);
+
+    return entry.program;
+}
+
+int ShaderBatch::finish() {
+    size_t remaining = 0;
+    for (const Entry &entry : entries_) {
+        if (!entry.done) {
+            ++remaining;
+        }
+    }
+
+    // Finish programs in the order the driver completes them
+    while (remaining > 0) {
+        bool progress = false;
+        for (Entry &entry : entries_) {
+            if (!entry.done && entry.program->isReady()) {
+                entry.success = entry.program->finish();
+                entry.done = true;
+                --remaining;
+                progress = true;
+            }
+        }
+
+        if (!progress) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+
+    int failed = 0;
+    for (const Entry &entry : entries_) {
+        if (!entry.success) {
+            ++failed;
+        }
+    }
+    return failed;
+}
+
+void ShaderBatch::printTimings(std::ostream &os) const {
+    for (const Entry &entry : entries_) {
+        os << entry.name << ": compile " << entry.program->compileMilliseconds() << " ms, link "
+           << entry.program->linkMilliseconds() << " ms" << (entry.success ? "" : " (failed)") << "\n";
+    }
+}
@@ -0,0 +1,109 @@
+#include <rendering/ShaderPreprocessor.hpp>
+#include <common/FileReader.hpp>
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+std::string ShaderPreprocessor::include_directory_ = "../shaders";
+
+void ShaderPreprocessor::setIncludeDirectory(const std::string &directory) {
+    include_directory_ = directory;
+}
+
+std::string ShaderPreprocessor::process(const std::string &filename, const ShaderDefines &defines,
+                                        std::vector<std::string> &dependencies) {
+    // Files of this stage only, includes shared with other stages must be expanded again
+    std::vector<std::string> files(1, filename);
+    const size_t source_index = 0;
+
+    std::string expanded;
+    expand(source_index, files, expanded);
+    dependencies.insert(dependencies.end(), files.begin(), files.end());
+
+    if (defines.empty()) {
+        return expanded;
+    }
+
+    std::string define_block;
+    for (const auto &define : defines) {
+        define_block += "#define " + define.first + " " + define.second + "\n";
+    }
+
+    // #version has to stay the first statement, so the defines go right after it
+    size_t version = expanded.find("#version");
+    if (version == std::string::npos) {
+        return define_block + "#line 1 " + std::to_string(source_index) + "\n" + expanded;
+    }
+
+    size_t line_end = expanded.find('\n', version);
+    size_t version_line = std::count(expanded.begin(), expanded.begin() + version, '\n') + 1;
+    if (line_end == std::string::npos) {
+        return expanded + "\n" + define_block;
+    }
+
+    return expanded.substr(0, line_end + 1) + define_block +
+           "#line " + std::to_string(version_line + 1) + " " + std::to_string(source_index) + "\n" +
+           expanded.substr(line_end + 1);
+}
+
+void ShaderPreprocessor::expand(size_t source_index, std::vector<std::string> &files, std::string &out) {
+    MappedFile file(files[source_index]);
+    const char *begin = file.data();
+    const char *end = begin + file.size();
+    out.reserve(out.size() + file.size());
+
+    // Lines without #include are copied straight from the mapping in runs
+    const char *run_start = begin;
+    size_t line_number = 0;
+
+    for (const char *line = begin; line < end;) {
+        const char *line_end = static_cast<const char *>(memchr(line, '\n', end - line));
+        if (!line_end) {
+            line_end = end;
+        }
+        ++line_number;
+
+        const char *start = line;
+        while (start < line_end && (*start == ' ' || *start == '\t')) {
+            ++start;
+        }
+
+        if (line_end - start < 8 || strncmp(start, "#include", 8) != 0) {
+            line = line_end + 1;
+            continue;
+        }
+
+        out.append(run_start, line);
+        run_start = line_end < end ? line_end + 1 : end;
+
+        std::string directive(start + 8, line_end);
+        size_t open = directive.find_first_of("\"<");
+        size_t close = open == std::string::npos ? open : directive.find_first_of("\">", open + 1);
+        if (close == std::string::npos) {
+            std::cerr << "Malformed #include in " << files[source_index] << ":" << line_number << std::endl;
+            out += '\n';
+            line = line_end + 1;
+            continue;
+        }
+
+        std::string path = include_directory_ + "/" + directive.substr(open + 1, close - open - 1);
+
+        // Include once, which also breaks include cycles
+        if (std::find(files.begin(), files.end(), path) == files.end()) {
+            files.push_back(path);
+            size_t include_index = files.size() - 1;
+
+            out += "#line 1 " + std::to_string(include_index) + "\n";
+            expand(include_index, files, out);
+            if (!out.empty() && out.back() != '\n') {
+                out += '\n';
+            }
+        }
+
+        out += "#line " + std::to_string(line_number + 1) + " " + std::to_string(source_index) + "\n";
+        line = line_end + 1;
+    }
+
+    out.append(run_start, end);
+}
@@ -1,54 +1,229 @@
 #include <rendering/ShaderProgram.hpp>
-#include <common/FileReader.hpp>
+#include <rendering/ProgramBinaryCache.hpp>
+#include <rendering/GLCapabilities.hpp>
+#include <rendering/GLState.hpp>
 
 #include <memory>
+#include <cstring>
 
+#include <glm/gtc/type_ptr.hpp>
+
+
+std::unordered_map<std::string, GLuint> ShaderProgram::block_bindings_;
 
 ShaderProgram::ShaderProgram(std::string vertex_shader_filename, std::string tessellation_control_shader_filename,
                              std::string tessellation_eval_shader_filename, std::string geometry_shader_filename,
-                             std::string fragment_shader_filename) {
+                             std::string fragment_shader_filename, const ShaderDefines &defines)
+        : ShaderProgram(Deferred(), vertex_shader_filename, tessellation_control_shader_filename,
+                        tessellation_eval_shader_filename, geometry_shader_filename, fragment_shader_filename,
+                        defines) {
 
-    if (vertex_shader_filename != "") {
-        auto v_source = FileReader::ReadFromFile(vertex_shader_filename);
-        AttachShader(GL_VERTEX_SHADER, v_source);
+    // There is no previous program to fall back to on the initial build
+    if (!finish()) {
+        exit(EXIT_FAILURE);
     }
-    if (tessellation_control_shader_filename != "") {
-        auto t_c_source = FileReader::ReadFromFile(tessellation_control_shader_filename);
-        AttachShader(GL_TESS_CONTROL_SHADER, t_c_source);
+}
+
+ShaderProgram::ShaderProgram(Deferred, std::string vertex_shader_filename,
+                             std::string tessellation_control_shader_filename,
+                             std::string tessellation_eval_shader_filename, std::string geometry_shader_filename,
+                             std::string fragment_shader_filename, const ShaderDefines &defines) {
+
+    const GLuint stage_types[] = {GL_VERTEX_SHADER, GL_TESS_CONTROL_SHADER, GL_TESS_EVALUATION_SHADER,
+                                  GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER};
+    const std::string stage_filenames[] = {vertex_shader_filename, tessellation_control_shader_filename,
+                                           tessellation_eval_shader_filename, geometry_shader_filename,
+                                           fragment_shader_filename};
+
+    // Read all stages first, the binary cache is keyed on the complete set of sources
+    std::vector<GLuint> types;
+    std::vector<std::string> sources;
+    stage_filenames_.assign(stage_filenames, stage_filenames + 5);
+    defines_ = defines;
+    for (int i = 0; i < 5; ++i) {
+        if (stage_filenames[i] != "") {
+            types.push_back(stage_types[i]);
+            sources.push_back(ShaderPreprocessor::process(stage_filenames[i], defines_, dependencies_));
+        }
     }
-    if (tessellation_eval_shader_filename != "") {
-        auto t_e_source = FileReader::ReadFromFile(tessellation_eval_shader_filename);
-        AttachShader(GL_TESS_EVALUATION_SHADER, t_e_source);
+
+    SubmitProgram(types, sources);
+}
+
+ShaderProgram::~ShaderProgram() {
+    for (GLuint shader_program : shader_programs_) {
+        glDeleteShader(shader_program);
     }
-    if (geometry_shader_filename != "") {
-        auto g_source = FileReader::ReadFromFile(geometry_shader_filename);
-        AttachShader(GL_GEOMETRY_SHADER, g_source);
+    GLState::deleteProgram(prog);
+
+}
+
+void ShaderProgram::SubmitProgram(const std::vector<GLuint> &types, const std::vector<std::string> &sources) {
+    submit_time_ = Clock::now();
+
+    if (ProgramBinaryCache::isEnabled()) {
+        cache_key_ = ProgramBinaryCache::makeKey(types, sources);
+
+        prog = glCreateProgram();
+        if (ProgramBinaryCache::load(cache_key_, prog)) {
+            std::cout << "Loaded cached program binary " << cache_key_ << "\n";
+            from_cache_ = true;
+            return;
+        }
+        GLState::deleteProgram(prog);
     }
-    if (fragment_shader_filename != "") {
-        auto f_source = FileReader::ReadFromFile(fragment_shader_filename);
-        AttachShader(GL_FRAGMENT_SHADER, f_source);
+
+    // Only submit work here, status queries are deferred to finish() so the driver can overlap compiles
+    for (size_t i = 0; i < types.size(); ++i) {
+        AttachShader(types[i], sources[i]);
     }
 
     //Link shaders
     ConfigureShaderProgram();
+}
+
+bool ShaderProgram::parallelCompileSupported() {
+    return GLCapabilities::hasExtension("GL_ARB_parallel_shader_compile") ||
+           GLCapabilities::hasExtension("GL_KHR_parallel_shader_compile");
+}
+
+void ShaderProgram::bindUniformBlock(const std::string &block_name, GLuint binding) {
+    block_bindings_[block_name] = binding;
+}
+
+bool ShaderProgram::isReady() {
+    if (finished_ || from_cache_ || !parallelCompileSupported()) {
+        return true;
+    }
+
+    if (!compiled_) {
+        for (GLuint shader : shader_programs_) {
+            GLint done = GL_FALSE;
+            glGetShaderiv(shader, GL_COMPLETION_STATUS_ARB, &done);
+            if (done == GL_FALSE) {
+                return false;
+            }
+        }
+        compiled_ = true;
+        compile_done_time_ = Clock::now();
+    }
+
+    GLint done = GL_FALSE;
+    glGetProgramiv(prog, GL_COMPLETION_STATUS_ARB, &done);
+    if (done == GL_FALSE) {
+        return false;
+    }
+
+    linked_ = true;
+    link_done_time_ = Clock::now();
+    return true;
+}
+
+bool ShaderProgram::finish() {
+    if (finished_) {
+        return true;
+    }
+    finished_ = true;
+
+    if (from_cache_) {
+        compile_done_time_ = link_done_time_ = Clock::now();
+        QueryUniforms();
+        BindUniformBlocks();
+        return true;
+    }
+
+    // Without parallel compile these queries block until the driver is done
+    bool success = true;
+    for (size_t i = 0; i < shader_programs_.size(); ++i) {
+        success = CheckCompileStatus(shader_programs_[i], shader_types_[i]) && success;
+    }
+    if (!compiled_) {
+        compile_done_time_ = Clock::now();
+    }
+
+    success = success && CheckLinkStatus();
+    if (!linked_) {
+        link_done_time_ = Clock::now();
+    }
+
+    if (!success) {
+        return false;
+    }
+
+    if (!cache_key_.empty()) {
+        ProgramBinaryCache::store(cache_key_, prog);
+    }
 
     //Detach shaders after successful linking
     for (GLuint shader_program : shader_programs_) {
         glDetachShader(prog, shader_program);
     }
+
+    QueryUniforms();
+    BindUniformBlocks();
+    return true;
 }
 
-ShaderProgram::~ShaderProgram() {
-    for (GLuint shader_program : shader_programs_) {
-        glDeleteShader(shader_program);
+void ShaderProgram::watch(FileWatcher &watcher) {
+    watcher_ = &watcher;
+    for (const std::string &filename : dependencies_) {
+        watcher.watch(filename);
     }
-    glDeleteProgram(prog);
+}
+
+bool ShaderProgram::dependsOn(const std::string &filename) const {
+    for (const std::string &dependency : dependencies_) {
+        if (dependency == filename) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ShaderProgram::reload() {
+    ShaderProgram fresh(Deferred(), stage_filenames_[0], stage_filenames_[1], stage_filenames_[2],
+                        stage_filenames_[3], stage_filenames_[4], defines_);
+
+    if (!fresh.finish()) {
+        log_ = fresh.log_;
+        std::cerr << "Shader reload failed, keeping previous program" << std::endl;
+        return false;
+    }
+
+    // Swap in the new objects, the old ones are released when fresh goes out of scope
+    std::swap(prog, fresh.prog);
+    std::swap(shader_programs_, fresh.shader_programs_);
+    std::swap(shader_types_, fresh.shader_types_);
+    std::swap(cache_key_, fresh.cache_key_);
+    std::swap(from_cache_, fresh.from_cache_);
+    std::swap(dependencies_, fresh.dependencies_);
+    log_.clear();
+
+    // The edit may have added includes
+    if (watcher_) {
+        watch(*watcher_);
+    }
+
+    // Handles stay valid, only their locations are resolved again
+    QueryUniforms();
+    BindUniformBlocks();
 
+    std::cout << "Reloaded shader program " << prog << "\n";
+    return true;
+}
+
+double ShaderProgram::compileMilliseconds() const {
+    return std::chrono::duration<double, std::milli>(compile_done_time_ - submit_time_).count();
+}
+
+double ShaderProgram::linkMilliseconds() const {
+    return std::chrono::duration<double, std::milli>(link_done_time_ - submit_time_).count();
 }
 
 GLuint ShaderProgram::AttachShader(GLuint shaderType, std::string source) {
     GLuint sh = compile(shaderType, source.c_str());
     shader_programs_.push_back(sh);
+    shader_types_.push_back(shaderType);
 
     std::cout << "Attached shader of type: '" << getShaderType(shaderType) << "'\n";
 
@@ -62,21 +237,165 @@ void ShaderProgram::ConfigureShaderProgram() {
         glAttachShader(prog, shader_program);
     }
 
+    if (ProgramBinaryCache::isEnabled()) {
+        glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
     glLinkProgram(prog);
+}
 
+bool ShaderProgram::CheckLinkStatus() {
     GLint isLinked;
     glGetProgramiv(prog, GL_LINK_STATUS, (int *) &isLinked);
 
     if (isLinked == GL_FALSE) {
         GLint length;
-        glGetShaderiv(prog, GL_INFO_LOG_LENGTH, &length);
+        glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &length);
         std::string log(length, ' ');
-        glGetShaderInfoLog(prog, length, &length, &log[0]);
+        glGetProgramInfoLog(prog, length, &length, &log[0]);
         std::cerr << "Failed to link shaderprogram : " << std::endl
         << log << std::endl;
-        exit(EXIT_FAILURE);
-    } else {
-        std::cout << "Shader linking complete!\n";
+        log_ += log;
+        return false;
+    }
+
+    std::cout << "Shader linking complete!\n";
+    return true;
+}
+
+void ShaderProgram::QueryUniforms() {
+    // Keep existing handles valid across reloads, uniforms that disappeared end up with location -1
+    for (Uniform &uniform : uniforms_) {
+        uniform.location = -1;
+        uniform.uploaded = false;
+    }
+
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(prog, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(prog, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::string name(maxLength, ' ');
+    for (GLint i = 0; i < count; ++i) {
+        Uniform uniform;
+        GLsizei length = 0;
+        glGetActiveUniform(prog, i, maxLength, &length, &uniform.size, &uniform.type, &name[0]);
+        uniform.name = name.substr(0, length);
+        uniform.location = glGetUniformLocation(prog, uniform.name.c_str());
+        uniform.uploaded = false;
+
+        // Members of uniform blocks have no location and are not set through glUniform*
+        if (uniform.location < 0) {
+            continue;
+        }
+
+        auto existing = uniform_handles_.find(uniform.name);
+        if (existing != uniform_handles_.end()) {
+            uniforms_[existing->second] = uniform;
+            continue;
+        }
+
+        UniformHandle handle = static_cast<UniformHandle>(uniforms_.size());
+        uniform_handles_[uniform.name] = handle;
+
+        // Arrays are reported as "name[0]", also make them reachable as "name"
+        size_t bracket = uniform.name.find('[');
+        if (bracket != std::string::npos) {
+            uniform_handles_[uniform.name.substr(0, bracket)] = handle;
+        }
+
+        uniforms_.push_back(uniform);
+    }
+}
+
+void ShaderProgram::BindUniformBlocks() {
+    // Block bindings are program state, a new program object (reload, cache hit) starts at binding 0
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(prog, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(prog, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+
+    std::string name(maxLength, ' ');
+    for (GLint i = 0; i < count; ++i) {
+        GLsizei length = 0;
+        glGetActiveUniformBlockName(prog, i, maxLength, &length, &name[0]);
+
+        auto binding = block_bindings_.find(name.substr(0, length));
+        if (binding == block_bindings_.end()) {
+            std::cerr << "Uniform block '" << name.substr(0, length) << "' in program " << prog
+                      << " has no registered binding\n";
+            continue;
+        }
+        glUniformBlockBinding(prog, i, binding->second);
+    }
+}
+
+ShaderProgram::UniformHandle ShaderProgram::getUniformHandle(const std::string &name) const {
+    auto it = uniform_handles_.find(name);
+    if (it == uniform_handles_.end()) {
+#ifdef MY_DEBUG
+        std::cerr << "Uniform '" << name << "' is not active in program " << prog << std::endl;
+#endif
+        return -1;
+    }
+    return it->second;
+}
+
+bool ShaderProgram::UpdateUniformCache(UniformHandle handle, const void *value, size_t bytes) {
+    if (handle < 0 || handle >= static_cast<UniformHandle>(uniforms_.size())) {
+        return false;
+    }
+
+    Uniform &uniform = uniforms_[handle];
+    if (uniform.location < 0) {
+        return false;
+    }
+    if (uniform.uploaded && std::memcmp(uniform.value, value, bytes) == 0) {
+        return false;
+    }
+
+    std::memcpy(uniform.value, value, bytes);
+    uniform.uploaded = true;
+    return true;
+}
+
+void ShaderProgram::set(UniformHandle handle, GLint value) {
+    if (UpdateUniformCache(handle, &value, sizeof(value))) {
+        glUniform1i(uniforms_[handle].location, value);
+    }
+}
+
+void ShaderProgram::set(UniformHandle handle, GLfloat value) {
+    if (UpdateUniformCache(handle, &value, sizeof(value))) {
+        glUniform1f(uniforms_[handle].location, value);
+    }
+}
+
+void ShaderProgram::set(UniformHandle handle, const glm::vec2 &value) {
+    if (UpdateUniformCache(handle, glm::value_ptr(value), sizeof(value))) {
+        glUniform2fv(uniforms_[handle].location, 1, glm::value_ptr(value));
+    }
+}
+
+void ShaderProgram::set(UniformHandle handle, const glm::vec3 &value) {
+    if (UpdateUniformCache(handle, glm::value_ptr(value), sizeof(value))) {
+        glUniform3fv(uniforms_[handle].location, 1, glm::value_ptr(value));
+    }
+}
+
+void ShaderProgram::set(UniformHandle handle, const glm::vec4 &value) {
+    if (UpdateUniformCache(handle, glm::value_ptr(value), sizeof(value))) {
+        glUniform4fv(uniforms_[handle].location, 1, glm::value_ptr(value));
+    }
+}
+
+void ShaderProgram::set(UniformHandle handle, const glm::mat3 &value) {
+    if (UpdateUniformCache(handle, glm::value_ptr(value), sizeof(value))) {
+        glUniformMatrix3fv(uniforms_[handle].location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+}
+
+void ShaderProgram::set(UniformHandle handle, const glm::mat4 &value) {
+    if (UpdateUniformCache(handle, glm::value_ptr(value), sizeof(value))) {
+        glUniformMatrix4fv(uniforms_[handle].location, 1, GL_FALSE, glm::value_ptr(value));
     }
 }
 
@@ -109,6 +428,10 @@ GLuint ShaderProgram::compile(GLuint type, GLchar const *source) {
     GLuint shader = glCreateShader(type);
     glShaderSource(shader, 1, &source, NULL);
     glCompileShader(shader);
+    return shader;
+}
+
+bool ShaderProgram::CheckCompileStatus(GLuint shader, GLuint type) {
     GLint compiled = 0;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
     if (compiled == GL_FALSE) {
@@ -118,8 +441,8 @@ GLuint ShaderProgram::compile(GLuint type, GLchar const *source) {
         glGetShaderInfoLog(shader, logSize, &logSize, &log[0]);
         std::cerr << "Failed to compile shadertype: " << getShaderType(type) << std::endl
         << log << std::endl;
-        glDeleteShader(shader); // Don't leak the shader.
-        exit(EXIT_FAILURE);
+        log_ += getShaderType(type) + ": " + log;
+        return false;
     }
-    return shader;
+    return true;
 }
@@ -0,0 +1,65 @@
+#include <rendering/ShaderVariantCache.hpp>
+
+#include <iostream>
+
+std::string ShaderVariantCache::makeKey(const std::string &vertex_shader_filename,
+                                        const std::string &fragment_shader_filename, const ShaderDefines &defines,
+                                        const std::string &geometry_shader_filename) {
+    // Identity of the variant, not its current sources, so edits don't move it to another key.
+    // Names and values can't contain '\0', and the defines are ordered
+    std::string key = vertex_shader_filename + '\0' + geometry_shader_filename + '\0' + fragment_shader_filename;
+    for (const auto &define : defines) {
+        key += '\0' + define.first + '=' + define.second;
+    }
+    return key;
+}
+
+std::shared_ptr<ShaderProgram> ShaderVariantCache::get(const std::string &vertex_shader_filename,
+                                                       const std::string &fragment_shader_filename,
+                                                       const ShaderDefines &defines,
+                                                       const std::string &geometry_shader_filename) {
+    std::string key = makeKey(vertex_shader_filename, fragment_shader_filename, defines, geometry_shader_filename);
+
+    auto it = programs_.find(key);
+    if (it != programs_.end()) {
+        return it->second.program;
+    }
+
+    // The blocking constructor exits on failure, a bad permutation should not take the process down
+    std::shared_ptr<ShaderProgram> program = std::make_shared<ShaderProgram>(
+            ShaderProgram::Deferred(), vertex_shader_filename, "", "", geometry_shader_filename,
+            fragment_shader_filename, defines);
+    if (!program->finish()) {
+        std::cerr << "Could not build shader variant of " << vertex_shader_filename << " and "
+                  << fragment_shader_filename << "\n";
+        return std::shared_ptr<ShaderProgram>();
+    }
+
+    Variant variant;
+    variant.vertex_shader_filename = vertex_shader_filename;
+    variant.fragment_shader_filename = fragment_shader_filename;
+    variant.geometry_shader_filename = geometry_shader_filename;
+    variant.defines = defines;
+    variant.program = program;
+    programs_[key] = variant;
+
+    return variant.program;
+}
+
+void ShaderVariantCache::watch(FileWatcher &watcher) {
+    for (auto &entry : programs_) {
+        entry.second.program->watch(watcher);
+    }
+}
+
+void ShaderVariantCache::reload(const std::vector<std::string> &changed_files) {
+    // A failed reload keeps the previous program, either way the variant stays under its key
+    for (auto &entry : programs_) {
+        for (const std::string &file : changed_files) {
+            if (entry.second.program->dependsOn(file)) {
+                entry.second.program->reload();
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,115 @@
+#include <rendering/StreamBuffer.hpp>
+#include <rendering/GLCapabilities.hpp>
+#include <rendering/GLState.hpp>
+
+#include <iostream>
+#include <cstring>
+
+// The buffer is only bound to GL_COPY_WRITE_BUFFER here, so no vertex, index or uniform binding is disturbed
+
+StreamBuffer::StreamBuffer(size_t frame_bytes, unsigned int frames)
+        : frame_bytes_((frame_bytes + 255) & ~static_cast<size_t>(255)), frames_(frames > 0 ? frames : 1),
+          fences_(frames_, static_cast<GLsync>(0)), frame_(frames_ - 1) {
+    const size_t total = frame_bytes_ * frames_;
+
+    glGenBuffers(1, &buffer_);
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+    if (GLCapabilities::supports("GL_ARB_buffer_storage")) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, total, NULL, flags);
+        mapped_ = static_cast<unsigned char *>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total, flags));
+        persistent_ = mapped_ != NULL;
+
+        if (!persistent_) {
+            // Immutable storage can't be respecified, start over with a mutable buffer
+            std::cerr << "Could not map the stream buffer persistently, falling back to copies\n";
+            GLState::deleteBuffers(1, &buffer_);
+            glGenBuffers(1, &buffer_);
+            GLState::bindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+        }
+    }
+    if (!persistent_) {
+        glBufferData(GL_COPY_WRITE_BUFFER, total, NULL, GL_STREAM_DRAW);
+        staging_.resize(frame_bytes_);
+    }
+}
+
+StreamBuffer::~StreamBuffer() {
+    for (GLsync fence : fences_) {
+        if (fence) {
+            glDeleteSync(fence);
+        }
+    }
+    if (persistent_) {
+        GLState::bindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    }
+    GLState::deleteBuffers(1, &buffer_);
+}
+
+void StreamBuffer::beginFrame() {
+    frame_ = (frame_ + 1) % frames_;
+    head_ = 0;
+    flushed_ = 0;
+
+    GLsync &fence = fences_[frame_];
+    if (!fence) {
+        return;
+    }
+
+    if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+        ++stalls_;
+        if (persistent_) {
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+            }
+        } else {
+            // Fresh storage for the whole ring, the old one is freed once the GPU is done with it
+            GLState::bindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+            glBufferData(GL_COPY_WRITE_BUFFER, frame_bytes_ * frames_, NULL, GL_STREAM_DRAW);
+            for (GLsync &other : fences_) {
+                if (other && other != fence) {
+                    glDeleteSync(other);
+                    other = 0;
+                }
+            }
+        }
+    }
+    glDeleteSync(fence);
+    fence = 0;
+}
+
+StreamBuffer::Slice StreamBuffer::allocate(size_t bytes, size_t alignment) {
+    Slice slice = {NULL, buffer_, 0, static_cast<GLsizeiptr>(bytes)};
+
+    // Regions start at multiples of 256, so aligning within the region aligns in the buffer
+    size_t offset = (head_ + alignment - 1) & ~(alignment - 1);
+    if (offset + bytes > frame_bytes_) {
+        return slice;
+    }
+    head_ = offset + bytes;
+
+    slice.offset = static_cast<GLintptr>(frame_ * frame_bytes_ + offset);
+    slice.data = persistent_ ? mapped_ + slice.offset : &staging_[offset];
+    return slice;
+}
+
+void StreamBuffer::flush() {
+    if (persistent_ || head_ == flushed_) {
+        return;
+    }
+
+    // The fence said the GPU is done with this region, so the driver need not sync
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+    void *ptr = glMapBufferRange(GL_COPY_WRITE_BUFFER, frame_ * frame_bytes_ + flushed_, head_ - flushed_, flags);
+    if (ptr) {
+        memcpy(ptr, &staging_[flushed_], head_ - flushed_);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    }
+    flushed_ = head_;
+}
+
+void StreamBuffer::endFrame() {
+    flush();
+    fences_[frame_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,149 @@
+#include <rendering/TextureIndex.hpp>
+
+#include <SOIL.h>
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cctype>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+namespace {
+    bool hasImageExtension(const std::string &name) {
+        static const char *extensions[] = {"jpg", "jpeg", "png", "bmp", "tga", "psd", "hdr", "dds"};
+
+        size_t dot = name.find_last_of('.');
+        if (dot == std::string::npos) {
+            return false;
+        }
+        std::string extension = name.substr(dot + 1);
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        for (const char *image_extension : extensions) {
+            if (extension == image_extension) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Appends the image files below directory, subdirectories included
+    void listImages(const std::string &directory, std::vector<std::string> &files) {
+#ifdef _WIN32
+        struct _finddata_t data;
+        intptr_t handle = _findfirst((directory + "/*").c_str(), &data);
+        if (handle == -1) {
+            return;
+        }
+        do {
+            std::string name = data.name;
+            if (name == "." || name == "..") {
+                continue;
+            }
+            std::string path = directory + "/" + name;
+            if (data.attrib & _A_SUBDIR) {
+                listImages(path, files);
+            } else if (hasImageExtension(name)) {
+                files.push_back(path);
+            }
+        } while (_findnext(handle, &data) == 0);
+        _findclose(handle);
+#else
+        DIR *dir = opendir(directory.c_str());
+        if (dir == NULL) {
+            return;
+        }
+        while (struct dirent *entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name == "." || name == "..") {
+                continue;
+            }
+            std::string path = directory + "/" + name;
+
+            // Most file systems fill in d_type, which saves a stat per file
+            bool known = false, is_directory = false;
+#ifdef _DIRENT_HAVE_D_TYPE
+            if (entry->d_type != DT_UNKNOWN && entry->d_type != DT_LNK) {
+                known = true;
+                is_directory = entry->d_type == DT_DIR;
+            }
+#endif
+            if (!known) {
+                struct stat st;
+                is_directory = stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+            }
+
+            if (is_directory) {
+                listImages(path, files);
+            } else if (hasImageExtension(name)) {
+                files.push_back(path);
+            }
+        }
+        closedir(dir);
+#endif
+    }
+}
+
+TextureIndex::TextureIndex(const std::string &directory, unsigned int threads) {
+    std::vector<std::string> files;
+    listImages(directory, files);
+    std::sort(files.begin(), files.end());
+
+    // Headers are a few hundred bytes, so probing is bound by file open latency; threads hide it
+    std::vector<Entry> probed(files.size());
+    std::vector<char> valid(files.size(), 0);
+    std::atomic<size_t> next(0);
+    auto probe = [&]() {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            Entry &entry = probed[i];
+            entry.path = files[i];
+            valid[i] = SOIL_image_info(files[i].c_str(), &entry.width, &entry.height, &entry.channels) != 0;
+        }
+    };
+
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned int>(std::min<size_t>(threads, std::max<size_t>(files.size(), 1)));
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threads; ++i) {
+        workers.push_back(std::thread(probe));
+    }
+    probe();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    entries_.reserve(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (valid[i]) {
+            entries_.push_back(probed[i]);
+        } else {
+            std::cerr << "Could not read image header of " << files[i] << std::endl;
+        }
+    }
+}
+
+const std::vector<TextureIndex::Entry> &TextureIndex::entries() const {
+    return entries_;
+}
+
+const TextureIndex::Entry *TextureIndex::find(const std::string &path) const {
+    auto it = std::lower_bound(entries_.begin(), entries_.end(), path,
+                               [](const Entry &entry, const std::string &key) { return entry.path < key; });
+    return it != entries_.end() && it->path == path ? &*it : NULL;
+}
+
+size_t TextureIndex::decodedBytes() const {
+    size_t bytes = 0;
+    for (const Entry &entry : entries_) {
+        bytes += static_cast<size_t>(entry.width) * entry.height * entry.channels;
+    }
+    return bytes;
+}
@@ -1,46 +1,77 @@
 #include <rendering/TextureManager.hpp>
+#include <common/FileReader.hpp>
+#include <rendering/GLCapabilities.hpp>
+#include <rendering/GLState.hpp>
+
+#include <SOIL.h>
+#include <string.h>
+
+extern "C" {
+#include <image_DXT.h>
+}
+
+#include <iostream>
+#include <utility>
 
 
 // Simple helper to make a single buffer object.
 GLuint makeBO(GLenum type, void* data, GLsizei size, GLenum accessFlags) {
     GLuint bo;
     glGenBuffers(1, &bo);
-    glBindBuffer(type, bo);
+    GLState::bindBuffer(type, bo);
     glBufferData(type, size, data, accessFlags);
     return(bo);
 }
 
+// Number of levels in a full mip chain down to 1x1
+int mipLevelCount(int w, int h) {
+	int levels = 1;
+	int size = w > h ? w : h;
+	while(size > 1) {
+		size >>= 1;
+		levels++;
+	}
+	return levels;
+}
+
+// Allocate storage for all levels of the bound GL_TEXTURE_2D in one call.
+// Immutable storage lets the driver skip completeness checks on every bind, older
+// contexts get the levels one by one and MAX_LEVEL set to match.
+void allocateTexture2D(GLsizei levels, GLint internalFormat, GLsizei w, GLsizei h, GLenum format, GLenum type) {
+	if(GLCapabilities::supports("GL_ARB_texture_storage")) {
+		glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat, w, h);
+		return;
+	}
+
+	for(GLsizei level = 0; level < levels; level++) {
+		glTexImage2D(GL_TEXTURE_2D, level, internalFormat, w, h, 0, format, type, NULL);
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+}
+
 // Helper function to make a buffer object of some size
 GLuint makeTextureBuffer(int w, int h, GLenum format, GLint internalFormat) {
 	GLuint buffertex;
 
 	glGenTextures(1, &buffertex);
-	glBindTexture(GL_TEXTURE_2D, buffertex);
+	GLState::bindTexture(GL_TEXTURE_2D, buffertex);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
-	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, format, GL_FLOAT, NULL);
+	allocateTexture2D(1, internalFormat, w, h, format, GL_FLOAT);
 
 	return buffertex;
 }
 
 // Load text from a file.
 char* loadFile(char* name) {
-	long size;
-	char* buffer;
-	FILE* fp = fopen(name, "rb");
-	fseek(fp, 0, SEEK_END);
-	size = ftell(fp);
-	buffer = (char*)malloc(size + 1);
-	fseek(fp, 0, SEEK_SET);
-	int res = fread(buffer, 1, size, fp);
-	if(res != size) {
+	char* buffer = FileReader::ReadBytes(name);
+	if(buffer == NULL) {
 		exit(-1);
 	}
-	fclose(fp);
-	buffer[size] = '\0';
 	return(buffer);
 }
 
@@ -163,7 +194,7 @@ GLuint loadTexture(const char *filename) {
 	// Generate texture, bind as active texture.
 	GLuint texture;
 	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
+	GLState::bindTexture(GL_TEXTURE_2D, texture);
 
 	// Texture parameters
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -172,17 +203,12 @@ GLuint loadTexture(const char *filename) {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
 	// Load pixels from buffer into texture.
-	glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			alpha == 1 ? GL_RGBA8 : GL_RGB8,
-			width,
-			height,
-			0,
-			alpha == 1 ? GL_BGRA : GL_BGR,
-			GL_UNSIGNED_BYTE,
-			pixels
-	);
+	GLenum format = alpha == 1 ? GL_BGRA : GL_BGR;
+	allocateTexture2D(mipLevelCount(width, height), alpha == 1 ? GL_RGBA8 : GL_RGB8, width, height, format,
+			GL_UNSIGNED_BYTE);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, pixels);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 	glGenerateMipmap(GL_TEXTURE_2D);
 
 	// Release buffer.
@@ -197,44 +223,66 @@ GLuint genFloatTexture(float *data, int width, int height) {
 	// Generate texture, bind as active texture.
 	GLuint texture;
 	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
+	GLState::bindTexture(GL_TEXTURE_2D, texture);
 
 	// Texture parameters
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
 
 	// Load pixels from buffer into texture.
-	glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_R32F,
-			width,
-			height,
-			0,
-			GL_RED,
-			GL_FLOAT,
-			data
-	);
+	allocateTexture2D(1, GL_R32F, width, height, GL_RED, GL_FLOAT);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_FLOAT, data);
 
 	return texture;
 }
 
-uint8_t* readFileBytes(const char *name)  {
-    FILE *fl = fopen(name, "r");
-    fseek(fl, 0, SEEK_END);
-    long len = ftell(fl);
-    uint8_t *ret = (uint8_t*)malloc(len);
-    fseek(fl, 0, SEEK_SET);
-    fread(ret, 1, len, fl);
-    fclose(fl);
-    return ret;
+// Upload a [0,1] float image, e.g. a heightmap from loadPGM, as a single channel BC4 (RGTC1) texture:
+// an eighth of the memory and bandwidth of genFloatTexture, at 8-bit precision.
+GLuint genCompressedFloatTexture(const float *data, int width, int height) {
+	std::vector<unsigned char> bytes(width * height);
+	for(int i = 0; i < width * height; i++) {
+		float v = data[i] < 0.0f ? 0.0f : (data[i] > 1.0f ? 1.0f : data[i]);
+		bytes[i] = (unsigned char)(v * 255.0f + 0.5f);
+	}
+
+	int size = 0;
+	unsigned char *blocks = convert_image_to_BC4(bytes.data(), width, height, 1, &size);
+	if(blocks == NULL) {
+		fprintf(stderr, "BC4 compression of a %dx%d image failed\n", width, height);
+		return 0;
+	}
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	GLState::bindTexture(GL_TEXTURE_2D, texture);
+
+	// Texture parameters
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	if(GLCapabilities::supports("GL_ARB_texture_storage")) {
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_COMPRESSED_RED_RGTC1, width, height);
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_COMPRESSED_RED_RGTC1, size, blocks);
+	} else {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RED_RGTC1, width, height, 0, size, blocks);
+	}
+	free(blocks);
+
+	return texture;
 }
 
 float* loadPGM(const char* fileName, int w, int h) {
-    uint8_t* inputData = readFileBytes(fileName);
+    // Parse straight from the mapping, no copy of the file
+    MappedFile file(fileName);
+    const uint8_t* inputData = (const uint8_t*)file.data();
+    if(inputData == NULL) {
+        return NULL;
+    }
 
     // Remove header
     int pos = 0;
@@ -261,6 +309,11 @@ float* loadPGM(const char* fileName, int w, int h) {
     }
     pos++;
 
+    if(file.size() < (size_t)pos + 2 * (size_t)w * h) {
+        fprintf(stderr, "%s is too small for a %dx%d 16-bit image\n", fileName, w, h);
+        return NULL;
+    }
+
     float* dataFloats = (float*)malloc(sizeof(float) * w * h);
     float minv = 100000000000000.0f;
     float maxv = 0.0f;
@@ -280,7 +333,247 @@ float* loadPGM(const char* fileName, int w, int h) {
         dataFloats[i] = (dataFloats[i] - minv) / (maxv - minv);
     }
 
-    free(inputData);
-
     return dataFloats;
 }
+
+
+
+// Load a DXT1/DXT5/BC4/BC5 DDS file with all of its mip levels, as written by texbake.
+// The blocks are uploaded as they are, no decoding or mipmap generation happens here.
+GLuint loadCompressedTexture(const char *filename) {
+	MappedFile file(filename);
+	if(!file.isOpen() || file.size() < sizeof(DDS_header)) {
+		fprintf(stderr, "Unable to open %s for reading\n", filename);
+		return 0;
+	}
+
+	DDS_header header;
+	memcpy(&header, file.data(), sizeof(header));
+	if(header.dwMagic != (('D' << 0) | ('D' << 8) | ('S' << 16) | (' ' << 24)) ||
+			!(header.sPixelFormat.dwFlags & DDPF_FOURCC)) {
+		fprintf(stderr, "%s is not a compressed DDS file\n", filename);
+		return 0;
+	}
+
+	GLenum internalFormat;
+	int blockBytes;
+	if(header.sPixelFormat.dwFourCC == (('D' << 0) | ('X' << 8) | ('T' << 16) | ('1' << 24))) {
+		internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		blockBytes = 8;
+	} else if(header.sPixelFormat.dwFourCC == (('D' << 0) | ('X' << 8) | ('T' << 16) | ('5' << 24))) {
+		internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		blockBytes = 16;
+	} else if(header.sPixelFormat.dwFourCC == (('A' << 0) | ('T' << 8) | ('I' << 16) | ('1' << 24)) ||
+			header.sPixelFormat.dwFourCC == (('B' << 0) | ('C' << 8) | ('4' << 16) | ('U' << 24))) {
+		internalFormat = GL_COMPRESSED_RED_RGTC1;
+		blockBytes = 8;
+	} else if(header.sPixelFormat.dwFourCC == (('A' << 0) | ('T' << 8) | ('I' << 16) | ('2' << 24)) ||
+			header.sPixelFormat.dwFourCC == (('B' << 0) | ('C' << 8) | ('5' << 16) | ('U' << 24))) {
+		internalFormat = GL_COMPRESSED_RG_RGTC2;
+		blockBytes = 16;
+	} else {
+		fprintf(stderr, "%s is not DXT1, DXT5, BC4 or BC5\n", filename);
+		return 0;
+	}
+
+	// RGTC is core since GL 3.0
+	bool rgtc = internalFormat == GL_COMPRESSED_RED_RGTC1 || internalFormat == GL_COMPRESSED_RG_RGTC2;
+	if(!rgtc && !GLCapabilities::supports("GL_EXT_texture_compression_s3tc")) {
+		fprintf(stderr, "S3TC textures not supported, cannot load %s\n", filename);
+		return 0;
+	}
+
+	int width = header.dwWidth;
+	int height = header.dwHeight;
+	int levels = (header.dwFlags & DDSD_MIPMAPCOUNT) && header.dwMipMapCount > 0 ? header.dwMipMapCount : 1;
+	bool immutable = GLCapabilities::supports("GL_ARB_texture_storage");
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	GLState::bindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	if(immutable) {
+		glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat, width, height);
+	} else {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	}
+
+	size_t offset = sizeof(DDS_header);
+	for(int level = 0; level < levels; level++) {
+		GLsizei size = ((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+		if(offset + size > file.size()) {
+			fprintf(stderr, "%s is truncated at mip level %d\n", filename, level);
+			GLState::deleteTextures(1, &texture);
+			return 0;
+		}
+
+		if(immutable) {
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, internalFormat, size,
+					file.data() + offset);
+		} else {
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, width, height, 0, size,
+					file.data() + offset);
+		}
+
+		offset += size;
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+TextureHandle::TextureHandle() : manager_(NULL), slot_(0) {
+}
+
+TextureHandle::TextureHandle(TextureManager *manager, size_t slot) : manager_(manager), slot_(slot) {
+    manager_->addReference(slot_);
+}
+
+TextureHandle::TextureHandle(const TextureHandle &other) : manager_(other.manager_), slot_(other.slot_) {
+    if (manager_) {
+        manager_->addReference(slot_);
+    }
+}
+
+TextureHandle::TextureHandle(TextureHandle &&other) : manager_(other.manager_), slot_(other.slot_) {
+    other.manager_ = NULL;
+}
+
+TextureHandle &TextureHandle::operator=(TextureHandle other) {
+    std::swap(manager_, other.manager_);
+    std::swap(slot_, other.slot_);
+    return *this;
+}
+
+TextureHandle::~TextureHandle() {
+    if (manager_) {
+        manager_->release(slot_);
+    }
+}
+
+GLuint TextureHandle::id() const {
+    return manager_ ? manager_->textures_[slot_].id : 0;
+}
+
+
+TextureManager::TextureManager(size_t budget_bytes) : budget_bytes_(budget_bytes), resident_bytes_(0) {
+}
+
+TextureManager::~TextureManager() {
+    for (const auto &entry : slots_) {
+        GLState::deleteTextures(1, &textures_[entry.second].id);
+    }
+}
+
+TextureHandle TextureManager::acquire(const std::string &filename, int channels) {
+    const std::string key = filename + "#" + std::to_string(channels);
+
+    auto it = slots_.find(key);
+    if (it != slots_.end()) {
+        return TextureHandle(this, it->second);
+    }
+
+    int width = 0, height = 0, file_channels = 0;
+    unsigned char *pixels = SOIL_load_image(filename.c_str(), &width, &height, &file_channels, channels);
+    if (pixels == NULL) {
+        // Not registered, so a later acquire() tries the file again
+        std::cerr << "Could not load texture " << filename << ": " << SOIL_last_result() << std::endl;
+        return TextureHandle();
+    }
+    if (channels != SOIL_LOAD_AUTO) {
+        file_channels = channels;
+    }
+
+    const GLenum formats[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+    const GLint internal_formats[] = {GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+
+    Texture texture;
+    texture.key = key;
+    texture.id = 0;
+    texture.bytes = 0;
+    texture.references = 0;
+    texture.lru = lru_.end();
+
+    glGenTextures(1, &texture.id);
+    GLState::bindTexture(GL_TEXTURE_2D, texture.id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    allocateTexture2D(mipLevelCount(width, height), internal_formats[file_channels - 1], width, height,
+                      formats[file_channels - 1], GL_UNSIGNED_BYTE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, formats[file_channels - 1], GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    GLState::bindTexture(GL_TEXTURE_2D, 0);
+    SOIL_free_image_data(pixels);
+
+    // Full mip chain is about a third on top of the base level
+    texture.bytes = static_cast<size_t>(width) * height * file_channels * 4 / 3;
+
+    size_t slot;
+    if (free_slots_.empty()) {
+        slot = textures_.size();
+        textures_.push_back(texture);
+    } else {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+        textures_[slot] = texture;
+    }
+    slots_[key] = slot;
+    resident_bytes_ += texture.bytes;
+
+    TextureHandle handle(this, slot);
+    evict();
+    return handle;
+}
+
+void TextureManager::setBudget(size_t budget_bytes) {
+    budget_bytes_ = budget_bytes;
+    evict();
+}
+
+void TextureManager::addReference(size_t slot) {
+    Texture &texture = textures_[slot];
+    if (texture.references++ == 0 && texture.lru != lru_.end()) {
+        lru_.erase(texture.lru);
+        texture.lru = lru_.end();
+    }
+}
+
+void TextureManager::release(size_t slot) {
+    Texture &texture = textures_[slot];
+    if (--texture.references == 0) {
+        texture.lru = lru_.insert(lru_.end(), slot);
+        evict();
+    }
+}
+
+void TextureManager::evict() {
+    while (resident_bytes_ > budget_bytes_ && !lru_.empty()) {
+        size_t slot = lru_.front();
+        lru_.pop_front();
+
+        Texture &texture = textures_[slot];
+        GLState::deleteTextures(1, &texture.id);
+        resident_bytes_ -= texture.bytes;
+        slots_.erase(texture.key);
+        free_slots_.push_back(slot);
+
+        texture.id = 0;
+        texture.lru = lru_.end();
+    }
+
+#ifdef MY_DEBUG
+    if (resident_bytes_ > budget_bytes_) {
+        std::cerr << "Referenced textures exceed the budget: " << resident_bytes_ << " bytes" << std::endl;
+    }
+#endif
+}
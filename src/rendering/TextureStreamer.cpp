@@ -0,0 +1,323 @@
+#include <rendering/TextureStreamer.hpp>
+#include <rendering/TextureManager.hpp>
+#include <rendering/GLCapabilities.hpp>
+#include <rendering/GLState.hpp>
+
+#include <SOIL.h>
+#include <stb_image_aug.h>
+extern "C" {
+#include <image_DXT.h>
+#include <image_helper.h>
+}
+
+#include <iostream>
+#include <chrono>
+#include <cstring>
+
+namespace {
+    // Offsets into the staging ring, only needs to keep rows of 4-byte texels aligned
+    const size_t STAGING_ALIGNMENT = 16;
+
+    GLenum formatForChannels(int channels) {
+        switch (channels) {
+            case 1:
+                return GL_RED;
+            case 2:
+                return GL_RG;
+            case 3:
+                return GL_RGB;
+            default:
+                return GL_RGBA;
+        }
+    }
+
+    GLint internalFormatForChannels(int channels) {
+        switch (channels) {
+            case 1:
+                return GL_R8;
+            case 2:
+                return GL_RG8;
+            case 3:
+                return GL_RGB8;
+            default:
+                return GL_RGBA8;
+        }
+    }
+}
+
+TextureStreamer::TextureStreamer(unsigned int threads, size_t staging_bytes)
+        : running_(true), staging_ptr_(NULL), staging_size_(staging_bytes), staging_head_(0), persistent_(false) {
+
+    // Mid grey 1x1 stand-in for textures that are still streaming
+    const unsigned char grey[4] = {128, 128, 128, 255};
+    glGenTextures(1, &placeholder_);
+    GLState::bindTexture(GL_TEXTURE_2D, placeholder_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    allocateTexture2D(1, GL_RGBA8, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    GLState::bindTexture(GL_TEXTURE_2D, 0);
+
+    // Staging ring, persistently mapped when the driver has buffer storage (GL 4.4)
+    glGenBuffers(1, &staging_buffer_);
+    GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, staging_buffer_);
+    if (GLCapabilities::supports("GL_ARB_buffer_storage")) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, staging_size_, NULL, flags);
+        staging_ptr_ = static_cast<unsigned char *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, staging_size_, flags));
+        persistent_ = staging_ptr_ != NULL;
+    } else {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, staging_size_, NULL, GL_STREAM_DRAW);
+    }
+    GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    // The workers already keep every core busy, so the decoders must not each start a thread per core
+    // of their own. The settings are process-wide and not thread safe, so they are made before any worker runs
+    stbi_set_thread_count(1);
+    set_DXT_thread_count(1);
+    set_image_helper_thread_count(1);
+
+    if (threads == 0) {
+        unsigned int cores = std::thread::hardware_concurrency();
+        threads = cores > 1 ? cores - 1 : 1;
+    }
+    for (unsigned int i = 0; i < threads; ++i) {
+        workers_.push_back(std::thread(&TextureStreamer::work, this));
+    }
+}
+
+TextureStreamer::~TextureStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    jobs_available_.notify_all();
+    for (std::thread &worker : workers_) {
+        worker.join();
+    }
+
+    for (Decoded &image : decoded_) {
+        SOIL_free_image_data(image.pixels);
+    }
+    for (Decoded &image : uploads_) {
+        SOIL_free_image_data(image.pixels);
+    }
+
+    retireStaging(true);
+    if (persistent_) {
+        GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, staging_buffer_);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    GLState::deleteBuffers(1, &staging_buffer_);
+
+    for (Entry &entry : entries_) {
+        if (entry.resident) {
+            GLState::deleteTextures(1, &entry.texture);
+        }
+    }
+    GLState::deleteTextures(1, &placeholder_);
+}
+
+TextureStreamer::TextureId TextureStreamer::request(const std::string &filename, int channels) {
+    Entry entry;
+    entry.filename = filename;
+    entry.texture = placeholder_;
+    entry.resident = false;
+    entry.failed = false;
+    entries_.push_back(entry);
+
+    Job job;
+    job.id = entries_.size() - 1;
+    job.filename = filename;
+    job.channels = channels;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back(job);
+    }
+    jobs_available_.notify_one();
+
+    return job.id;
+}
+
+void TextureStreamer::work() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            jobs_available_.wait(lock, [this] { return !running_ || !jobs_.empty(); });
+            if (!running_) {
+                return;
+            }
+            job = jobs_.front();
+            jobs_.pop_front();
+        }
+
+        Decoded image;
+        image.id = job.id;
+        image.pixels = SOIL_load_image(job.filename.c_str(), &image.width, &image.height, &image.channels,
+                                       job.channels);
+        if (image.pixels == NULL) {
+            // The result is thread local, the GL thread would see its own
+            image.error = SOIL_last_result();
+        }
+        // SOIL reports the channel count of the file, not of the forced format
+        if (job.channels != SOIL_LOAD_AUTO) {
+            image.channels = job.channels;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        decoded_.push_back(image);
+    }
+}
+
+void TextureStreamer::update(double budget_ms) {
+    typedef std::chrono::high_resolution_clock Clock;
+    Clock::time_point start = Clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uploads_.insert(uploads_.end(), decoded_.begin(), decoded_.end());
+        decoded_.clear();
+    }
+
+    retireStaging(false);
+
+    bool uploaded = false;
+    while (!uploads_.empty()) {
+        if (uploaded && std::chrono::duration<double, std::milli>(Clock::now() - start).count() >= budget_ms) {
+            break;
+        }
+
+        const Decoded &image = uploads_.front();
+        if (image.pixels == NULL) {
+            std::cerr << "Could not load texture " << entries_[image.id].filename << ": " << image.error << std::endl;
+            entries_[image.id].failed = true;
+        } else {
+            upload(image);
+            SOIL_free_image_data(image.pixels);
+        }
+
+        uploads_.pop_front();
+        uploaded = true;
+    }
+}
+
+void TextureStreamer::finish() {
+    while (pending() > 0) {
+        update(1e9);
+        if (pending() > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+GLuint TextureStreamer::texture(TextureId id) const {
+    return entries_[id].texture;
+}
+
+bool TextureStreamer::isResident(TextureId id) const {
+    return entries_[id].resident;
+}
+
+size_t TextureStreamer::pending() const {
+    size_t count = 0;
+    for (const Entry &entry : entries_) {
+        if (!entry.resident && !entry.failed) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+void TextureStreamer::retireStaging(bool wait) {
+    while (!in_flight_.empty()) {
+        GLenum status = glClientWaitSync(in_flight_.front().fence, 0, wait ? GL_TIMEOUT_IGNORED : 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            return;
+        }
+        glDeleteSync(in_flight_.front().fence);
+        in_flight_.pop_front();
+    }
+}
+
+bool TextureStreamer::allocateStaging(size_t bytes, size_t &offset) {
+    bytes = (bytes + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+    if (bytes > staging_size_) {
+        return false;
+    }
+
+    if (in_flight_.empty()) {
+        offset = 0;
+    } else {
+        // The used part of the ring runs from the oldest in-flight upload to the head
+        size_t tail = in_flight_.front().begin;
+        if (staging_head_ > tail) {
+            if (staging_head_ + bytes <= staging_size_) {
+                offset = staging_head_;
+            } else if (bytes <= tail) {
+                offset = 0;
+            } else {
+                return false;
+            }
+        } else if (staging_head_ < tail && staging_head_ + bytes <= tail) {
+            offset = staging_head_;
+        } else {
+            return false;
+        }
+    }
+
+    staging_head_ = offset + bytes;
+    return true;
+}
+
+void TextureStreamer::upload(const Decoded &image) {
+    const size_t bytes = static_cast<size_t>(image.width) * image.height * image.channels;
+    const GLenum format = formatForChannels(image.channels);
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    GLState::bindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    allocateTexture2D(mipLevelCount(image.width, image.height), internalFormatForChannels(image.channels),
+                      image.width, image.height, format, GL_UNSIGNED_BYTE);
+
+    // SOIL rows are tightly packed
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    size_t offset = 0;
+    if (allocateStaging(bytes, offset)) {
+        GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, staging_buffer_);
+        if (persistent_) {
+            memcpy(staging_ptr_ + offset, image.pixels, bytes);
+        } else {
+            // Fenced ring regions are never in use by the GPU, so no implicit sync is needed
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+            void *ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, bytes, flags);
+            memcpy(ptr, image.pixels, bytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, format, GL_UNSIGNED_BYTE,
+                        reinterpret_cast<const GLvoid *>(offset));
+        GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        InFlight region;
+        region.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        region.begin = offset;
+        in_flight_.push_back(region);
+    } else {
+        // Larger than the free part of the ring, upload straight from client memory
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, format, GL_UNSIGNED_BYTE,
+                        image.pixels);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    GLState::bindTexture(GL_TEXTURE_2D, 0);
+
+    entries_[image.id].texture = texture;
+    entries_[image.id].resident = true;
+}
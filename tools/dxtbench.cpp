@@ -0,0 +1,185 @@
+// dxtbench: block compression quality versus time.
+// Encodes each image as DXT1, DXT5, BC4 and BC5 at every encoder quality level, decodes the result
+// again and reports the encode time and the PSNR over the channels that format stores.
+//
+// Usage: dxtbench [--threads N] <image>...   (N = 0 uses one thread per CPU, default 1)
+
+#include <SOIL.h>
+
+extern "C" {
+#include <image_DXT.h>
+}
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+enum Format { DXT1, DXT5, BC4, BC5 };
+
+const char *format_names[] = {"DXT1", "DXT5", "BC4", "BC5"};
+const char *quality_names[] = {"fast", "normal", "high"};
+
+void decode565(unsigned int c, int rgb[3]) {
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// Decodes a DXT1 color block into the RGB of 16 RGBA pixels
+void decodeColorBlock(const unsigned char *block, unsigned char out[16 * 4]) {
+    unsigned int c0 = block[0] | (block[1] << 8);
+    unsigned int c1 = block[2] | (block[3] << 8);
+    int palette[4][3];
+    decode565(c0, palette[0]);
+    decode565(c1, palette[1]);
+    for (int k = 0; k < 3; ++k) {
+        if (c0 > c1) {
+            palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+            palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+        } else {
+            palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+            palette[3][k] = 0;
+        }
+    }
+    unsigned int bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((unsigned int)block[7] << 24);
+    for (int i = 0; i < 16; ++i) {
+        const int *c = palette[(bits >> (2 * i)) & 3];
+        out[i * 4 + 0] = c[0];
+        out[i * 4 + 1] = c[1];
+        out[i * 4 + 2] = c[2];
+    }
+}
+
+// Decodes a DXT5 alpha / BC4 block into one channel of 16 RGBA pixels
+void decodeChannelBlock(const unsigned char *block, unsigned char out[16 * 4], int channel) {
+    int a0 = block[0], a1 = block[1];
+    int palette[8] = {a0, a1};
+    for (int k = 2; k < 8; ++k) {
+        palette[k] = a0 > a1 ? ((8 - k) * a0 + (k - 1) * a1) / 7
+                             : (k < 6 ? ((6 - k) * a0 + (k - 1) * a1) / 5 : (k == 6 ? 0 : 255));
+    }
+    unsigned long long bits = 0;
+    for (int k = 0; k < 6; ++k) {
+        bits |= (unsigned long long)block[2 + k] << (8 * k);
+    }
+    for (int i = 0; i < 16; ++i) {
+        out[i * 4 + channel] = palette[(bits >> (3 * i)) & 7];
+    }
+}
+
+// PSNR of the compressed image over the channels the format keeps
+double measure(Format format, const unsigned char *blocks, const unsigned char *image, int width, int height) {
+    int blockBytes = (format == DXT5 || format == BC5) ? 16 : 8;
+    int blocksX = (width + 3) / 4;
+    double error = 0.0;
+    long samples = 0;
+    unsigned char pixels[16 * 4];
+    for (int by = 0; by < (height + 3) / 4; ++by) {
+        for (int bx = 0; bx < blocksX; ++bx) {
+            const unsigned char *block = blocks + (by * blocksX + bx) * blockBytes;
+            int first = 0, count = 3;
+            switch (format) {
+            case DXT1:
+                decodeColorBlock(block, pixels);
+                break;
+            case DXT5:
+                decodeChannelBlock(block, pixels, 3);
+                decodeColorBlock(block + 8, pixels);
+                count = 4;
+                break;
+            case BC4:
+                decodeChannelBlock(block, pixels, 0);
+                count = 1;
+                break;
+            case BC5:
+                decodeChannelBlock(block, pixels, 0);
+                decodeChannelBlock(block + 8, pixels, 1);
+                count = 2;
+                break;
+            }
+            for (int y = 0; y < 4 && by * 4 + y < height; ++y) {
+                for (int x = 0; x < 4 && bx * 4 + x < width; ++x) {
+                    const unsigned char *src = image + ((by * 4 + y) * width + bx * 4 + x) * 4;
+                    for (int k = first; k < first + count; ++k) {
+                        double d = (double)src[k] - pixels[(y * 4 + x) * 4 + k];
+                        error += d * d;
+                        ++samples;
+                    }
+                }
+            }
+        }
+    }
+    double mse = error / samples;
+    return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int threads = 1;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            threads = std::atoi(argv[++i]);
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    if (files.empty()) {
+        std::cerr << "Usage: dxtbench [--threads N] <image>..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    set_DXT_thread_count(threads);
+    std::cout << std::fixed;
+    for (const std::string &file : files) {
+        int width, height, channels;
+        unsigned char *image = SOIL_load_image(file.c_str(), &width, &height, &channels, SOIL_LOAD_RGBA);
+        if (image == NULL) {
+            std::cerr << "Could not load " << file << ": " << SOIL_last_result() << std::endl;
+            continue;
+        }
+
+        std::cout << file << " (" << width << "x" << height << ")\n";
+        std::cout << "  format  quality      ms    MPix/s   PSNR dB\n";
+        for (int format = DXT1; format <= BC5; ++format) {
+            for (int quality = SOIL_DXT_QUALITY_FAST; quality <= SOIL_DXT_QUALITY_HIGH; ++quality) {
+                set_DXT_quality(quality);
+                int size = 0;
+                auto start = std::chrono::steady_clock::now();
+                unsigned char *blocks = NULL;
+                switch (format) {
+                case DXT1: blocks = convert_image_to_DXT1(image, width, height, 4, &size); break;
+                case DXT5: blocks = convert_image_to_DXT5(image, width, height, 4, &size); break;
+                case BC4: blocks = convert_image_to_BC4(image, width, height, 4, &size); break;
+                case BC5: blocks = convert_image_to_BC5(image, width, height, 4, &size); break;
+                }
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                if (blocks == NULL) {
+                    std::cerr << "Compression failed" << std::endl;
+                    return EXIT_FAILURE;
+                }
+
+                double psnr = measure((Format)format, blocks, image, width, height);
+                free(blocks);
+                std::cout << "  " << std::setw(6) << std::left << format_names[format] << "  " << std::setw(7)
+                          << quality_names[quality] << std::right << std::setprecision(2) << std::setw(8) << ms
+                          << std::setw(10) << (width * (double)height / 1000.0 / ms) << std::setw(10) << psnr
+                          << "\n";
+            }
+        }
+        SOIL_free_image_data(image);
+    }
+    set_DXT_quality(SOIL_DXT_QUALITY_NORMAL);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+// texbake: offline texture baking.
+// Decodes an image once, builds the full mip chain and block-compresses every level into a DDS
+// file that loadCompressedTexture() uploads directly, with no decoding or mip generation at runtime.
+// BC4 keeps the first channel (heightmaps, masks), BC5 the first two (normal map X/Y).
+// --srgb averages the mip levels in linear light, for color textures sampled as sRGB.
+//
+// Usage: texbake [--dxt1|--dxt5|--bc4|--bc5] [--fast|--high] [--srgb] <input image> <output.dds>
+
+#include <SOIL.h>
+
+extern "C" {
+#include <image_DXT.h>
+#include <image_helper.h>
+}
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char **argv) {
+    int format = 0; // 1 = DXT1, 5 = DXT5, 4 = BC4, 6 = BC5, 0 = DXT1/5 by alpha channel
+    int quality = SOIL_DXT_QUALITY_NORMAL;
+    bool srgb = false;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--dxt1") {
+            format = 1;
+        } else if (arg == "--dxt5") {
+            format = 5;
+        } else if (arg == "--bc4") {
+            format = 4;
+        } else if (arg == "--bc5") {
+            format = 6;
+        } else if (arg == "--fast") {
+            quality = SOIL_DXT_QUALITY_FAST;
+        } else if (arg == "--high") {
+            quality = SOIL_DXT_QUALITY_HIGH;
+        } else if (arg == "--srgb") {
+            srgb = true;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    if (files.size() != 2) {
+        std::cerr << "Usage: texbake [--dxt1|--dxt5|--bc4|--bc5] [--fast|--high] [--srgb] <input image> <output.dds>"
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int width, height, channels;
+    unsigned char *image = SOIL_load_image(files[0].c_str(), &width, &height, &channels, SOIL_LOAD_AUTO);
+    if (image == NULL) {
+        std::cerr << "Could not load " << files[0] << ": " << SOIL_last_result() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (format == 0) {
+        format = (channels & 1) ? 1 : 5;
+    }
+    set_DXT_quality(quality);
+
+    // Encode level after level, each one box-filtered from the previous
+    std::vector<unsigned char> levels_data;
+    int levels = 0;
+    int top_level_size = 0;
+    std::vector<unsigned char> level(image, image + width * height * channels);
+    SOIL_free_image_data(image);
+
+    int w = width, h = height;
+    while (true) {
+        int size = 0;
+        unsigned char *compressed = NULL;
+        switch (format) {
+        case 1: compressed = convert_image_to_DXT1(level.data(), w, h, channels, &size); break;
+        case 5: compressed = convert_image_to_DXT5(level.data(), w, h, channels, &size); break;
+        case 4: compressed = convert_image_to_BC4(level.data(), w, h, channels, &size); break;
+        case 6: compressed = convert_image_to_BC5(level.data(), w, h, channels, &size); break;
+        }
+        if (compressed == NULL) {
+            std::cerr << "Block compression failed at level " << levels << std::endl;
+            return EXIT_FAILURE;
+        }
+        levels_data.insert(levels_data.end(), compressed, compressed + size);
+        free(compressed);
+
+        if (levels == 0) {
+            top_level_size = size;
+        }
+        ++levels;
+
+        if (w == 1 && h == 1) {
+            break;
+        }
+
+        int mip_w = w > 1 ? w / 2 : 1;
+        int mip_h = h > 1 ? h / 2 : 1;
+        std::vector<unsigned char> mip(mip_w * mip_h * channels);
+        if (srgb) {
+            mipmap_image_sRGB(level.data(), w, h, channels, mip.data(), w > 1 ? 2 : 1, h > 1 ? 2 : 1);
+        } else {
+            mipmap_image(level.data(), w, h, channels, mip.data(), w > 1 ? 2 : 1, h > 1 ? 2 : 1);
+        }
+        level.swap(mip);
+        w = mip_w;
+        h = mip_h;
+    }
+
+    DDS_header header;
+    memset(&header, 0, sizeof(header));
+    header.dwMagic = ('D' << 0) | ('D' << 8) | ('S' << 16) | (' ' << 24);
+    header.dwSize = 124;
+    header.dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE | DDSD_MIPMAPCOUNT;
+    header.dwWidth = width;
+    header.dwHeight = height;
+    header.dwPitchOrLinearSize = top_level_size;
+    header.dwMipMapCount = levels;
+    header.sPixelFormat.dwSize = 32;
+    header.sPixelFormat.dwFlags = DDPF_FOURCC;
+    if (format == 4 || format == 6) {
+        header.sPixelFormat.dwFourCC = ('A' << 0) | ('T' << 8) | ('I' << 16) | ((format == 4 ? '1' : '2') << 24);
+    } else {
+        header.sPixelFormat.dwFourCC = ('D' << 0) | ('X' << 8) | ('T' << 16) | ((format == 1 ? '1' : '5') << 24);
+    }
+    header.sCaps.dwCaps1 = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+
+    std::ofstream ofs(files[1].c_str(), std::ios::binary | std::ios::trunc);
+    if (!ofs.is_open()) {
+        std::cerr << "Could not write " << files[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+    ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<const char *>(levels_data.data()), levels_data.size());
+
+    const char *format_name = format == 4 ? "BC4" : (format == 6 ? "BC5" : (format == 1 ? "DXT1" : "DXT5"));
+    std::cout << files[0] << " -> " << files[1] << ": " << width << "x" << height << ", " << levels << " levels, "
+              << format_name << ", " << levels_data.size() << " bytes\n";
+    return EXIT_SUCCESS;
+}